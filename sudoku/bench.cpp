@@ -0,0 +1,554 @@
+#include "sudoku.cpp"
+#include "sudoku_canon.cpp"
+#include "sudoku_grade.cpp"
+#include "sudoku_board.cpp"
+#include "sudoku_simd.cpp"
+#include "sudoku_batch.cpp"
+
+// benchmark every engine and the hot kernels, results as json so builds can be diffed
+//
+// bench [data file] [json file] [max puzzles] [timeout ms] [max nodes]
+//
+// part one solve the sudokus/ set and a data/ corpus with every engine, one puzzle
+// at a time on one thread, and report puzzles/sec, ns/puzzle percentiles and
+// guesses/puzzle. every puzzle get its own budget so the plain backtrackers
+// can't stall the run on a hard corpus, those puzzles are counted as gave up.
+// part two time the small kernels in a tight loop over the sudokus/ set.
+
+#define BENCH_STRIDE (9 * 9 + 32) // sse_is_valid_9 load 16 bytes from the last row
+#define BENCH_KERNEL_REPEAT 5     // best of, to keep noise out of ns/op
+
+struct BenchCorpus {
+    const char *name;
+    u8 *puzzles;    // count * BENCH_STRIDE
+    u8 *solutions;  // known answers, 0 when only the rules can be checked
+    u32 count;
+};
+
+struct BenchContext {
+    SudokuTrail *trail;
+    u16 possible[9 * 9 * 3];
+};
+
+typedef bool (*bench_solver)(BenchContext *context, u8 *sudoku, u32 *num_guess, SudokuBudget *budget);
+
+struct BenchEngine {
+    const char *name;
+    bench_solver solve;
+};
+
+bool bench_backtrack(BenchContext*, u8 *sudoku, u32 *num_guess, SudokuBudget *budget)
+{
+    return sudoku_backtrack(sudoku, 0, 9, 9, 3, num_guess, budget);
+}
+
+bool bench_backtrack_r(BenchContext*, u8 *sudoku, u32 *num_guess, SudokuBudget *budget)
+{
+    return sudoku_backtrack_r(sudoku, 0, 9, 9, 3, num_guess, budget);
+}
+
+bool bench_backtrack_min(BenchContext*, u8 *sudoku, u32 *num_guess, SudokuBudget *budget)
+{
+    return sudoku_backtrack_min(sudoku, 9, 9, 3, num_guess, budget);
+}
+
+bool bench_backtrack_with_possible(BenchContext *context, u8 *sudoku, u32 *num_guess, SudokuBudget *budget)
+{
+    memset(context->possible, 0, sizeof(context->possible));
+    sudoku_fill_possible(sudoku, context->possible, 9, 9, 3);
+    int index = find_free(sudoku, 0, 9 * 9);
+    return sudoku_backtrack_with_possible(sudoku, context->possible, index, 9, 9, 3, num_guess, budget);
+}
+
+bool bench_backtrack_heuristic(BenchContext *context, u8 *sudoku, u32 *num_guess, SudokuBudget *budget)
+{
+    memset(context->possible, 0, sizeof(context->possible));
+    sudoku_fill_possible(sudoku, context->possible, 9, 9, 3);
+    return sudoku_backtrack_heuristic(sudoku, context->possible, 9, 9, 3, num_guess, 0, 0, budget);
+}
+
+bool bench_trail(BenchContext *context, u8 *sudoku, u32 *num_guess, SudokuBudget *budget)
+{
+    return sudoku_solve_with_trail(sudoku, 9, 9, 3, context->trail, num_guess, SUDOKU_PROPAGATE_NONE, budget);
+}
+
+bool bench_singles(BenchContext *context, u8 *sudoku, u32 *num_guess, SudokuBudget *budget)
+{
+    return sudoku_solve_with_trail(sudoku, 9, 9, 3, context->trail, num_guess, SUDOKU_PROPAGATE_SINGLES, budget);
+}
+
+bool bench_subsets(BenchContext *context, u8 *sudoku, u32 *num_guess, SudokuBudget *budget)
+{
+    return sudoku_solve_with_trail(sudoku, 9, 9, 3, context->trail, num_guess, SUDOKU_PROPAGATE_SINGLES | SUDOKU_PROPAGATE_SUBSETS, budget);
+}
+
+bool bench_dlx(BenchContext *context, u8 *sudoku, u32 *num_guess, SudokuBudget *budget)
+{
+    memset(context->possible, 0, sizeof(context->possible));
+    sudoku_fill_possible(sudoku, context->possible, 9, 9, 3);
+    return sudoku_backtrack_dlx(sudoku, context->possible, 9, 9, 3, num_guess, 0, 0, budget);
+}
+
+bool bench_board(BenchContext*, u8 *sudoku, u32 *num_guess, SudokuBudget *budget)
+{
+    return sudoku_solve_board(sudoku, 3, num_guess, budget);
+}
+
+static BenchEngine bench_engines[] = {
+    {"backtrack", bench_backtrack},
+    {"backtrack_r", bench_backtrack_r},
+    {"backtrack_min", bench_backtrack_min},
+    {"backtrack_with_possible", bench_backtrack_with_possible},
+    {"backtrack_heuristic", bench_backtrack_heuristic},
+    {"trail", bench_trail},
+    {"singles", bench_singles},
+    {"subsets", bench_subsets},
+    {"dlx", bench_dlx},
+    {"board", bench_board},
+    {"simd", 0}, // whole lanes at once, see bench_run_simd
+};
+
+struct BenchResult {
+    u32 solved;
+    u32 failed;  // wrong answer or no answer for a valid puzzle
+    u32 gave_up;
+    u64 total_guess;
+    double seconds;
+    u64 *ns;     // one per puzzle
+};
+
+bool bench_load_sudokus(BenchCorpus *corpus)
+{
+    const u32 max_size = 9 * 9;
+    u32 capacity = 16 * 3;
+    corpus->name = "sudokus";
+    corpus->puzzles = (u8*)calloc(capacity, BENCH_STRIDE);
+    corpus->solutions = (u8*)calloc(capacity, max_size);
+    corpus->count = 0;
+    
+    // same set as run_tests, s01a .. s15c then s16
+    for (u32 k = 0; k < 15 * 3 + 1; ++k)
+    {
+        char fproblem[64];
+        char fsolution[64];
+        if (k < 15 * 3) {
+            sprintf(fproblem, "sudokus/s%02d%c.txt", k / 3 + 1, 'a' + k % 3);
+            sprintf(fsolution, "solutions/s%02d%c_s.txt", k / 3 + 1, 'a' + k % 3);
+        }
+        else {
+            sprintf(fproblem, "sudokus/s16.txt");
+            sprintf(fsolution, "solutions/s16_s.txt");
+        }
+        
+        u8 *sudoku = corpus->puzzles + corpus->count * BENCH_STRIDE;
+        u8 *solution = corpus->solutions + corpus->count * max_size;
+        if (read_sudoku_file(fproblem, sudoku, 9, 9, max_size) && read_sudoku_file(fsolution, solution, 9, 9, max_size))
+            ++corpus->count;
+    }
+    
+    return corpus->count > 0;
+}
+
+bool bench_load_data(BenchCorpus *corpus, char *fname, u32 max_puzzles)
+{
+    DataReader reader;
+    if (!data_reader_open(&reader, fname))
+        return false;
+    
+    corpus->name = fname;
+    corpus->puzzles = (u8*)calloc(max_puzzles, BENCH_STRIDE);
+    corpus->solutions = 0;
+    corpus->count = 0;
+    while (corpus->count < max_puzzles && data_reader_next(&reader, corpus->puzzles + corpus->count * BENCH_STRIDE, 9, 9 * 9))
+        ++corpus->count;
+    
+    data_reader_close(&reader);
+    return corpus->count > 0;
+}
+
+void bench_free_corpus(BenchCorpus *corpus)
+{
+    free(corpus->puzzles);
+    if (corpus->solutions) free(corpus->solutions);
+}
+
+// solved grid is right when it match the known answer, or just follow the rules and keep the givens
+bool bench_check(BenchCorpus *corpus, u32 k, u8 *sudoku)
+{
+    const u32 max_size = 9 * 9;
+    if (corpus->solutions)
+        return memcmp(sudoku, corpus->solutions + k * max_size, max_size) == 0;
+    
+    u8 *puzzle = corpus->puzzles + k * BENCH_STRIDE;
+    for (u32 i = 0; i < max_size; ++i)
+    {
+        if (puzzle[i] && puzzle[i] != sudoku[i])
+            return false;
+    }
+    
+    return sudoku_check_board(sudoku, 3);
+}
+
+void bench_record(BenchResult *result, BenchCorpus *corpus, u32 k, u8 *sudoku, bool solved, SudokuBudget *budget)
+{
+    if (solved && bench_check(corpus, k, sudoku))
+        ++result->solved;
+    else if (!solved && budget->gave_up)
+        ++result->gave_up;
+    else
+        ++result->failed;
+}
+
+void bench_run_engine(BenchEngine *engine, BenchCorpus *corpus, BenchContext *context, BenchResult *result, u64 max_nodes, double timeout)
+{
+    u8 sudoku[BENCH_STRIDE];
+    for (u32 k = 0; k < corpus->count; ++k)
+    {
+        memcpy(sudoku, corpus->puzzles + k * BENCH_STRIDE, BENCH_STRIDE);
+        
+        SudokuBudget budget;
+        sudoku_budget_init(&budget, max_nodes, timeout);
+        u32 num_guess = 0;
+        
+        double time_start = platform_time();
+        bool solved = engine->solve(context, sudoku, &num_guess, &budget);
+        double elapsed = platform_time() - time_start;
+        
+        result->seconds += elapsed;
+        result->ns[k] = (u64)(elapsed * 1e9);
+        result->total_guess += num_guess;
+        bench_record(result, corpus, k, sudoku, solved, &budget);
+    }
+}
+
+// simd engine solve SIMD_LANES puzzles per call, every puzzle of a batch get the batch time / lanes
+void bench_run_simd(BenchCorpus *corpus, BenchContext *context, BenchResult *result, u64 max_nodes, double timeout)
+{
+    u8 sudokus[SIMD_LANES][BENCH_STRIDE];
+    u8 *lanes[SIMD_LANES];
+    bool solved[SIMD_LANES];
+    u32 num_guess[SIMD_LANES];
+    SudokuBudget budgets[SIMD_LANES];
+    
+    for (u32 begin = 0; begin < corpus->count; begin += SIMD_LANES)
+    {
+        u32 count = corpus->count - begin < SIMD_LANES ? corpus->count - begin : SIMD_LANES;
+        for (u32 l = 0; l < count; ++l)
+        {
+            memcpy(sudokus[l], corpus->puzzles + (begin + l) * BENCH_STRIDE, BENCH_STRIDE);
+            lanes[l] = sudokus[l];
+            sudoku_budget_init(budgets + l, max_nodes, timeout);
+        }
+        
+        double time_start = platform_time();
+        sudoku_solve_simd(lanes, count, solved, num_guess, context->trail, budgets);
+        double elapsed = platform_time() - time_start;
+        
+        result->seconds += elapsed;
+        for (u32 l = 0; l < count; ++l)
+        {
+            result->ns[begin + l] = (u64)(elapsed * 1e9 / count);
+            result->total_guess += num_guess[l];
+            bench_record(result, corpus, begin + l, sudokus[l], solved[l], budgets + l);
+        }
+    }
+}
+
+int bench_compare_u64(const void *a, const void *b)
+{
+    u64 x = *(u64*)a;
+    u64 y = *(u64*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// nearest rank on sorted values
+inline u64 bench_percentile(u64 *sorted, u32 count, u32 percent)
+{
+    return sorted[(u64)(count - 1) * percent / 100];
+}
+
+void bench_write_result(FILE *out, const char *name, BenchResult *result, u32 count, bool last)
+{
+    qsort(result->ns, count, sizeof(u64), bench_compare_u64);
+    
+    fprintf(out, "        {\"engine\": \"%s\", \"puzzles\": %u, \"solved\": %u, \"failed\": %u, \"gave_up\": %u, ",
+            name, count, result->solved, result->failed, result->gave_up);
+    fprintf(out, "\"seconds\": %.6f, \"puzzles_per_sec\": %.1f, \"guesses_per_puzzle\": %.3f, ",
+            result->seconds, count / (result->seconds > 0 ? result->seconds : 1e-9), (double)result->total_guess / count);
+    fprintf(out, "\"ns\": {\"min\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu}}%s\n",
+            result->ns[0], bench_percentile(result->ns, count, 50), bench_percentile(result->ns, count, 90),
+            bench_percentile(result->ns, count, 99), result->ns[count - 1], last ? "" : ",");
+}
+
+// corpus names are paths, a windows one is full of backslashes
+void bench_write_json_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (; *text; ++text)
+    {
+        if (*text == '"' || *text == '\\')
+            fputc('\\', out);
+        fputc(*text, out);
+    }
+    fputc('"', out);
+}
+
+void bench_corpus(FILE *out, BenchCorpus *corpus, BenchContext *context, u64 max_nodes, double timeout, bool last)
+{
+    fprintf(out, "    {\"corpus\": ");
+    bench_write_json_string(out, corpus->name);
+    fprintf(out, ", \"puzzles\": %u, \"engines\": [\n", corpus->count);
+    
+    BenchResult result;
+    u64 *ns = (u64*)malloc(corpus->count * sizeof(u64));
+    for (u32 e = 0; e < array_count(bench_engines); ++e)
+    {
+        BenchEngine *engine = bench_engines + e;
+        fprintf(stderr, "%s: %s\n", corpus->name, engine->name);
+        
+        memset(&result, 0, sizeof(result));
+        result.ns = ns;
+        if (engine->solve)
+            bench_run_engine(engine, corpus, context, &result, max_nodes, timeout);
+        else
+            bench_run_simd(corpus, context, &result, max_nodes, timeout);
+        
+        bench_write_result(out, engine->name, &result, corpus->count, e + 1 == array_count(bench_engines));
+    }
+    free(ns);
+    
+    fprintf(out, "    ]}%s\n", last ? "" : ",");
+}
+
+// kernels, each return a value folded into bench_sink so the loop can't be thrown away
+static volatile u64 bench_sink;
+
+struct BenchKernelInput {
+    BenchCorpus *corpus;
+    u16 *possible; // filled candidate table of every puzzle, 9 * 9 per puzzle
+    u16 masks[1 << 10];
+};
+
+typedef u64 (*bench_kernel)(BenchKernelInput *input, u64 *ops);
+
+u64 bench_kernel_valid(BenchKernelInput *input, u64 *ops)
+{
+    u64 sum = 0;
+    for (u32 k = 0; k < input->corpus->count; ++k)
+    {
+        u8 *sudoku = input->corpus->puzzles + k * BENCH_STRIDE;
+        for (int i = 0; i < 9 * 9; ++i)
+            for (u8 val = 1; val <= 9; ++val)
+                sum += valid(sudoku, val, i, 9, 9, 3);
+    }
+    *ops = (u64)input->corpus->count * 9 * 9 * 9;
+    return sum;
+}
+
+u64 bench_kernel_sse_is_valid_9(BenchKernelInput *input, u64 *ops)
+{
+    u64 sum = 0;
+    for (u32 k = 0; k < input->corpus->count; ++k)
+    {
+        u8 *sudoku = input->corpus->puzzles + k * BENCH_STRIDE;
+        for (u32 row = 0; row < 9; ++row)
+            for (u8 val = 1; val <= 9; ++val)
+                sum += sse_is_valid_9(sudoku + row * 9, val);
+    }
+    *ops = (u64)input->corpus->count * 9 * 9;
+    return sum;
+}
+
+// every op restore the table first (a 162 byte copy) then place the first candidate of one open cell
+u64 bench_kernel_reduce_possible(BenchKernelInput *input, u64 *ops)
+{
+    const u32 max_size = 9 * 9;
+    u16 possible[max_size];
+    u64 sum = 0;
+    u64 count = 0;
+    for (u32 k = 0; k < input->corpus->count; ++k)
+    {
+        u8 *sudoku = input->corpus->puzzles + k * BENCH_STRIDE;
+        u16 *table = input->possible + k * max_size;
+        for (u32 i = 0; i < max_size; ++i)
+        {
+            if (sudoku[i] || !table[i])
+                continue;
+            
+            memcpy(possible, table, sizeof(possible));
+            sum += sudoku_reduce_possible(sudoku, possible, i, lowest_bit_index(table[i]), 9, 9, 3);
+            ++count;
+        }
+    }
+    *ops = count;
+    return sum;
+}
+
+u64 bench_kernel_find_possible_min(BenchKernelInput *input, u64 *ops)
+{
+    const u32 max_size = 9 * 9;
+    u64 sum = 0;
+    for (u32 k = 0; k < input->corpus->count; ++k)
+        sum += find_possible_min_from_table(input->corpus->puzzles + k * BENCH_STRIDE, input->possible + k * max_size, max_size);
+    *ops = input->corpus->count;
+    return sum;
+}
+
+u64 bench_kernel_count_set_bits(BenchKernelInput *input, u64 *ops)
+{
+    u64 sum = 0;
+    for (u32 i = 0; i < array_count(input->masks); ++i)
+        sum += count_set_bits(input->masks[i]);
+    *ops = array_count(input->masks);
+    return sum;
+}
+
+struct BenchKernel {
+    const char *name;
+    bench_kernel run;
+};
+
+static BenchKernel bench_kernels[] = {
+    {"valid", bench_kernel_valid},
+    {"sse_is_valid_9", bench_kernel_sse_is_valid_9},
+    {"sudoku_reduce_possible", bench_kernel_reduce_possible},
+    {"find_possible_min_from_table", bench_kernel_find_possible_min},
+    {"count_set_bits", bench_kernel_count_set_bits},
+};
+
+// repeat every kernel for about min_seconds, best of BENCH_KERNEL_REPEAT rounds
+void bench_kernels_run(FILE *out, BenchCorpus *corpus, double min_seconds)
+{
+    const u32 max_size = 9 * 9;
+    BenchKernelInput input;
+    input.corpus = corpus;
+    input.possible = (u16*)calloc(corpus->count, max_size * 3 * sizeof(u16));
+    for (u32 k = 0; k < corpus->count; ++k)
+    {
+        // fill_possible want room for the hidden pair / single planes, keep only the first plane
+        u16 table[max_size * 3] = {};
+        sudoku_fill_possible(corpus->puzzles + k * BENCH_STRIDE, table, 9, 9, 3);
+        memcpy(input.possible + k * max_size, table, max_size * sizeof(u16));
+    }
+    for (u32 i = 0; i < array_count(input.masks); ++i)
+        input.masks[i] = (u16)(i << 1); // every 9x9 candidate mask
+    
+    fprintf(out, "  \"kernels\": [\n");
+    for (u32 n = 0; n < array_count(bench_kernels); ++n)
+    {
+        BenchKernel *kernel = bench_kernels + n;
+        fprintf(stderr, "kernel: %s\n", kernel->name);
+        
+        // calibrate the loop count so one round last about min_seconds
+        u64 ops = 0;
+        u64 iterations = 1;
+        for (;;)
+        {
+            double time_start = platform_time();
+            for (u64 it = 0; it < iterations; ++it)
+                bench_sink += kernel->run(&input, &ops);
+            if (platform_time() - time_start >= min_seconds || iterations >= (1ull << 40))
+                break;
+            iterations *= 2;
+        }
+        
+        double best = 0;
+        for (u32 r = 0; r < BENCH_KERNEL_REPEAT; ++r)
+        {
+            double time_start = platform_time();
+            for (u64 it = 0; it < iterations; ++it)
+                bench_sink += kernel->run(&input, &ops);
+            double elapsed = platform_time() - time_start;
+            if (r == 0 || elapsed < best)
+                best = elapsed;
+        }
+        
+        u64 total_ops = ops * iterations;
+        fprintf(out, "    {\"kernel\": \"%s\", \"ops\": %llu, \"seconds\": %.6f, \"ns_per_op\": %.3f}%s\n",
+                kernel->name, total_ops, best, best * 1e9 / (total_ops ? total_ops : 1),
+                n + 1 == array_count(bench_kernels) ? "" : ",");
+    }
+    fprintf(out, "  ]\n");
+    
+    free(input.possible);
+}
+
+void bench_write_build(FILE *out, u64 max_nodes, double timeout)
+{
+#if defined(_MSC_VER)
+    fprintf(out, "  \"compiler\": \"msvc %d\",\n", _MSC_VER);
+#elif defined(__VERSION__)
+    fprintf(out, "  \"compiler\": \"%s\",\n", __VERSION__);
+#else
+    fprintf(out, "  \"compiler\": \"unknown\",\n");
+#endif
+#ifdef __AVX2__
+    fprintf(out, "  \"avx2\": true,\n");
+#else
+    fprintf(out, "  \"avx2\": false,\n");
+#endif
+    fprintf(out, "  \"simd_lanes\": %d,\n", SIMD_LANES);
+    fprintf(out, "  \"time\": %lld,\n", (long long)time(0));
+    fprintf(out, "  \"max_nodes\": %llu,\n", max_nodes);
+    fprintf(out, "  \"timeout_ms\": %.1f,\n", timeout * 1000.0);
+}
+
+int main(int argc, char **argv)
+{
+    char default_data_fname[] = "data/puzzles2_17_clue";
+    char *data_fname = default_data_fname;
+    if (argc > 1)
+        data_fname = argv[1];
+    char *out_fname = argc > 2 ? argv[2] : 0;
+    u32 max_puzzles = argc > 3 ? atoi(argv[3]) : 1000;
+    double timeout = (argc > 4 ? atof(argv[4]) : 100.0) / 1000.0;
+    u64 max_nodes = argc > 5 ? strtoull(argv[5], 0, 10) : 0;
+    
+    FILE *out = out_fname ? fopen(out_fname, "wb") : stdout;
+    if (!out)
+        return 1;
+    
+    simd_init_tables();
+    sudoku_subset_table_init();
+    sudoku_board_init_tables();
+    
+    BenchContext context = {};
+    context.trail = (SudokuTrail*)malloc(sizeof(SudokuTrail));
+    
+    BenchCorpus corpora[2];
+    u32 corpus_count = 0;
+    if (bench_load_sudokus(corpora + corpus_count))
+        ++corpus_count;
+    else
+        fprintf(stderr, "can't read sudokus/, run from the sudoku directory\n");
+    if (max_puzzles && bench_load_data(corpora + corpus_count, data_fname, max_puzzles))
+        ++corpus_count;
+    else
+        fprintf(stderr, "skip data corpus %s\n", data_fname);
+    
+    fprintf(out, "{\n");
+    bench_write_build(out, max_nodes, timeout);
+    fprintf(out, "  \"corpora\": [\n");
+    for (u32 c = 0; c < corpus_count; ++c)
+        bench_corpus(out, corpora + c, &context, max_nodes, timeout, c + 1 == corpus_count);
+    fprintf(out, "  ],\n");
+    
+    if (corpus_count && corpora[0].solutions)
+    {
+        bench_kernels_run(out, corpora, 0.05);
+    }
+    else
+    {
+        fprintf(out, "  \"kernels\": []\n");
+    }
+    fprintf(out, "}\n");
+    
+    if (out != stdout)
+        fclose(out);
+    
+    for (u32 c = 0; c < corpus_count; ++c)
+        bench_free_corpus(corpora + c);
+    free(context.trail);
+    
+    return 0;
+}
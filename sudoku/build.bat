@@ -5,6 +5,7 @@ REM del *.pdb
 set COMMON_FLAGS=/Od /W2 /Z7 /EHsc /wd4996 /nologo /MD
 set BUILD_FLAGS=%COMMON_FLAGS%  /link
 cl main.cpp /Femain.exe %BUILD_FLAGS% 
+cl bench.cpp /Febench.exe %BUILD_FLAGS% 
 REM cl gemini.cpp /Fegemini.exe %BUILD_FLAGS% 
 REM cl chatgpt.cpp /Fechatgpt.exe %BUILD_FLAGS% 
 cl bitpacking.cpp /Febitpacking.exe %BUILD_FLAGS% 
@@ -1 +1,3 @@
-gcc -O3 main.cpp -o main
+gcc -O3 -march=native -pthread main.cpp -o main
+gcc -O3 -march=native -pthread bench.cpp -o bench
+gcc -O3 -march=native -pthread -DSUDOKU_STATS=1 main.cpp -o main_stats
@@ -1,7 +1,11 @@
 #include <stdlib.h>
 #include <time.h>
 #include "sudoku.cpp"
+#include "sudoku_trace.cpp"
+#include "sudoku_grade.cpp"
+#include "sudoku_player.cpp"
 #include "base.h"
+#include "platform.h"
 #include "raylib.h"
 #include "raymath.h"
 
@@ -22,27 +26,27 @@ const int board_height = screenHeight / 3;
 const int cellWidth = board_width / COLS;
 const int cellHeight = board_height / ROWS;
 
-struct SudokuStep {
-    u32 step_id;
-    
-    u8 sudoku[BOARD_MEM_SIZE];
-    u16 candidates[BOARD_MEM_SIZE * 3];
-    
-    u32 move_index;
-    
-    SudokuStep *next;
-    SudokuStep *prev;
-};
-
 struct SudokuGame {
     u32 game_id;
     bool solved;
+    bool engine_mismatch; // the heuristic search failed a puzzle plain backtracking solve
     
     u8 sudoku[BOARD_MEM_SIZE];
     u16 candidates[BOARD_MEM_SIZE * 3];
     
     u8 player_board[BOARD_MEM_SIZE];
     u16 player_board_candidates[BOARD_MEM_SIZE];
+    SudokuPlayer player; // keep player_board_candidates and the conflicts in step with player_board
+    
+    // last "still solvable?" answer, only valid while check_key match the player board
+    SudokuCheckMemo check_memo; // checker thread only
+    SudokuCheck check;
+    u64 check_key;
+    
+    // shown while hint_key match the player board and candidates
+    SudokuDeduction hint;
+    bool has_hint;
+    u64 hint_key;
     int player_selected_row = 0;
     int player_selected_col = 0;
     
@@ -52,164 +56,239 @@ struct SudokuGame {
     
     SudokuGame *next;
     SudokuGame *prev;
+    SudokuGame *inbox_next; // finished by a worker, not yet in the render list
     
-    SudokuStep debug_steps;
-    SudokuStep *debug_current;
+    // search trace, the debugger show debug_step and the two steps after it
+    SudokuTrace trace;
+    SudokuTraceView debug_views[3];
+    u32 debug_step;
 };
 
-void sudoku_debug_callback(void *context, u8 *sudoku, u16 *sudoku_possible, u32 index, u32 val)
+// background solving, workers pull puzzles from one shared reader and push every
+// finished game on a lock free stack. the render loop drain the stack once per frame
+// and keep its own list sorted by game id, so the window never wait on a solve
+#define GUI_MAX_GAMES 4096 // games kept for browsing, the rest of the file is only counted
+#define GUI_MAX_WORKERS 16
+
+struct GuiSolver {
+    DataReader reader;
+    volatile u64 reader_lock;
+    u64 file_size;
+    volatile u64 bytes_read;
+    
+    Thread workers[GUI_MAX_WORKERS];
+    u32 num_workers;
+    volatile u32 running;  // workers not done yet
+    volatile u32 quit;
+    
+    volatile u32 read_count;
+    volatile u32 done_count;
+    volatile u64 total_guess;
+    volatile u32 mismatch_count; // games with engine_mismatch, shown in red on the hud
+    volatile u64 inbox;    // SudokuGame* stack linked by inbox_next
+    
+    double time_start;
+    double time_end;       // set by the render loop once every worker is done
+};
+
+void gui_solve_game(SudokuGame *game, u8 *sudoku_line)
 {
-    SudokuGame *game = (SudokuGame *) context;
+    const u32 max_row = 9;
+    const u32 max_col = 9;
+    const u32 max_size = 9 * 9;
+    const u32 block_size = 3;
+    
+    u8 *sudoku = game->sudoku;
+    u8 *sudoku_solution = game->sudoku_solution;
+    u16 *sudoku_possible = game->candidates;
+    
+    memcpy(sudoku, sudoku_line, max_size);
+    memcpy(sudoku_solution, sudoku, max_size);
+    memcpy(game->player_board, sudoku, max_size);
+    sudoku_player_init(&game->player, game->player_board, game->player_board_candidates, sudoku, max_row, max_col, block_size);
+    
+    double time_start = platform_time();
     
-    SudokuStep * step = (SudokuStep*)malloc(sizeof(SudokuStep));
+    sudoku_fill_possible(sudoku_solution, sudoku_possible, max_row, max_col, block_size);
     
-    memcpy(step->sudoku, sudoku, sizeof(step->sudoku));
-    memcpy(step->candidates, sudoku_possible, sizeof(step->candidates));
-    step->move_index = index;
+    // singles propagation feed hidden singles back into the candidates
+    u16 sudoku_candidates[max_size * 3];
+    memcpy(sudoku_candidates, sudoku_possible, sizeof(sudoku_candidates));
     
-    dll_insert_back(&game->debug_steps, step);
-    step->step_id = step->prev->step_id + 1;
+    u32 num_guess = 0;
+    sudoku_trace_init(&game->trace, sudoku_solution, sudoku_candidates, max_size);
+    bool ret = sudoku_backtrack_heuristic_trail(sudoku_solution, sudoku_candidates, max_row, max_col, block_size, &num_guess, sudoku_trace_callback, &game->trace, SUDOKU_PROPAGATE_SINGLES);
+    for (u32 i = 0; i < array_count(game->debug_views); ++i)
+        sudoku_trace_view_init(&game->trace, game->debug_views + i);
+    game->solved = ret;
+    game->num_guess = num_guess;
+    game->time_solve = platform_time() - time_start;
+    
+    sudoku_check_memo_init(&game->check_memo, ret ? sudoku_solution : 0, max_size);
+    
+    if (!ret) {
+        u32 min_guess = 0;
+        game->engine_mismatch = sudoku_backtrack_min(sudoku_solution, max_row, max_col, block_size, &min_guess);
+    }
 }
 
-void sudoku_solve_from_file(char *fname, SudokuGame *sudoku_games)
+void gui_solver_publish(GuiSolver *solver, SudokuGame *game)
 {
-    FILE *f = fopen(fname, "rb");
-    if(f) {
-        
-        fseek(f, 0, SEEK_END);
-        u32 file_size = ftell(f);
-        fseek(f, 0, SEEK_SET);
-        
-        u8 *file_contents = (u8*)malloc(file_size + 1);
-        file_contents[file_size] = 0;
-        fread(file_contents, file_size, 1, f);
-        fclose(f);
-        
-        u8 c = 0;
-        
-        const u32 max_row = 9;
-        const u32 max_col = 9;
-        const u32 padding = 32;
-        const u32 max_size = 9 * 9;
-        u32 solved_count = 0;
+    for (;;)
+    {
+        u64 head = atomic_load_u64(&solver->inbox);
+        game->inbox_next = (SudokuGame*)head;
+        if (atomic_cas_u64(&solver->inbox, head, (u64)game))
+            return;
+    }
+}
+
+void gui_solver_worker(void *param)
+{
+    GuiSolver *solver = (GuiSolver*)param;
+    
+    const u32 max_size = 9 * 9;
+    u8 sudoku_line[max_size];
+    SudokuTrail *trail = (SudokuTrail*)malloc(sizeof(SudokuTrail));
+    
+    while (!atomic_load_u32(&solver->quit))
+    {
+        spin_lock(&solver->reader_lock);
+        bool has_puzzle = data_reader_next(&solver->reader, sudoku_line, 9, max_size);
+        u32 game_id = has_puzzle ? atomic_add_u32(&solver->read_count, 1) : 0;
+        atomic_store_u64(&solver->bytes_read, solver->reader.bytes_read);
+        spin_unlock(&solver->reader_lock);
         
-        u32 i = 0;
+        if (!has_puzzle)
+            break;
         
-        // skip comment stuff
-        while(i < file_size && file_contents[i] == '#')
+        if (game_id <= GUI_MAX_GAMES)
         {
-            while (i < file_size && file_contents[++i] != '\n');
-            ++i;
+            SudokuGame *game = (SudokuGame*)calloc(sizeof(SudokuGame), 1);
+            game->game_id = game_id;
+            gui_solve_game(game, sudoku_line);
+            atomic_add_u64(&solver->total_guess, game->num_guess);
+            if (game->engine_mismatch)
+                atomic_add_u32(&solver->mismatch_count, 1);
+            gui_solver_publish(solver, game);
         }
-        
-        u64 total_guess = 0;
-        u32 game_id = 0;
-        while (i < file_size)
+        else
         {
-            SudokuGame *game = (SudokuGame*)calloc(sizeof(SudokuGame), 1);
-            dll_init(&game->debug_steps);
-            game->debug_current = &game->debug_steps;
-            
-            dll_insert_back(sudoku_games, game);
-            game->game_id = game->prev->game_id + 1;
-            u8 *sudoku = game->sudoku;
-            u8 *sudoku_solution = game->sudoku_solution;
-            u16* sudoku_possible = game->candidates;
-            
-            u8* buffer = file_contents + i;
-            i += max_size;
-            while (file_contents[i++] != '\n');
-            
-            for (int j = 0; j < max_size; ++j)
-            {
-                c = buffer[j];
-                
-                if (c == '.') c = '0';
-                
-                // 0 to 9 ascii
-                if (c >= '0' && c <= (max_row + 48))
-                {
-                    sudoku[j] = c - 48;
-                }
-            }
-            
-            double time_start = GetTime();
-            
-            u32 bcount = 0;
+            // past the browsing limit, solve without the trace for the throughput
             u32 num_guess = 0;
-            u32 block_size = 3;
-            
-            memcpy(sudoku_solution, sudoku, max_size);
-            memcpy(game->player_board, sudoku, max_size);
-            
-            sudoku_print(sudoku, max_size);
-            
-            sudoku_fill_possible(sudoku_solution, sudoku_possible, max_row, max_col, block_size);
-            
-            u16 *sudoku_candidates = (u16*)malloc(max_size * sizeof(u16) * 3);
-            memcpy(sudoku_candidates, sudoku_possible, max_size * sizeof(u16) * 3);
-            
-            u16 *hidden_pair = sudoku_candidates + max_size;
-            u16 *hidden_single = sudoku_candidates + max_size * 2;
-            for (int i = 0; i < max_size; ++i)
-            {
-                if (hidden_pair[i]) sudoku_candidates[i] = hidden_pair[i];
-                if (hidden_single[i]) sudoku_candidates[i] = hidden_single[i];
-            }
-            
-            bool ret = sudoku_backtrack_heuristic(sudoku_solution, sudoku_candidates, max_row, max_col, block_size, &num_guess, sudoku_debug_callback, game);
-            game->solved = ret;
-            game->num_guess = num_guess;
-            game->time_solve = GetTime() - time_start;
-            //bool ret = sudoku_backtrack_min(sudoku_solution, max_row, max_col, block_size, &num_guess);
-            
-            total_guess += num_guess;
-            sudoku_games->num_guess = total_guess;
-            
-            
-            printf("Game ID: %d\n", game->game_id);
-            printf("Number of guess: %d\n", num_guess);
-            sudoku_print(sudoku_solution, max_size);
-            fflush(stdout);
-            
-            if (!ret) {
-                num_guess = 0;
-                bool ret2 = sudoku_backtrack_min(sudoku_solution, max_row, max_col, block_size, &num_guess);
-                
-                printf("Number of guess: %d\n", num_guess);
-                sudoku_print(sudoku_solution, max_size);
-                fflush(stdout);
-                
-                if (ret2) {
-                    printf("heurictic bug");
-                    assert(ret);
-                }
-                else // no solution
-                {
-                    assert(ret);
-                }
-            }
-            
-            solved_count++;
-            if (solved_count > 20) 
-                break;
-            
+            sudoku_solve_with_trail(sudoku_line, 9, 9, 3, trail, &num_guess, SUDOKU_PROPAGATE_SINGLES);
+            atomic_add_u64(&solver->total_guess, num_guess);
         }
+        atomic_add_u32(&solver->done_count, 1);
+    }
+    
+    free(trail);
+    atomic_add_u32(&solver->running, (u32)-1);
+}
+
+bool gui_solver_start(GuiSolver *solver, char *fname)
+{
+    memset(solver, 0, sizeof(GuiSolver));
+    if (!data_reader_open(&solver->reader, fname))
+        return false;
+    
+    fseek(solver->reader.file, 0, SEEK_END);
+    solver->file_size = (u64)ftell(solver->reader.file);
+    fseek(solver->reader.file, 0, SEEK_SET);
+    
+    // leave one core to the render loop
+    u32 num_workers = platform_core_count();
+    num_workers = num_workers > 1 ? num_workers - 1 : 1;
+    if (num_workers > GUI_MAX_WORKERS)
+        num_workers = GUI_MAX_WORKERS;
+    
+    sudoku_subset_table_init();
+    solver->time_start = platform_time();
+    solver->num_workers = num_workers;
+    solver->running = num_workers;
+    for (u32 w = 0; w < num_workers; ++w)
+        thread_create(solver->workers + w, gui_solver_worker, solver);
+    
+    return true;
+}
+
+void gui_solver_stop(GuiSolver *solver)
+{
+    atomic_store_u32(&solver->quit, 1);
+    for (u32 w = 0; w < solver->num_workers; ++w)
+        thread_join(solver->workers + w);
+    data_reader_close(&solver->reader);
+}
+
+// move finished games into the render list, sorted by game id
+void gui_solver_collect(GuiSolver *solver, SudokuGame *games)
+{
+    u64 head = atomic_load_u64(&solver->inbox);
+    while (head && !atomic_cas_u64(&solver->inbox, head, 0))
+        head = atomic_load_u64(&solver->inbox);
+    
+    for (SudokuGame *game = (SudokuGame*)head; game;)
+    {
+        SudokuGame *next = game->inbox_next;
         
-        if (total_guess) {
-            printf("Total guess/problem %lld/%d=%lld\n", total_guess, solved_count, total_guess/solved_count);
-        }
+        // games come back almost in order, walk from the back
+        SudokuGame *after = games->prev;
+        while (after != games && after->game_id > game->game_id)
+            after = after->prev;
+        dll_insert(after, game);
         
-        if (file_contents) free(file_contents);
+        game = next;
     }
     
+    if (!solver->time_end && !atomic_load_u32(&solver->running))
+        solver->time_end = platform_time();
 }
 
-float timeGameStarted;
-float timeGameEnded;
+// hint drawn with the CellDraw candidate colors: pattern digits (or the digit to
+// place) go in the hidden_single mask, candidates the step remove in the hidden_pair one
+void gui_hint_masks(SudokuDeduction *hint, u16 *hidden_single, u16 *hidden_pair)
+{
+    memset(hidden_single, 0, BOARD_SIZE * sizeof(u16));
+    memset(hidden_pair, 0, BOARD_SIZE * sizeof(u16));
+    for (u32 c = 0; c < hint->cell_count; ++c)
+        hidden_single[hint->cells[c]] |= hint->digits;
+    for (u32 e = 0; e < hint->elimination_count; ++e)
+        hidden_pair[hint->eliminations[e].index] |= hint->eliminations[e].bits;
+}
+
+// glyph sizes of the digits, measured once after the window is up instead of every cell every frame
+#define GUI_VALUE_FONT_SIZE 20.0f
+#define GUI_MARK_FONT_SIZE 10.0f
+
+struct GuiGlyphs {
+    bool ready;
+    char text[10][2];
+    Vector2 value_size[10];
+    Vector2 mark_size[10];
+};
+
+static GuiGlyphs gui_glyphs;
+
+void gui_glyphs_init()
+{
+    if (gui_glyphs.ready)
+        return;
+    
+    Font font = GetFontDefault();
+    for (u32 val = 0; val < 10; ++val)
+    {
+        gui_glyphs.text[val][0] = (char)('0' + val);
+        gui_glyphs.text[val][1] = 0;
+        gui_glyphs.value_size[val] = MeasureTextEx(font, gui_glyphs.text[val], GUI_VALUE_FONT_SIZE, 0);
+        gui_glyphs.mark_size[val] = MeasureTextEx(font, gui_glyphs.text[val], GUI_MARK_FONT_SIZE, 0);
+    }
+    
+    gui_glyphs.ready = true;
+}
 
 void CellDraw(Vector2 p, int r, int c, u8 val, Color default_color, u16 candidates, u16 hidden_single, u16 hidden_pair)
 {
+    assert(gui_glyphs.ready);
     Font font = GetFontDefault();
     
     float recx = p.x  + r * cellWidth;
@@ -217,12 +296,8 @@ void CellDraw(Vector2 p, int r, int c, u8 val, Color default_color, u16 candidat
     
     if (!candidates)
     {
-        char s[2] = {0};
-        s[0] = val + 48;
-        
-        float font_size = 20.0f;
-        Vector2 text_size = MeasureTextEx(font, s, font_size, 0);
-        DrawTextEx(font, s, {recx + cellWidth/2  - text_size.x/2, recy + cellHeight/2 - text_size.y/2}, font_size, 0, default_color);
+        Vector2 text_size = gui_glyphs.value_size[val];
+        DrawTextEx(font, gui_glyphs.text[val], {recx + cellWidth/2  - text_size.x/2, recy + cellHeight/2 - text_size.y/2}, GUI_VALUE_FONT_SIZE, 0, default_color);
     }
     else 
     {
@@ -242,12 +317,8 @@ void CellDraw(Vector2 p, int r, int c, u8 val, Color default_color, u16 candidat
                 
                 if (candidates & bits)
                 {
-                    char s[2] = {0};
-                    s[0] = val + 48;
-                    
-                    float font_size = 10.0f;
-                    Vector2 text_size = MeasureTextEx(font, s, font_size, 0);
-                    DrawTextEx(font, s, {sub_recx + cellWidth/BLOCK_SIZE/2 - text_size.x/2, sub_recy + cellHeight/BLOCK_SIZE/2 - text_size.y/2}, font_size, 0, text_color);
+                    Vector2 text_size = gui_glyphs.mark_size[val];
+                    DrawTextEx(font, gui_glyphs.text[val], {sub_recx + cellWidth/BLOCK_SIZE/2 - text_size.x/2, sub_recy + cellHeight/BLOCK_SIZE/2 - text_size.y/2}, GUI_MARK_FONT_SIZE, 0, text_color);
                 }
                 
                 ++val;
@@ -333,7 +404,9 @@ void draw_board_debug(Vector2 pos,u8* sudoku, u8 *solution = 0, u16 *candidates
     
 }
 
-void draw_player_board(Vector2 pos,u8* sudoku, u8 *player_sudoku, u16 *candidates = 0, u16 *hidden_pair = 0, u16* hidden_single = 0)
+// open cells show their candidates, entries that repeat a digit in one of their houses are red,
+// entries the checker proved wrong get a red frame
+void draw_player_board(Vector2 pos,u8* sudoku, u8 *player_sudoku, u16 *candidates = 0, u16 *hidden_pair = 0, u16* hidden_single = 0, bool *conflicts = 0, bool *wrong = 0)
 {
     draw_board_grid(pos);
     
@@ -343,33 +416,223 @@ void draw_player_board(Vector2 pos,u8* sudoku, u8 *player_sudoku, u16 *candidate
         {
             int index = ROWS * j + i;
             u16 candidates_mask = candidates ? candidates[index] : 0;
+            u16 hidden_single_mask = hidden_single ? hidden_single[index] : 0;
+            u16 hidden_pair_mask = hidden_pair ? hidden_pair[index] : 0;
             
             Color color = DARKGRAY;
             if (!sudoku[index])
                 color = BLUE;
+            if (conflicts && conflicts[index])
+                color = RED;
+            if (wrong && wrong[index])
+            {
+                // no solution of the givens has this entry
+                float recx = pos.x  + i * cellWidth + 1;
+                float recy = pos.y + j * cellHeight + 1;
+                draw_rect({recx, recy, cellWidth - 3, cellHeight - 3}, 2, RED);
+            }
             
             if (player_sudoku[index])
-                CellDraw(pos, i, j, player_sudoku[index], color, candidates_mask, 0, 0);
+                CellDraw(pos, i, j, player_sudoku[index], color, 0, 0, 0);
+            else if (candidates_mask)
+                CellDraw(pos, i, j, 0, GRAY, candidates_mask, hidden_single_mask, hidden_pair_mask);
         }
     }
     
 }
 
+// a board is only redrawn into its texture when what it shows change, every other
+// frame it's one textured quad. the key is a hash of everything the board draw from
+#define BOARD_CACHE_MARGIN 2 // the thick block lines spill outside the board
+
+struct BoardCache {
+    RenderTexture2D texture;
+    bool loaded;
+    u64 key;
+};
+
+// fnv-1a, chain calls to hash several arrays into one key
+inline u64 gui_hash(u64 hash, void *data, u32 size)
+{
+    u8 *bytes = (u8*)data;
+    for (u32 i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+#define GUI_HASH_SEED 0xCBF29CE484222325ull
+
+// position to draw the board at inside the cache texture
+inline Vector2 board_cache_origin()
+{
+    return {(float)BOARD_CACHE_MARGIN, (float)BOARD_CACHE_MARGIN};
+}
+
+// true when the board need to be redrawn, draw it at board_cache_origin() then call board_cache_end
+bool board_cache_begin(BoardCache *cache, u64 key)
+{
+    if (!cache->loaded)
+    {
+        cache->texture = LoadRenderTexture(board_width + 2 * BOARD_CACHE_MARGIN, board_height + 2 * BOARD_CACHE_MARGIN);
+        cache->loaded = true;
+    }
+    else if (cache->key == key)
+    {
+        return false;
+    }
+    
+    cache->key = key;
+    BeginTextureMode(cache->texture);
+    ClearBackground(RAYWHITE);
+    return true;
+}
+
+void board_cache_end()
+{
+    EndTextureMode();
+}
+
+void board_cache_draw(BoardCache *cache, Vector2 pos)
+{
+    // render textures are stored bottom up
+    Texture2D texture = cache->texture.texture;
+    Rectangle source = {0, 0, (float)texture.width, -(float)texture.height};
+    DrawTextureRec(texture, source, {pos.x - BOARD_CACHE_MARGIN, pos.y - BOARD_CACHE_MARGIN}, WHITE);
+}
+
+void board_cache_free(BoardCache *cache)
+{
+    if (cache->loaded)
+        UnloadRenderTexture(cache->texture);
+    cache->loaded = false;
+}
+
+// one thread check the player board of the shown game after every move. the render
+// loop post the board whenever its hash change and pick the answer up once it's for
+// the latest post, so typing never wait on a search. one check is bounded by
+// GUI_CHECK_TIMEOUT, most moves are answered from the memo without searching at all
+#define GUI_CHECK_TIMEOUT 0.010
+
+struct GuiChecker {
+    Thread thread;
+    volatile u64 lock;
+    volatile u32 quit;
+    
+    // posted by the render loop
+    SudokuGame *game;
+    u8 board[BOARD_SIZE];
+    u64 key;
+    u64 request_id;
+    
+    // written by the checker thread
+    SudokuCheck result;
+    u64 result_id;
+};
+
+void gui_checker_proc(void *param)
+{
+    GuiChecker *checker = (GuiChecker*)param;
+    SudokuTrail *trail = (SudokuTrail*)malloc(sizeof(SudokuTrail));
+    SudokuCheck *check = (SudokuCheck*)malloc(sizeof(SudokuCheck));
+    
+    u64 done_id = 0;
+    while (!atomic_load_u32(&checker->quit))
+    {
+        spin_lock(&checker->lock);
+        u64 request_id = checker->request_id;
+        SudokuGame *game = checker->game;
+        u8 board[BOARD_SIZE];
+        memcpy(board, checker->board, BOARD_SIZE);
+        spin_unlock(&checker->lock);
+        
+        if (request_id == done_id)
+        {
+            thread_sleep_ms(1);
+            continue;
+        }
+        
+        sudoku_player_check(game->sudoku, board, ROWS, COLS, BLOCK_SIZE, &game->check_memo, check, trail, GUI_CHECK_TIMEOUT);
+        done_id = request_id;
+        
+        // an answer for an older board is dropped, the newer one is already queued
+        spin_lock(&checker->lock);
+        if (checker->request_id == request_id)
+        {
+            checker->result = *check;
+            checker->result_id = request_id;
+        }
+        spin_unlock(&checker->lock);
+    }
+    
+    free(check);
+    free(trail);
+}
+
+void gui_checker_start(GuiChecker *checker)
+{
+    memset(checker, 0, sizeof(GuiChecker));
+    thread_create(&checker->thread, gui_checker_proc, checker);
+}
+
+void gui_checker_stop(GuiChecker *checker)
+{
+    atomic_store_u32(&checker->quit, 1);
+    thread_join(&checker->thread);
+}
+
+// post the board when it changed since the last post, copy a fresh answer into the game
+void gui_checker_update(GuiChecker *checker, SudokuGame *game)
+{
+    u64 key = gui_hash(GUI_HASH_SEED, game->player_board, BOARD_SIZE);
+    
+    spin_lock(&checker->lock);
+    if (checker->game != game || checker->key != key)
+    {
+        checker->game = game;
+        checker->key = key;
+        memcpy(checker->board, game->player_board, BOARD_SIZE);
+        ++checker->request_id;
+    }
+    else if (checker->result_id == checker->request_id && game->check_key != key)
+    {
+        game->check = checker->result;
+        game->check_key = key;
+    }
+    spin_unlock(&checker->lock);
+    
+    // a pending board has no wrong marks, the last result was for another board
+    if (game->check_key != key)
+    {
+        game->check.status = SUDOKU_CHECK_PENDING;
+        memset(game->check.wrong, 0, sizeof(game->check.wrong));
+        game->check.wrong_count = 0;
+    }
+}
+
 int main()
 {
 	srand(time(0));
     
     int padding = 10;
 	InitWindow(screenWidth + padding, screenHeight + padding, "Sudoku Solver");
+    gui_glyphs_init();
     
-    timeGameStarted = GetTime();
-	
     SudokuGame games = {};
     dll_init(&games);
-    sudoku_solve_from_file("data/puzzles2_17_clue", &games);
-    SudokuGame *game = games.next;
+    SudokuGame *game = 0;
     
-    timeGameEnded= GetTime();
+    GuiSolver solver;
+    if (!gui_solver_start(&solver, "data/puzzles2_17_clue"))
+        printf("can't open data/puzzles2_17_clue\n");
+    
+    GuiChecker checker;
+    gui_checker_start(&checker);
+    
+    // hints run subset searches on the render thread
+    sudoku_subset_table_init();
     
     float x = 10.0f;
     float y = 30.0f;
@@ -379,12 +642,39 @@ int main()
     
     int debug_step_id = 0;
     
+    BoardCache challenge_cache = {};
+    BoardCache player_cache = {};
+    BoardCache solution_cache = {};
+    BoardCache debug_caches[3] = {};
+    
     while(!WindowShouldClose())
     {
         BeginDrawing();
         
         ClearBackground(RAYWHITE);
         
+        gui_solver_collect(&solver, &games);
+        if (!game && games.next != &games)
+            game = games.next;
+        
+        // live progress, the file position is the only total known before the end
+        u32 done_count = atomic_load_u32(&solver.done_count);
+        double time_now = solver.time_end ? solver.time_end : platform_time();
+        double elapsed = time_now - solver.time_start;
+        double progress = solver.file_size ? 100.0 * atomic_load_u64(&solver.bytes_read) / solver.file_size : 100.0;
+        u32 mismatch_count = atomic_load_u32(&solver.mismatch_count);
+        DrawText(TextFormat("Solved: %d/%d (%.1f%%), %.0f puzzles/sec, Total guess: %lld, Total time: %f secs, Engine mismatch: %d%s",
+                            done_count, atomic_load_u32(&solver.read_count), progress, elapsed > 0 ? done_count / elapsed : 0.0,
+                            atomic_load_u64(&solver.total_guess), elapsed, mismatch_count, solver.time_end ? "" : " ..."),
+                 5, 15, 10, mismatch_count ? RED : DARKGRAY);
+        
+        if (!game)
+        {
+            DrawText("Solving...", 5, 0, 10, DARKGRAY);
+            EndDrawing();
+            continue;
+        }
+        
         if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
         {
             game->player_selected_row = game->player_selected_col = 0;
@@ -420,27 +710,30 @@ int main()
         
         if (IsKeyPressed(KEY_J))
         {
-            SudokuStep *step = &game->debug_steps;
-            for (int i = 0; i < debug_step_id; ++i)
-                step = step->next;
-            
-            game->debug_current = step;
-            
+            u32 last = sudoku_trace_last(&game->trace);
+            game->debug_step = debug_step_id < 0 ? 0 : ((u32)debug_step_id > last ? last : debug_step_id);
         }
         
         
         if (IsKeyPressed(KEY_RIGHT))
         {
-            if (game->debug_current->next != &game->debug_steps)
-                game->debug_current = game->debug_current->next;
+            if (game->debug_step < sudoku_trace_last(&game->trace))
+                ++game->debug_step;
         }
         
         if (IsKeyPressed(KEY_LEFT))
         {
-            if (game->debug_current->prev != &game->debug_steps)
-                game->debug_current = game->debug_current->prev;
+            if (game->debug_step > 0)
+                --game->debug_step;
         }
         
+        // ctrl+z / ctrl+y undo and redo the player moves
+        bool ctrl_down = IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL);
+        if (ctrl_down && IsKeyPressed(KEY_Z))
+            sudoku_player_undo(&game->player);
+        if (ctrl_down && IsKeyPressed(KEY_Y))
+            sudoku_player_redo(&game->player);
+        
         if (game->player_selected_row)
         {
             DrawText(TextFormat("cell selected: %d, %d", game->player_selected_row, game->player_selected_col), 200, 0, 10, DARKGRAY);
@@ -451,21 +744,42 @@ int main()
                 last_key_pressed = key_pressed;
             if (last_key_pressed)
             {
+                // 0, backspace and delete clear the cell
                 int number = last_key_pressed - '0';
-                if (number > 0 && number < 10) {
+                if (last_key_pressed == KEY_BACKSPACE || last_key_pressed == KEY_DELETE)
+                    number = 0;
+                if (number >= 0 && number < 10) {
                     int row = game->player_selected_row - 1;
                     int col = game->player_selected_col - 1;
                     int index = row * ROWS+ col;
-                    if (!game->sudoku[index]) // only modify empty cell
-                        game->player_board[index] = number;
+                    sudoku_player_set(&game->player, index, (u8)number); // givens are left alone
                     last_key_pressed = 0;
                 }
             }
         }
         
-        DrawText(TextFormat("Game: %d, Success: %d, Guess: %d, Time solve: %f secs", game->game_id, game->solved, game->num_guess, game->time_solve), 5, 0, 10, DARKGRAY);
+        gui_checker_update(&checker, game);
+        
+        // h show the next logical step, h again apply it
+        u64 hint_key = gui_hash(GUI_HASH_SEED, game->player_board, BOARD_SIZE);
+        hint_key = gui_hash(hint_key, game->player_board_candidates, BOARD_SIZE * sizeof(u16));
+        bool hint_shown = game->has_hint && game->hint_key == hint_key;
+        if (IsKeyPressed(KEY_H) && !ctrl_down)
+        {
+            if (hint_shown)
+            {
+                sudoku_player_apply_hint(&game->player, &game->hint);
+                game->has_hint = hint_shown = false;
+            }
+            else
+            {
+                game->has_hint = hint_shown = sudoku_player_hint(&game->player, &game->hint);
+                game->hint_key = hint_key;
+            }
+        }
         
-        DrawText(TextFormat("Total guess: %d, Total time: %f secs", games.num_guess, timeGameEnded - timeGameStarted), 5, 15, 10, DARKGRAY);
+        DrawText(TextFormat("Game: %d, Success: %d, Guess: %d, Time solve: %f secs%s", game->game_id, game->solved, game->num_guess, game->time_solve,
+                            game->engine_mismatch ? ", engine mismatch" : ""), 5, 0, 10, game->engine_mismatch ? RED : DARKGRAY);
         
         // draw game
         
@@ -473,38 +787,121 @@ int main()
         u16 *candidates = game->candidates;
         u16 *hidden_pair = game->candidates + BOARD_SIZE;
         u16 *hidden_single = game->candidates + BOARD_SIZE * 2;
-        draw_board({x, y}, game->sudoku, candidates, hidden_single, hidden_pair);
+        u64 key = gui_hash(GUI_HASH_SEED, game->sudoku, BOARD_SIZE);
+        key = gui_hash(key, game->candidates, sizeof(game->candidates));
+        if (board_cache_begin(&challenge_cache, key))
+        {
+            draw_board(board_cache_origin(), game->sudoku, candidates, hidden_single, hidden_pair);
+            board_cache_end();
+        }
+        board_cache_draw(&challenge_cache, {x, y});
         
         // draw player board
-        draw_player_board(player_board_pos, game->sudoku, game->player_board, game->player_board_candidates);
+        key = gui_hash(GUI_HASH_SEED, game->sudoku, BOARD_SIZE);
+        key = gui_hash(key, game->player_board, BOARD_SIZE);
+        key = gui_hash(key, game->player_board_candidates, BOARD_SIZE * sizeof(u16));
+        key = gui_hash(key, game->player.conflict, BOARD_SIZE * sizeof(bool));
+        key = gui_hash(key, game->check.wrong, BOARD_SIZE * sizeof(bool));
+        u16 hint_single[BOARD_SIZE];
+        u16 hint_pair[BOARD_SIZE];
+        if (hint_shown)
+        {
+            gui_hint_masks(&game->hint, hint_single, hint_pair);
+            key = gui_hash(key, hint_single, sizeof(hint_single));
+            key = gui_hash(key, hint_pair, sizeof(hint_pair));
+        }
+        if (board_cache_begin(&player_cache, key))
+        {
+            draw_player_board(board_cache_origin(), game->sudoku, game->player_board, game->player_board_candidates,
+                              hint_shown ? hint_pair : 0, hint_shown ? hint_single : 0, game->player.conflict, game->check.wrong);
+            board_cache_end();
+        }
+        board_cache_draw(&player_cache, player_board_pos);
+        DrawText(TextFormat("Conflicts: %d, Moves: %d/%d (ctrl+z / ctrl+y)", game->player.conflict_count, game->player.move_cursor, game->player.move_count),
+                 player_board_pos.x, player_board_pos.y + board_height + 5, 10, game->player.conflict_count ? RED : DARKGRAY);
+        
+        const char *check_text = "Checking...";
+        Color check_color = DARKGRAY;
+        if (game->check.status == SUDOKU_CHECK_SOLVABLE)
+        {
+            check_text = "Still solvable";
+            check_color = LIME;
+        }
+        else if (game->check.status == SUDOKU_CHECK_DEAD_END)
+        {
+            check_text = TextFormat("Dead end, %d wrong entries", game->check.wrong_count);
+            check_color = RED;
+        }
+        else if (game->check.status == SUDOKU_CHECK_GAVE_UP)
+        {
+            check_text = "Can't tell, check ran out of time";
+        }
+        DrawText(check_text, player_board_pos.x, player_board_pos.y + board_height + 17, 10, check_color);
+        
+        if (hint_shown && game->hint.index < BOARD_SIZE)
+            DrawText(TextFormat("Hint: %s, %d at row %d col %d (h to apply)", sudoku_technique_names[game->hint.technique], game->hint.val,
+                                game->hint.index / COLS + 1, game->hint.index % COLS + 1), player_board_pos.x + board_width, player_board_pos.y + board_height + 5, 10, DARKGREEN);
+        else if (hint_shown)
+            DrawText(TextFormat("Hint: %s, %d candidates to remove (h to apply)", sudoku_technique_names[game->hint.technique], game->hint.elimination_count),
+                     player_board_pos.x + board_width, player_board_pos.y + board_height + 5, 10, DARKGREEN);
+        else
+            DrawText("h: hint", player_board_pos.x + board_width, player_board_pos.y + board_height + 5, 10, DARKGRAY);
         
         
         // draw solution
-        draw_board({player_board_pos.x + board_width, y}, game->sudoku_solution);
+        key = gui_hash(GUI_HASH_SEED, game->sudoku_solution, BOARD_SIZE);
+        if (board_cache_begin(&solution_cache, key))
+        {
+            draw_board(board_cache_origin(), game->sudoku_solution);
+            board_cache_end();
+        }
+        board_cache_draw(&solution_cache, {player_board_pos.x + board_width, y});
         
         // draw debug board
-        if (game->debug_current)
+        if (game->trace.step_count)
         {
             float debug_x = x;
             float debug_y = y + board_height + 30;
             
             int value_box =  GuiValueBox({debug_x + 120, debug_y, 100, 20}, "debug_step_id", &debug_step_id, 1, -1, true);
+            DrawText(TextFormat("Trace: %d steps, %d KB", sudoku_trace_last(&game->trace), (int)(sudoku_trace_memory(&game->trace) / 1024)), debug_x + 240, debug_y + 5, 10, DARKGRAY);
             debug_y += 30;
             
-            SudokuStep *step = game->debug_current;
-            for(int i = 0; i < 3; ++i)
+            for(u32 i = 0; i < 3; ++i)
             {
+                u32 step = game->debug_step + i;
+                if (step > sudoku_trace_last(&game->trace))
+                    break;
+                
+                SudokuTraceView *view = game->debug_views + i;
+                sudoku_trace_seek(&game->trace, view, step);
+                
                 debug_x = x + i * board_width;
-                DrawText(TextFormat("Step: %d", step->step_id), debug_x, debug_y, 10, DARKGRAY);
-                if (step != &game->debug_steps)
-                    draw_board_debug({debug_x, debug_y + 30}, step->sudoku, game->sudoku_solution, step->candidates, step->move_index);
-                step = step->next;
+                DrawText(TextFormat("Step: %d", step), debug_x, debug_y, 10, DARKGRAY);
+                key = gui_hash(GUI_HASH_SEED, view->sudoku, BOARD_SIZE);
+                key = gui_hash(key, view->candidates, BOARD_SIZE * sizeof(u16));
+                key = gui_hash(key, &view->move_index, sizeof(view->move_index));
+                key = gui_hash(key, game->sudoku_solution, BOARD_SIZE);
+                if (board_cache_begin(debug_caches + i, key))
+                {
+                    draw_board_debug(board_cache_origin(), view->sudoku, game->sudoku_solution, view->candidates, view->move_index);
+                    board_cache_end();
+                }
+                board_cache_draw(debug_caches + i, {debug_x, debug_y + 30});
             }
         }
         
         EndDrawing();
     }
     
+    gui_checker_stop(&checker);
+    gui_solver_stop(&solver);
+    
+    board_cache_free(&challenge_cache);
+    board_cache_free(&player_cache);
+    board_cache_free(&solution_cache);
+    for (u32 i = 0; i < 3; ++i)
+        board_cache_free(debug_caches + i);
     CloseWindow();
     
     return 0;
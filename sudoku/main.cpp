@@ -1,7 +1,142 @@
 #include "sudoku.cpp"
+#include "sudoku_canon.cpp"
+#include "sudoku_grade.cpp"
+#include "sudoku_player.cpp"
+#include "sudoku_board.cpp"
+#include "sudoku_simd.cpp"
+#include "sudoku_batch.cpp"
 
-int main()
+int main(int argc, char **argv)
 {
+    if (argc > 2 && strcmp(argv[1], "batch") == 0)
+    {
+        // main batch <data file> [output file] [threads] [engine] [max nodes] [timeout ms] [binary] [cache], limits are per puzzle,
+        // binary write a corpus file with solutions and stats instead of lines (output file required),
+        // cache answer copies of an already solved puzzle (up to symmetry) without solving them
+        char *out_fname = argc > 3 ? argv[3] : 0;
+        u32 num_threads = argc > 4 ? atoi(argv[4]) : 0;
+        BatchEngine engine = BATCH_ENGINE_HEURISTIC;
+        for (u32 e = 0; argc > 5 && e < array_count(batch_engine_names); ++e)
+        {
+            if (strcmp(argv[5], batch_engine_names[e]) == 0)
+                engine = (BatchEngine)e;
+        }
+        u64 max_nodes = argc > 6 ? strtoull(argv[6], 0, 10) : 0;
+        double timeout = argc > 7 ? atof(argv[7]) / 1000.0 : 0;
+        BatchOutput output = BATCH_OUTPUT_TEXT;
+        bool use_cache = false;
+        for (int i = 8; i < argc; ++i)
+        {
+            if (strcmp(argv[i], "binary") == 0)
+                output = BATCH_OUTPUT_BINARY;
+            else if (strcmp(argv[i], "cache") == 0)
+                use_cache = true;
+        }
+        return solve_data_file_mt(argv[2], out_fname, num_threads, engine, 2, max_nodes, timeout, 0, 0, output, use_cache) ? 0 : 1;
+    }
+    
+    if (argc > 4 && strcmp(argv[1], "stats") == 0)
+    {
+        // main stats <data file> <csv file> <summary file> [threads] [engine] [output file]
+        // per puzzle counters as csv and a prometheus text summary, need a -DSUDOKU_STATS=1 build
+#if SUDOKU_STATS
+        u32 num_threads = argc > 5 ? atoi(argv[5]) : 0;
+        BatchEngine engine = BATCH_ENGINE_HEURISTIC;
+        for (u32 e = 0; argc > 6 && e < array_count(batch_engine_names); ++e)
+        {
+            if (strcmp(argv[6], batch_engine_names[e]) == 0)
+                engine = (BatchEngine)e;
+        }
+        char *out_fname = argc > 7 ? argv[7] : 0;
+        return solve_data_file_mt(argv[2], out_fname, num_threads, engine, 2, 0, 0, argv[3], argv[4]) ? 0 : 1;
+#else
+        fprintf(stderr, "stats need a build with -DSUDOKU_STATS=1\n");
+        return 1;
+#endif
+    }
+    
+    if (argc > 2 && strcmp(argv[1], "count") == 0)
+    {
+        // main count <data file> [output file] [threads] [limit], one solution count per line (gave_up past the budget)
+        char *out_fname = argc > 3 ? argv[3] : 0;
+        u32 num_threads = argc > 4 ? atoi(argv[4]) : 0;
+        u32 limit = argc > 5 ? atoi(argv[5]) : 2;
+        return solve_data_file_mt(argv[2], out_fname, num_threads, BATCH_ENGINE_COUNT, limit) ? 0 : 1;
+    }
+    
+    if (argc > 2 && strcmp(argv[1], "grade") == 0)
+    {
+        // main grade <data file> [output file] [threads], "<score> <hardest technique>" per line
+        char *out_fname = argc > 3 ? argv[3] : 0;
+        u32 num_threads = argc > 4 ? atoi(argv[4]) : 0;
+        return solve_data_file_mt(argv[2], out_fname, num_threads, BATCH_ENGINE_GRADE) ? 0 : 1;
+    }
+    
+    if (argc > 2 && strcmp(argv[1], "solutions") == 0)
+    {
+        // main solutions <data file> [limit], stream every solution of every puzzle to stdout
+        u32 limit = argc > 3 ? atoi(argv[3]) : 0;
+        return stream_solutions_data_file(argv[2], limit) ? 0 : 1;
+    }
+    
+    if (argc > 3 && strcmp(argv[1], "generate") == 0)
+    {
+        // main generate <count> <clues> [seed] [threads] [output file]
+        u64 seed = argc > 4 ? strtoull(argv[4], 0, 10) : 0;
+        u32 num_threads = argc > 5 ? atoi(argv[5]) : 0;
+        char *out_fname = argc > 6 ? argv[6] : 0;
+        return generate_data_file_mt(strtoull(argv[2], 0, 10), atoi(argv[3]), seed, num_threads, out_fname) ? 0 : 1;
+    }
+    
+    if (argc > 2 && strcmp(argv[1], "dedupe") == 0)
+    {
+        // main dedupe <data file> [output file] [threads], drop puzzles that are a symmetry copy of an earlier one
+        char *out_fname = argc > 3 ? argv[3] : 0;
+        u32 num_threads = argc > 4 ? atoi(argv[4]) : 0;
+        return dedupe_data_file(argv[2], out_fname, num_threads) ? 0 : 1;
+    }
+    
+    if (argc > 3 && strcmp(argv[1], "pack") == 0)
+    {
+        // main pack <data file> <corpus file> [solution data file | solve], text lines to the binary corpus
+        bool solve = argc > 4 && strcmp(argv[4], "solve") == 0;
+        char *solution_fname = argc > 4 && !solve ? argv[4] : 0;
+        return pack_data_file(argv[2], argv[3], solution_fname, solve) ? 0 : 1;
+    }
+    
+    if (argc > 3 && strcmp(argv[1], "unpack") == 0)
+    {
+        // main unpack <corpus file> <data file> [solution file] [stats csv] [grid], corpus back to text
+        char *solution_fname = argc > 4 && strcmp(argv[4], "-") != 0 ? argv[4] : 0;
+        char *stats_fname = argc > 5 && strcmp(argv[5], "-") != 0 ? argv[5] : 0;
+        bool grid = argc > 6 && strcmp(argv[6], "grid") == 0;
+        return unpack_data_file(argv[2], argv[3], grid, solution_fname, stats_fname) ? 0 : 1;
+    }
+    
+    if (argc > 3 && strcmp(argv[1], "board") == 0)
+    {
+        // main board <data file> <block size> [output file], 4x4 to 25x25
+        char *out_fname = argc > 4 ? argv[4] : 0;
+        return solve_data_file_board(argv[2], atoi(argv[3]), out_fname) ? 0 : 1;
+    }
+    
+    if (argc > 1 && strcmp(argv[1], "test") == 0)
+    {
+        // main test, the sudokus/ checks, run from the sudoku directory
+        run_tests(false);
+        run_count_tests(false);
+        run_corpus_tests(false);
+        run_canon_tests(false);
+        run_grade_tests(false);
+        run_player_tests(false);
+        run_check_tests(false);
+        run_hint_tests(false);
+        run_simd_tests(false);
+        run_board_tests(false);
+        printf("tests passed\n");
+        return 0;
+    }
+    
     solve_data_file("data/puzzles2_17_clue");
     
 #if 0
@@ -25,13 +160,17 @@ int main()
     const int max_size = 9 * 9;
     sudoku_print(su_deadlock, max_size);
     
-    u16 sudoku_possible[max_size] = {};
+    u16 sudoku_possible[max_size * 3] = {};
     sudoku_fill_possible(su_deadlock, sudoku_possible, 9, 9, 3);
     sudoku_backtrack_with_possible(su_deadlock, sudoku_possible, 0, 9, 9, 3);
     
     
+    // plain backtracking need billions of nodes here, give up after a second
     u32 bcount = 0;
-    sudoku_backtrack(su_deadlock, 0, 9, 9, 3, &bcount);
+    SudokuBudget budget;
+    sudoku_budget_init(&budget, 0, 1.0);
+    bool ret = sudoku_backtrack(su_deadlock, 0, 9, 9, 3, &bcount, &budget);
+    printf("status: %d, nodes: %lld\n", sudoku_status(ret, &budget), budget.nodes);
     //sudoku_backtrack_r(su_deadlock, 0, 9, 9, 3, &bcount);
     //sudoku_backtrack_min(su_deadlock, 9, 9, 3);
     sudoku_print(su_deadlock, max_size);
@@ -0,0 +1,225 @@
+/* date = October 18th 2026 9:40 am */
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// thin layer over win32 / posix for the batch tools: threads, atomics, timer
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI  // Rectangle, DrawText, CloseWindow... clash with raylib in gui.cpp
+#define NOUSER
+#include <windows.h>
+#include <intrin.h>
+#undef near // raymath use them as parameter names
+#undef far
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned int u32;
+typedef unsigned long long u64;
+
+typedef void (*thread_proc)(void *param);
+
+// keep it alive until thread_join
+struct Thread {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    thread_proc proc;
+    void *param;
+};
+
+#ifdef _WIN32
+
+static DWORD WINAPI thread_entry(LPVOID param)
+{
+    Thread *thread = (Thread*)param;
+    thread->proc(thread->param);
+    return 0;
+}
+
+static bool thread_create(Thread *thread, thread_proc proc, void *param)
+{
+    thread->proc = proc;
+    thread->param = param;
+    thread->handle = CreateThread(0, 0, thread_entry, thread, 0, 0);
+    return thread->handle != 0;
+}
+
+static void thread_join(Thread *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+}
+
+static void thread_yield()
+{
+    SwitchToThread();
+}
+
+static void thread_sleep_ms(u32 ms)
+{
+    Sleep(ms);
+}
+
+static u32 platform_core_count()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
+static double platform_time()
+{
+    static LARGE_INTEGER frequency;
+    if (!frequency.QuadPart)
+        QueryPerformanceFrequency(&frequency);
+    
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+// all atomics return the new value
+inline u32 atomic_add_u32(volatile u32 *value, u32 addend)
+{
+    return (u32)_InterlockedExchangeAdd((volatile long*)value, (long)addend) + addend;
+}
+
+inline u64 atomic_add_u64(volatile u64 *value, u64 addend)
+{
+    return (u64)_InterlockedExchangeAdd64((volatile long long*)value, (long long)addend) + addend;
+}
+
+inline bool atomic_cas_u64(volatile u64 *value, u64 expected, u64 desired)
+{
+    return (u64)_InterlockedCompareExchange64((volatile long long*)value, (long long)desired, (long long)expected) == expected;
+}
+
+inline u32 atomic_load_u32(volatile u32 *value)
+{
+    u32 ret = *value;
+    _ReadWriteBarrier();
+    return ret;
+}
+
+inline u64 atomic_load_u64(volatile u64 *value)
+{
+    return (u64)_InterlockedCompareExchange64((volatile long long*)value, 0, 0);
+}
+
+inline void atomic_store_u32(volatile u32 *value, u32 desired)
+{
+    _InterlockedExchange((volatile long*)value, (long)desired);
+}
+
+inline void atomic_store_u64(volatile u64 *value, u64 desired)
+{
+    _InterlockedExchange64((volatile long long*)value, (long long)desired);
+}
+
+#else
+
+static void *thread_entry(void *param)
+{
+    Thread *thread = (Thread*)param;
+    thread->proc(thread->param);
+    return 0;
+}
+
+static bool thread_create(Thread *thread, thread_proc proc, void *param)
+{
+    thread->proc = proc;
+    thread->param = param;
+    return pthread_create(&thread->handle, 0, thread_entry, thread) == 0;
+}
+
+static void thread_join(Thread *thread)
+{
+    pthread_join(thread->handle, 0);
+}
+
+static void thread_yield()
+{
+    sched_yield();
+}
+
+static void thread_sleep_ms(u32 ms)
+{
+    usleep(ms * 1000);
+}
+
+static u32 platform_core_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
+static double platform_time()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// all atomics return the new value
+inline u32 atomic_add_u32(volatile u32 *value, u32 addend)
+{
+    return __atomic_add_fetch(value, addend, __ATOMIC_SEQ_CST);
+}
+
+inline u64 atomic_add_u64(volatile u64 *value, u64 addend)
+{
+    return __atomic_add_fetch(value, addend, __ATOMIC_SEQ_CST);
+}
+
+inline bool atomic_cas_u64(volatile u64 *value, u64 expected, u64 desired)
+{
+    return __atomic_compare_exchange_n(value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+inline u32 atomic_load_u32(volatile u32 *value)
+{
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+inline u64 atomic_load_u64(volatile u64 *value)
+{
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+inline void atomic_store_u32(volatile u32 *value, u32 desired)
+{
+    __atomic_store_n(value, desired, __ATOMIC_RELEASE);
+}
+
+inline void atomic_store_u64(volatile u64 *value, u64 desired)
+{
+    __atomic_store_n(value, desired, __ATOMIC_RELEASE);
+}
+
+#endif
+
+// short critical sections only, waiting thread yield instead of sleeping
+inline void spin_lock(volatile u64 *lock)
+{
+    while (!atomic_cas_u64(lock, 0, 1))
+        thread_yield();
+}
+
+inline void spin_unlock(volatile u64 *lock)
+{
+    atomic_store_u64(lock, 0);
+}
+
+#endif
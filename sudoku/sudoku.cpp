@@ -4,6 +4,9 @@
 #include <time.h>
 #include <stdlib.h>
 #include "nmmintrin.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 typedef unsigned char u8;
 typedef unsigned short u16;
@@ -36,47 +39,324 @@ void sudoku_print(u8 *sudoku, int max_size)
 #endif
 }
 
-bool read_sudoku_file(char *fname, u8 *sudoku, int max_row, int max_col, int max_size)
+// puzzle text parser, every reader go through here
+//
+// three formats are auto detected:
+// - line: one puzzle per line, the cells as '0'..'9' or '.' with nothing in between (boards past
+//   9x9 go on with 'A'..'P'), anything after a space, tab, ',' or ';' that follow the cells is
+//   ignored (ratings...)
+// - grid: one digit per cell, spaces, '|', '-' and '+' only lay the grid out
+// - comma: numbers separated by ',' (write_sudoku_file)
+// '#' start a comment line and '=' a trailing comment (the "= 0,45" row sums of the
+// solution files). lines may end with "\r\n". a puzzle with missing cells, extra cells,
+// a char that is not a cell or givens that already conflict is rejected
+enum SudokuFormat {
+    SUDOKU_FORMAT_UNKNOWN = 0,
+    SUDOKU_FORMAT_LINE,
+    SUDOKU_FORMAT_GRID,
+    SUDOKU_FORMAT_COMMA,
+};
+
+enum SudokuParse {
+    SUDOKU_PARSE_OK = 0,
+    SUDOKU_PARSE_SHORT,    // fewer cells than the board
+    SUDOKU_PARSE_LONG,     // more cells than the board
+    SUDOKU_PARSE_BAD_CHAR, // char that is neither a cell nor a separator
+    SUDOKU_PARSE_CONFLICT, // same given twice in a row, col or block
+};
+
+// '.' and '0' are blank, then '1'..'9' and 'A'..'P' (either case) for 10..25, 0xFF for any other char
+inline u32 sudoku_char_value(u8 c)
 {
-    FILE *f = fopen(fname, "rb");
-    if(f) {
-        u8 c = 0;
-        int i = 0;
-        while (fread(&c, 1, 1, f))
+    if (c == '.') return 0;
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'P') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'p') return c - 'a' + 10;
+    return 0xFF;
+}
+
+inline bool sudoku_is_cell_char(u8 c, u32 max_row)
+{
+    return sudoku_char_value(c) <= max_row;
+}
+
+// no digit twice in a house, block_size * block_size == max_row (up to 25x25)
+bool sudoku_givens_valid(u8 *sudoku, u32 max_row, u32 block_size)
+{
+    u32 row_used[25] = {};
+    u32 col_used[25] = {};
+    u32 box_used[25] = {};
+    
+    // band / stack loops so the box of a cell need no division
+    u8 *cell = sudoku;
+    for (u32 row = 0; row < max_row; ++row)
+    {
+        u32 *box = box_used + row / block_size * block_size;
+        for (u32 stack = 0, col = 0; stack < block_size; ++stack, ++box)
         {
-            
-            // skip solution info & comment stuff
-            if (c == '=' || c == '#')
-                while (fread(&c, 1, 1, f) && c != '\n');
-            
-            // 0 to 9 ascii
-            if (c >= '0' && c <= (max_row + 48) && i < max_size)
+            for (u32 k = 0; k < block_size; ++k, ++col)
             {
-                sudoku[i++] = c - 48;
+                u32 val = *cell++;
+                if (!val)
+                    continue;
+                
+                u32 bit = 1u << val;
+                if ((row_used[row] | col_used[col] | *box) & bit)
+                    return false;
+                
+                row_used[row] |= bit;
+                col_used[col] |= bit;
+                *box |= bit;
             }
         }
+    }
+    
+    return true;
+}
+
+inline u32 sudoku_block_size(u32 max_row)
+{
+    u32 block_size = 1;
+    while ((block_size + 1) * (block_size + 1) <= max_row)
+        ++block_size;
+    return block_size;
+}
+
+// 16 line chars to digits: '.' become '0', then one subtract and two compares both
+// convert the chunk and flag any byte out of '0'..'9' (bytes past 127 wrap negative)
+inline __m128i sudoku_parse_chunk(__m128i chars, __m128i *bad)
+{
+    __m128i zero = _mm_set1_epi8('0');
+    __m128i dot = _mm_cmpeq_epi8(chars, _mm_set1_epi8('.'));
+    chars = _mm_or_si128(_mm_andnot_si128(dot, chars), _mm_and_si128(dot, zero));
+    
+    __m128i digits = _mm_sub_epi8(chars, zero);
+    __m128i out = _mm_or_si128(_mm_cmplt_epi8(digits, _mm_setzero_si128()), _mm_cmpgt_epi8(digits, _mm_set1_epi8(9)));
+    *bad = _mm_or_si128(*bad, out);
+    return digits;
+}
+
+// one line format puzzle, size without the line break. 9x9 lines are converted 16 cells
+// at a time, other sizes (the board engine) a char at a time
+SudokuParse sudoku_parse_line(u8 *line, u32 size, u8 *sudoku, u32 max_row, u32 max_size)
+{
+    if (size && line[size - 1] == '\r')
+        --size;
+    
+    if (size < max_size)
+        return SUDOKU_PARSE_SHORT;
+    
+    if (size > max_size)
+    {
+        u8 c = line[max_size];
+        if (c != ' ' && c != '\t' && c != ',' && c != ';')
+            return sudoku_is_cell_char(c, max_row) ? SUDOKU_PARSE_LONG : SUDOKU_PARSE_BAD_CHAR;
+    }
+    
+    if (max_row != 9 || max_size != 9 * 9)
+    {
+        for (u32 i = 0; i < max_size; ++i)
+        {
+            u32 val = sudoku_char_value(line[i]);
+            if (val > max_row)
+                return SUDOKU_PARSE_BAD_CHAR;
+            sudoku[i] = (u8)val;
+        }
+        return sudoku_givens_valid(sudoku, max_row, sudoku_block_size(max_row)) ? SUDOKU_PARSE_OK : SUDOKU_PARSE_CONFLICT;
+    }
+    
+    __m128i bad = _mm_setzero_si128();
+    u32 i = 0;
+    for (; i + 16 <= max_size; i += 16)
+        _mm_storeu_si128((__m128i*)(sudoku + i), sudoku_parse_chunk(_mm_loadu_si128((__m128i*)(line + i)), &bad));
+    
+    for (; i < max_size; ++i)
+    {
+        u8 c = line[i] == '.' ? '0' : line[i];
+        if (c < '0' || c > '9')
+            return SUDOKU_PARSE_BAD_CHAR;
+        sudoku[i] = c - '0';
+    }
+    
+    if (_mm_movemask_epi8(bad))
+        return SUDOKU_PARSE_BAD_CHAR;
+    
+    return sudoku_givens_valid(sudoku, 9, 3) ? SUDOKU_PARSE_OK : SUDOKU_PARSE_CONFLICT;
+}
+
+inline u64 sudoku_skip_line(u8 *text, u64 i, u64 size)
+{
+    u8 *end = (u8*)memchr(text + i, '\n', size - i);
+    return end ? end - text : size;
+}
+
+// the first line with cells decide: a whole puzzle and nothing else is the line format,
+// else a ',' anywhere outside comments make it comma, else grid
+SudokuFormat sudoku_detect_format(u8 *text, u64 size, u32 max_row, u32 max_size)
+{
+    SudokuFormat format = SUDOKU_FORMAT_UNKNOWN;
+    for (u64 i = 0; i < size;)
+    {
+        u64 end = sudoku_skip_line(text, i, size);
+        u64 line_end = end;
+        if (line_end > i && text[line_end - 1] == '\r')
+            --line_end;
         
-        fclose(f);
+        u8 *line = text + i;
+        u64 line_size = line_end - i;
+        i = end + 1;
         
-        return true;
+        if (line_size == 0 || line[0] == '#')
+            continue;
+        
+        u64 cells = 0;
+        while (cells < line_size && sudoku_is_cell_char(line[cells], max_row))
+            ++cells;
+        
+        if (format == SUDOKU_FORMAT_UNKNOWN && cells == max_size &&
+            (cells == line_size || line[cells] == ' ' || line[cells] == '\t' || line[cells] == ',' || line[cells] == ';'))
+            return SUDOKU_FORMAT_LINE;
+        
+        if (format == SUDOKU_FORMAT_UNKNOWN)
+            format = SUDOKU_FORMAT_GRID;
+        
+        for (u64 k = 0; k < line_size && line[k] != '='; ++k)
+        {
+            if (line[k] == ',')
+                return SUDOKU_FORMAT_COMMA;
+        }
     }
     
-    return false;
+    return format;
 }
 
-void write_sudoku_file(char *fname, u8 *sudoku, int max_size, int max_row)
+// grid and comma formats, cells are read until the board is full, the rest of that
+// line must not hold more cells and anything after it is ignored. parsed (optional) get
+// where the puzzle ended, the next one of a file start there
+SudokuParse sudoku_parse_cells(u8 *text, u64 size, u8 *sudoku, u32 max_row, u32 max_size, bool comma, u64 *parsed = 0)
 {
-    FILE *f = fopen(fname, "wb");
-    if (f) {
-        int i = 0;
-        while(i < max_size) {
-            fprintf(f, "%d, ", sudoku[i]);
+    u32 count = 0;
+    u64 i = 0;
+    while (i < size)
+    {
+        u8 c = text[i];
+        if (c == '#' || c == '=')
+        {
+            i = sudoku_skip_line(text, i, size);
+            if (count == max_size)
+                break;
+            continue;
+        }
+        
+        if (c == '\n' && count == max_size)
+            break;
+        
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '|' || c == '-' || c == '+' || c == ',')
+        {
             ++i;
-            if (i % max_row == 0) {
-                fwrite("\n", 1, 1, f);
-            }
+            continue;
+        }
+        
+        u32 val = 0;
+        if (c == '.')
+        {
+            ++i;
+        }
+        else if (c >= '0' && c <= '9')
+        {
+            // comma numbers can have several digits, grid cells are one char each
+            val = c - '0';
+            ++i;
+            while (comma && i < size && text[i] >= '0' && text[i] <= '9')
+                val = val * 10 + text[i++] - '0';
+            
+            if (val > max_row)
+                return SUDOKU_PARSE_BAD_CHAR;
+        }
+        else
+        {
+            return SUDOKU_PARSE_BAD_CHAR;
         }
         
+        if (count == max_size)
+            return SUDOKU_PARSE_LONG;
+        sudoku[count++] = (u8)val;
+    }
+    
+    if (parsed)
+        *parsed = i;
+    if (count < max_size)
+        return SUDOKU_PARSE_SHORT;
+    
+    return sudoku_givens_valid(sudoku, max_row, sudoku_block_size(max_row)) ? SUDOKU_PARSE_OK : SUDOKU_PARSE_CONFLICT;
+}
+
+// one puzzle from text in any format, format (optional) get the detected one
+SudokuParse sudoku_parse_text(u8 *text, u64 size, u8 *sudoku, u32 max_row, u32 max_size, SudokuFormat *format_ret = 0)
+{
+    SudokuFormat format = sudoku_detect_format(text, size, max_row, max_size);
+    if (format_ret)
+        *format_ret = format;
+    
+    if (format == SUDOKU_FORMAT_UNKNOWN)
+        return SUDOKU_PARSE_SHORT;
+    
+    if (format == SUDOKU_FORMAT_LINE)
+    {
+        // first line that isn't a comment
+        u64 i = 0;
+        while (i < size && (text[i] == '#' || text[i] == '\n' || text[i] == '\r'))
+            i = text[i] == '#' ? sudoku_skip_line(text, i, size) : i + 1;
+        
+        u64 end = sudoku_skip_line(text, i, size);
+        return sudoku_parse_line(text + i, (u32)(end - i), sudoku, max_row, max_size);
+    }
+    
+    return sudoku_parse_cells(text, size, sudoku, max_row, max_size, format == SUDOKU_FORMAT_COMMA);
+}
+
+// whole file in one read, false when it can't be opened or doesn't hold a valid puzzle.
+// the parsers only take square boards, max_row x max_col has to be max_size
+bool read_sudoku_file(char *fname, u8 *sudoku, int max_row, int max_col, int max_size)
+{
+    if (max_row != max_col || max_row * max_col != max_size)
+        return false;
+    
+    FILE *f = fopen(fname, "rb");
+    if (!f)
+        return false;
+    
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    u8 *text = (u8*)malloc(size > 0 ? size : 1);
+    size = (long)fread(text, 1, size > 0 ? size : 0, f);
+    fclose(f);
+    
+    SudokuParse parse = sudoku_parse_text(text, (u64)size, sudoku, max_row, max_size);
+    free(text);
+    
+    return parse == SUDOKU_PARSE_OK;
+}
+
+void write_sudoku_grid(FILE *f, u8 *sudoku, int max_size, int max_row)
+{
+    int i = 0;
+    while(i < max_size) {
+        fprintf(f, "%d, ", sudoku[i]);
+        ++i;
+        if (i % max_row == 0) {
+            fwrite("\n", 1, 1, f);
+        }
+    }
+}
+
+void write_sudoku_file(char *fname, u8 *sudoku, int max_size, int max_row)
+{
+    FILE *f = fopen(fname, "wb");
+    if (f) {
+        write_sudoku_grid(f, sudoku, max_size, max_row);
         fclose(f);
     }
 }
@@ -150,30 +430,302 @@ bool valid(u8 *sudoku, u8 val, int index, int max_row, int max_col, u8 block_siz
     return true;
 }
 
-bool sudoku_backtrack(u8 *sudoku_ret, u32 index, u8 max_row, u8 max_col, u8 block_size, u32 *count)
+// board state keeping used digits per row, col and block, same bit layout as sudoku_possible (1 << val)
+// so candidates of a cell is ~(row | col | box) without scanning the board
+#define SUDOKU_MAX_SIDE 16
+#define SUDOKU_MAX_CELLS (SUDOKU_MAX_SIDE * SUDOKU_MAX_SIDE)
+
+struct SudokuState {
+    u8 *sudoku;
+    u8 max_row;
+    u8 max_col;
+    u8 block_size;
+    u32 max_size;
+    u16 all_mask;
+    
+    u16 row_used[SUDOKU_MAX_SIDE];
+    u16 col_used[SUDOKU_MAX_SIDE];
+    u16 box_used[SUDOKU_MAX_SIDE];
+    
+    u8 cell_row[SUDOKU_MAX_CELLS];
+    u8 cell_col[SUDOKU_MAX_CELLS];
+    u8 cell_box[SUDOKU_MAX_CELLS];
+    
+    // cell indexes of every row, then every col, then every block
+    u32 num_houses;
+    u8 houses[3 * SUDOKU_MAX_SIDE][SUDOKU_MAX_SIDE];
+};
+
+// return false when the givens already conflict with each other
+bool sudoku_state_init(SudokuState *state, u8 *sudoku, u8 max_row, u8 max_col, u8 block_size)
+{
+    // bit 0 is unused so u16 hold at most 15 digits
+    assert(max_row < SUDOKU_MAX_SIDE && max_col < SUDOKU_MAX_SIDE);
+    
+    state->sudoku = sudoku;
+    state->max_row = max_row;
+    state->max_col = max_col;
+    state->block_size = block_size;
+    state->max_size = max_row * max_col;
+    state->all_mask = (u16)(((1 << (max_row + 1)) - 1) & ~1);
+    
+    memset(state->row_used, 0, sizeof(state->row_used));
+    memset(state->col_used, 0, sizeof(state->col_used));
+    memset(state->box_used, 0, sizeof(state->box_used));
+    
+    bool consistent = true;
+    u32 blocks_per_row = max_col / block_size;
+    for (u32 i = 0; i < state->max_size; ++i)
+    {
+        u8 row = (u8)(i / max_col);
+        u8 col = (u8)(i % max_col);
+        u8 box = (u8)(row / block_size * blocks_per_row + col / block_size);
+        state->cell_row[i] = row;
+        state->cell_col[i] = col;
+        state->cell_box[i] = box;
+        
+        u8 val = sudoku[i];
+        if (val) {
+            u16 bit = 1 << val;
+            if ((state->row_used[row] | state->col_used[col] | state->box_used[box]) & bit)
+                consistent = false;
+            
+            state->row_used[row] |= bit;
+            state->col_used[col] |= bit;
+            state->box_used[box] |= bit;
+        }
+    }
+    
+    state->num_houses = 3 * max_row;
+    for (u32 h = 0; h < max_row; ++h)
+    {
+        u32 start_block_index = (h / blocks_per_row * block_size) * max_col + h % blocks_per_row * block_size;
+        for (u32 k = 0; k < max_col; ++k)
+        {
+            state->houses[h][k] = (u8)(h * max_col + k);
+            state->houses[max_row + h][k] = (u8)(k * max_col + h);
+            state->houses[2 * max_row + h][k] = (u8)(start_block_index + k / block_size * max_col + k % block_size);
+        }
+    }
+    
+    return consistent;
+}
+
+// used digits of house h, same order as state->houses
+inline u16 sudoku_state_house_used(SudokuState *state, u32 h)
+{
+    u32 n = state->max_row;
+    if (h < n) return state->row_used[h];
+    if (h < 2 * n) return state->col_used[h - n];
+    return state->box_used[h - 2 * n];
+}
+
+inline u16 sudoku_state_candidates(SudokuState *state, u32 index)
+{
+    u16 used = state->row_used[state->cell_row[index]] | state->col_used[state->cell_col[index]] | state->box_used[state->cell_box[index]];
+    return ~used & state->all_mask;
+}
+
+inline bool sudoku_state_valid(SudokuState *state, u8 val, u32 index)
+{
+    return (sudoku_state_candidates(state, index) & (1 << val)) != 0;
+}
+
+inline void sudoku_state_place(SudokuState *state, u32 index, u8 val)
+{
+    u16 bit = 1 << val;
+    state->sudoku[index] = val;
+    state->row_used[state->cell_row[index]] |= bit;
+    state->col_used[state->cell_col[index]] |= bit;
+    state->box_used[state->cell_box[index]] |= bit;
+}
+
+inline void sudoku_state_unplace(SudokuState *state, u32 index)
+{
+    u16 bit = ~(1 << state->sudoku[index]);
+    state->sudoku[index] = 0;
+    state->row_used[state->cell_row[index]] &= bit;
+    state->col_used[state->cell_col[index]] &= bit;
+    state->box_used[state->cell_box[index]] &= bit;
+}
+
+// wall clock seconds, c11 timespec_get so no platform header is needed here
+inline double sudoku_time()
+{
+    timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// per solve instrumentation, build with -DSUDOKU_STATS=1 to turn it on.
+// engines report through a thread local SudokuStats set by sudoku_stats_begin,
+// with SUDOKU_STATS 0 every hook below is an empty statement
+#ifndef SUDOKU_STATS
+#define SUDOKU_STATS 0
+#endif
+
+struct SudokuStats {
+    u64 nodes;        // search calls, same unit as the budget
+    u64 guesses;      // tried placements
+    u64 backtracks;   // tried placements taken back
+    u64 propagations; // cells placed by propagation
+    u64 eliminations; // candidate bits removed
+    u32 depth;        // guesses on the current path
+    u32 max_depth;
+    
+    // seconds, parse and output are only filled by drivers that time them
+    double time_parse;
+    double time_fill;   // board state and candidate table setup
+    double time_search;
+    double time_output;
+};
+
+#if SUDOKU_STATS
+
+#ifdef _MSC_VER
+#define SUDOKU_THREAD_LOCAL __declspec(thread)
+#else
+#define SUDOKU_THREAD_LOCAL __thread
+#endif
+
+static SUDOKU_THREAD_LOCAL SudokuStats *sudoku_stats_current;
+
+#define SUDOKU_STAT_ADD(field, n) do { if (sudoku_stats_current) sudoku_stats_current->field += (n); } while (0)
+#define SUDOKU_STAT_GUESS() do { SudokuStats *stats_ = sudoku_stats_current; \
+    if (stats_) { ++stats_->guesses; if (++stats_->depth > stats_->max_depth) stats_->max_depth = stats_->depth; } } while (0)
+#define SUDOKU_STAT_BACKTRACK() do { SudokuStats *stats_ = sudoku_stats_current; \
+    if (stats_) { ++stats_->backtracks; --stats_->depth; } } while (0)
+#define SUDOKU_STAT_TIMER_BEGIN(name) double name = sudoku_time()
+#define SUDOKU_STAT_TIMER_END(name, field) SUDOKU_STAT_ADD(field, sudoku_time() - name)
+
+#else
+
+#define SUDOKU_STAT_ADD(field, n) do {} while (0)
+#define SUDOKU_STAT_GUESS() do {} while (0)
+#define SUDOKU_STAT_BACKTRACK() do {} while (0)
+#define SUDOKU_STAT_TIMER_BEGIN(name) do {} while (0)
+#define SUDOKU_STAT_TIMER_END(name, field) do {} while (0)
+
+#endif
+
+// every hook on this thread go to stats until sudoku_stats_end, stats is cleared first
+inline void sudoku_stats_begin(SudokuStats *stats)
+{
+#if SUDOKU_STATS
+    memset(stats, 0, sizeof(SudokuStats));
+    sudoku_stats_current = stats;
+#else
+    (void)stats;
+#endif
+}
+
+inline void sudoku_stats_end()
+{
+#if SUDOKU_STATS
+    sudoku_stats_current = 0;
+#endif
+}
+
+// fold one solve into a total, depth is a max not a sum
+void sudoku_stats_add(SudokuStats *total, SudokuStats *stats)
+{
+    total->nodes += stats->nodes;
+    total->guesses += stats->guesses;
+    total->backtracks += stats->backtracks;
+    total->propagations += stats->propagations;
+    total->eliminations += stats->eliminations;
+    if (stats->max_depth > total->max_depth)
+        total->max_depth = stats->max_depth;
+    
+    total->time_parse += stats->time_parse;
+    total->time_fill += stats->time_fill;
+    total->time_search += stats->time_search;
+    total->time_output += stats->time_output;
+}
+
+// limits of one solve, a node budget and / or a wall clock deadline (0 = no limit).
+// every engine spend one node per search call, once the budget is spent the search
+// unwind, undo its changes like a failed search and gave_up is set. nodes stay as partial stats
+#define SUDOKU_BUDGET_CLOCK_INTERVAL 1024 // nodes between two clock reads
+
+struct SudokuBudget {
+    u64 max_nodes;
+    double deadline; // sudoku_time() value
+    
+    u64 nodes;
+    bool gave_up;
+};
+
+enum SudokuStatus {
+    SUDOKU_STATUS_UNSOLVABLE = 0,
+    SUDOKU_STATUS_SOLVED,
+    SUDOKU_STATUS_GAVE_UP,
+};
+
+void sudoku_budget_init(SudokuBudget *budget, u64 max_nodes, double timeout_secs)
+{
+    budget->max_nodes = max_nodes;
+    budget->deadline = timeout_secs > 0 ? sudoku_time() + timeout_secs : 0;
+    budget->nodes = 0;
+    budget->gave_up = false;
+}
+
+// count one node, true once the budget is spent. no budget never run out
+inline bool sudoku_budget_spend(SudokuBudget *budget)
+{
+    SUDOKU_STAT_ADD(nodes, 1);
+    if (!budget) return false;
+    if (budget->gave_up) return true;
+    
+    ++budget->nodes;
+    if (budget->max_nodes && budget->nodes > budget->max_nodes)
+        budget->gave_up = true;
+    else if (budget->deadline > 0 && budget->nodes % SUDOKU_BUDGET_CLOCK_INTERVAL == 0 && sudoku_time() > budget->deadline)
+        budget->gave_up = true;
+    
+    return budget->gave_up;
+}
+
+inline bool sudoku_budget_gave_up(SudokuBudget *budget)
+{
+    return budget && budget->gave_up;
+}
+
+inline SudokuStatus sudoku_status(bool solved, SudokuBudget *budget)
+{
+    if (solved) return SUDOKU_STATUS_SOLVED;
+    return sudoku_budget_gave_up(budget) ? SUDOKU_STATUS_GAVE_UP : SUDOKU_STATUS_UNSOLVABLE;
+}
+
+bool sudoku_state_backtrack(SudokuState *state, u32 index, u32 *count, SudokuBudget *budget = 0)
 {
     
     ++*count;
-    if (*count > 387420489) {
+    if (sudoku_budget_spend(budget)) {
         return false;
     }
     
-    u32 max_size = max_row * max_col;
+    u8 *sudoku_ret = state->sudoku;
+    u32 max_size = state->max_size;
     
     for(u32 i = index; i < max_size; ++i)
     {
         if (sudoku_ret[i] == 0)
         {
-            for (u8 val = 1; val <= max_row; ++val)
+            u16 candidates = sudoku_state_candidates(state, i);
+            for (u8 val = 1; val <= state->max_row; ++val)
             {
-                if (valid(sudoku_ret, val, i, max_row, max_col, block_size)) {
-                    sudoku_ret[i] = val;
-                    if (sudoku_backtrack(sudoku_ret, i + 1, max_row, max_col, block_size, count))
+                if (candidates & (1 << val)) {
+                    sudoku_state_place(state, i, val);
+                    SUDOKU_STAT_GUESS();
+                    if (sudoku_state_backtrack(state, i + 1, count, budget))
                     {
                         return true;
                     }
                     
-                    sudoku_ret[i] = 0;
+                    sudoku_state_unplace(state, i);
+                    SUDOKU_STAT_BACKTRACK();
+                    if (sudoku_budget_gave_up(budget)) return false;
                 }
             }
             
@@ -184,30 +736,42 @@ bool sudoku_backtrack(u8 *sudoku_ret, u32 index, u8 max_row, u8 max_col, u8 bloc
     return true;
 }
 
-bool sudoku_backtrack_r(u8 *sudoku_ret, u32 index, u8 max_row, u8 max_col, u8 block_size, u32 *count)
+bool sudoku_backtrack(u8 *sudoku_ret, u32 index, u8 max_row, u8 max_col, u8 block_size, u32 *count, SudokuBudget *budget = 0)
+{
+    SudokuState state;
+    sudoku_state_init(&state, sudoku_ret, max_row, max_col, block_size);
+    return sudoku_state_backtrack(&state, index, count, budget);
+}
+
+bool sudoku_state_backtrack_r(SudokuState *state, u32 index, u32 *count, SudokuBudget *budget = 0)
 {
     
     ++*count;
-    if (*count > 387420489) {
+    if (sudoku_budget_spend(budget)) {
         return false;
     }
     
-    u32 max_size = max_row * max_col;
+    u8 *sudoku_ret = state->sudoku;
+    u32 max_size = state->max_size;
     
     for(u32 i = index; i < max_size; ++i)
     {
         if (sudoku_ret[i] == 0)
         {
-            for (u8 val = max_row; val > 0; --val)
+            u16 candidates = sudoku_state_candidates(state, i);
+            for (u8 val = state->max_row; val > 0; --val)
             {
-                if (valid(sudoku_ret, val, i, max_row, max_col, block_size)) {
-                    sudoku_ret[i] = val;
-                    if (sudoku_backtrack_r(sudoku_ret, i + 1, max_row, max_col, block_size, count))
+                if (candidates & (1 << val)) {
+                    sudoku_state_place(state, i, val);
+                    SUDOKU_STAT_GUESS();
+                    if (sudoku_state_backtrack_r(state, i + 1, count, budget))
                     {
                         return true;
                     }
                     
-                    sudoku_ret[i] = 0;
+                    sudoku_state_unplace(state, i);
+                    SUDOKU_STAT_BACKTRACK();
+                    if (sudoku_budget_gave_up(budget)) return false;
                 }
             }
             
@@ -218,32 +782,165 @@ bool sudoku_backtrack_r(u8 *sudoku_ret, u32 index, u8 max_row, u8 max_col, u8 bl
     return true;
 }
 
-u16 count_set_bits(u16 n) {
+bool sudoku_backtrack_r(u8 *sudoku_ret, u32 index, u8 max_row, u8 max_col, u8 block_size, u32 *count, SudokuBudget *budget = 0)
+{
+    SudokuState state;
+    sudoku_state_init(&state, sudoku_ret, max_row, max_col, block_size);
+    return sudoku_state_backtrack_r(&state, index, count, budget);
+}
+
+// hardware popcount, -march=native (or msvc on any x64 from the last decade) has the instruction
+inline u16 count_set_bits(u16 n) {
+#ifdef _MSC_VER
+    return __popcnt16(n);
+#else
+    return (u16)__builtin_popcount(n);
+#endif
+}
+
+// every position mask with 2 or 3 bits set in ascending order, so the subsets of
+// a house with n cells are the prefix below (1 << n). same table index digits (bit d - 1)
+#define SUDOKU_SUBSET_MAX 3
+#define SUDOKU_SUBSET_TABLE_SIZE 680 // C(16, 2) + C(16, 3)
+
+struct SudokuSubsetTable {
+    bool ready;
+    u32 count;
+    u16 masks[SUDOKU_SUBSET_TABLE_SIZE];
+};
+
+static SudokuSubsetTable sudoku_subset_table;
+
+// call once before any thread use the subset tier
+void sudoku_subset_table_init()
+{
+    if (sudoku_subset_table.ready)
+        return;
+    
     u32 count = 0;
-    while (n) {
-        n &= (n - 1); // Removes the rightmost set bit in each iteration
-        count++;
+    for (u32 mask = 1; mask < (1 << SUDOKU_MAX_SIDE); ++mask)
+    {
+        u32 bits = count_set_bits((u16)mask);
+        if (bits >= 2 && bits <= SUDOKU_SUBSET_MAX)
+            sudoku_subset_table.masks[count++] = (u16)mask;
     }
-    return count;
+    assert(count == SUDOKU_SUBSET_TABLE_SIZE);
+    
+    sudoku_subset_table.count = count;
+    sudoku_subset_table.ready = true;
 }
 
-void print_candidates(u16 candidates) 
+// index of the lowest set bit, mask must not be zero
+inline u32 lowest_bit_index(u32 mask)
 {
-    for (u8 val = 1; val <= 9; ++val) {
-        if (1 << val & candidates)
-        {
-            printf("%d ", val);
-        }
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// digits that appear in exactly one cell of house h, also check every missing digit still has a place
+// once/twice trick: a bit that show up a second time moves to twice
+inline bool sudoku_house_unique(SudokuState *state, u16 *sudoku_possible, u32 h, u16 *unique)
+{
+    u8 *house = state->houses[h];
+    u16 once = 0;
+    u16 twice = 0;
+    for (u32 k = 0; k < state->max_col; ++k)
+    {
+        u16 m = sudoku_possible[house[k]];
+        twice |= once & m;
+        once |= m;
     }
-    printf("\n");
+    
+    *unique = once & ~twice;
+    return (once | sudoku_state_house_used(state, h)) == state->all_mask;
 }
 
-bool sudoku_reduce_possible(u8 *sudoku, u16* sudoku_possible, int index, int val, int max_row, int max_col, int block_size)
+// tag hidden singles of the candidate table, display only, nothing is removed
+void sudoku_mark_hidden_singles(SudokuState *state, u16 *sudoku_possible, u16 *hidden_single)
 {
-    int max_size = max_row * max_col;
+    memset(hidden_single, 0, state->max_size * sizeof(u16));
+    for (u32 h = 0; h < state->num_houses; ++h)
+    {
+        u16 unique = 0;
+        sudoku_house_unique(state, sudoku_possible, h, &unique);
+        if (!unique) continue;
+        
+        u8 *house = state->houses[h];
+        for (u32 k = 0; k < state->max_col; ++k)
+            hidden_single[house[k]] |= sudoku_possible[house[k]] & unique;
+    }
+}
+
+// candidates of every cell of house h into m, and positions (bit k for houses[h][k]) of every digit into where
+// return the open cells as positions
+inline u32 sudoku_house_positions(SudokuState *state, u16 *sudoku_possible, u32 h, u16 *m, u16 *where)
+{
+    u8 *house = state->houses[h];
+    u32 open = 0;
+    memset(where, 0, (state->max_row + 1) * sizeof(u16));
+    for (u32 k = 0; k < state->max_col; ++k)
+    {
+        m[k] = sudoku_possible[house[k]];
+        if (!m[k]) continue;
+        
+        open |= 1 << k;
+        for (u32 bits = m[k]; bits; bits &= bits - 1)
+            where[lowest_bit_index(bits)] |= 1 << k;
+    }
     
-    // validate row
-    int row = index / max_col;
+    return open;
+}
+
+// tag hidden pairs (two digits that share the same two cells of a house), display only
+void sudoku_mark_hidden_pairs(SudokuState *state, u16 *sudoku_possible, u16 *hidden_pair)
+{
+    memset(hidden_pair, 0, state->max_size * sizeof(u16));
+    
+    u16 m[SUDOKU_MAX_SIDE];
+    u16 where[SUDOKU_MAX_SIDE + 1];
+    for (u32 h = 0; h < state->num_houses; ++h)
+    {
+        sudoku_house_positions(state, sudoku_possible, h, m, where);
+        
+        u8 *house = state->houses[h];
+        for (u32 d1 = 1; d1 <= state->max_row; ++d1)
+        {
+            if (count_set_bits(where[d1]) != 2) continue;
+            
+            for (u32 d2 = d1 + 1; d2 <= state->max_row; ++d2)
+            {
+                if (where[d2] != where[d1]) continue;
+                
+                u16 bits = (u16)((1 << d1) | (1 << d2));
+                for (u32 cells = where[d1]; cells; cells &= cells - 1)
+                    hidden_pair[house[lowest_bit_index(cells)]] |= bits;
+            }
+        }
+    }
+}
+
+void print_candidates(u16 candidates) 
+{
+    for (u8 val = 1; val <= 9; ++val) {
+        if (1 << val & candidates)
+        {
+            printf("%d ", val);
+        }
+    }
+    printf("\n");
+}
+
+bool sudoku_reduce_possible(u8 *sudoku, u16* sudoku_possible, int index, int val, int max_row, int max_col, int block_size)
+{
+    int max_size = max_row * max_col;
+    
+    // validate row
+    int row = index / max_col;
     int start_row = row * max_col;
     int end_row = start_row +  max_col;
     
@@ -256,6 +953,7 @@ bool sudoku_reduce_possible(u8 *sudoku, u16* sudoku_possible, int index, int val
     {
         if (sudoku_possible[i] & possible) {
             sudoku_possible[i] ^= possible;
+            SUDOKU_STAT_ADD(eliminations, 1);
             
             if (!sudoku_possible[i]) // zero possible mean we pick wrong number
                 return false;
@@ -269,6 +967,7 @@ bool sudoku_reduce_possible(u8 *sudoku, u16* sudoku_possible, int index, int val
         int col_index = i * max_row + col;
         if (sudoku_possible[col_index] & possible) {
             sudoku_possible[col_index] ^= possible;
+            SUDOKU_STAT_ADD(eliminations, 1);
             
             if (!sudoku_possible[col_index]) // zero possible mean we pick wrong number
                 return false;
@@ -286,6 +985,7 @@ bool sudoku_reduce_possible(u8 *sudoku, u16* sudoku_possible, int index, int val
             const int block_index = start_block_index +  i * max_col + j;
             if (sudoku_possible[block_index] & possible) {
                 sudoku_possible[block_index] ^= possible;
+                SUDOKU_STAT_ADD(eliminations, 1);
                 
                 if (!sudoku_possible[block_index]) // zero possible mean we pick wrong number
                     return false;
@@ -301,261 +1001,39 @@ bool sudoku_reduce_possible(u8 *sudoku, u16* sudoku_possible, int index, int val
 void sudoku_fill_possible(u8 *sudoku, u16* sudoku_possible, int max_row, int max_col, int block_size)
 {
     int max_size = max_row * max_col;
+    
+    sudoku_subset_table_init();
+    SUDOKU_STAT_TIMER_BEGIN(time_fill_start);
+    
+    SudokuState state;
+    sudoku_state_init(&state, sudoku, max_row, max_col, block_size);
     for(int i = 0; i < max_size; ++i)
     {
         if (sudoku[i] == 0) {
-            for (u16 val = 1; val <= max_row; ++val) {
-                if (valid(sudoku, val, i, max_row, max_col, block_size))
-                {
-                    // first 16 bit for marking possible number, second 16 bit for count possible
-                    sudoku_possible[i] |= 1 << val;
-                    //sudoku_possible[i] += 1;
-                }
-            }
+            // first 16 bit for marking possible number, second 16 bit for count possible
+            sudoku_possible[i] |= sudoku_state_candidates(&state, i);
         }
     }
     
-    // hidden naked
+    // hidden pairs and singles for the debugger view
     u16 *hidden_pair = sudoku_possible + max_size;
     u16 *hidden_single = sudoku_possible + max_size * 2;
     
-    int delta = 0;
-    
-#if 0
-    // row
-    for (int row = 0; row < max_row; ++row)
-    {
-        int start_row = row * max_row;
-        int end_row = start_row + max_row;
-        for(int i = start_row; i < end_row; ++i)
-        {
-            if (hidden_pair[i]) continue;
-            
-            for(int j = i + 1; j < end_row; ++j)
-            {
-                if (hidden_pair[j]) continue;
-                
-                u16 bits = sudoku_possible[i] & sudoku_possible[j];
-                if (count_set_bits(bits) == 2) {
-                    u16 row_bits = 0;
-                    for (int k = start_row; k < end_row; ++k)
-                    {
-                        if (k != i && k != j) {
-                            row_bits |= sudoku_possible[k];
-                        }
-                    }
-                    
-                    if ((bits & row_bits) == 0)
-                    {
-                        printf("found naked hidden at: %d, %d and %d, %d\n", row, i, row, j);
-                        print_candidates(sudoku_possible[i]);
-                        print_candidates(sudoku_possible[j]);
-                        print_candidates(bits);
-                        hidden_pair[i] = bits;
-                        hidden_pair[j] = bits;
-                    }
-                }
-            }
-        }
-    }
-    
-    // col
-    for (int col = 0; col < max_col; ++col) 
-    {
-        for(int i = 0; i < max_row; ++i)
-        {
-            for(int j = i; j < max_row; ++j)
-            {
-                int col_i = i * max_row + col;
-                int col_j = j * max_row + col;
-                if (hidden_pair[col_i] || hidden_pair[col_j]) continue;
-                
-                u16 bits = sudoku_possible[col_i] & sudoku_possible[col_j];
-                if (count_set_bits(bits) == 2) {
-                    u16 col_bits = 0;
-                    for (int k = 0; k < max_row; ++k) {
-                        int col_k = col * max_row + k;
-                        if (col_k != col_i && col_k != col_j)
-                        {
-                            col_bits |= sudoku_possible[col_k];
-                        }
-                    }
-                    
-                    if ((bits & col_bits) == 0)
-                    {
-                        printf("found naked hidden at: %d, %d and %d, %d\n", i, col, j, col);
-                        print_candidates(sudoku_possible[col_i]);
-                        print_candidates(sudoku_possible[col_j]);
-                        print_candidates(bits);
-                        hidden_pair[col_i] = bits;
-                        hidden_pair[col_j] = bits;
-                    }
-                }
-            }
-        }
-    }
-    
-    // block
-    delta = 0;
-    for (int b = 0; b < 9; ++b)
-    {
-        int start_block_index = b * block_size + delta * max_col;
-        if ((b + 1)% 3 == 0) delta += 2;
-        
-        int box_indexs[9] = {0};
-        int bi = 0;
-        for (int i = 0; i < block_size; ++i)
-        {
-            for(int j = 0; j < block_size; ++j)
-            {
-                const int block_index = start_block_index +  i * max_col + j;
-                box_indexs[bi++] = block_index;
-            }
-        }
-        
-        for (int i = 0; i < bi; ++i) {
-            for (int j = i; j < bi; ++j)
-            {
-                int xi = box_indexs[i];
-                int xj = box_indexs[j];
-                u16 bits = sudoku_possible[xi] & sudoku_possible[xj];
-                if (count_set_bits(bits) == 2) {
-                    u16 row_bits = 0;
-                    for (int k = 0; k < bi; ++k)
-                    {
-                        int xk = box_indexs[k];
-                        if (k != i && k != j) {
-                            row_bits |= sudoku_possible[xk];
-                        }
-                    }
-                    
-                    if ((bits & row_bits) == 0)
-                    {
-                        printf("box found naked hidden at: %d and %d\n", xi, xj);
-                        print_candidates(sudoku_possible[xi]);
-                        print_candidates(sudoku_possible[xj]);
-                        print_candidates(bits);
-                        hidden_pair[xi] = bits;
-                        hidden_pair[xj] = bits;
-                    }
-                }
-            }
-        }
-        
-    }
-    
-#endif
-    
-#if 0
-    // row
-    for (int row = 0; row < max_row; ++row)
-    {
-        int start_row = row * max_row;
-        int end_row = start_row + max_row;
-        
-        for (u32 val = 1; val <= max_row; ++val)
-        {
-            u16 val_bit = (1 << val);
-            u32 count = 0;
-            u32 found_index = 0;
-            for(int i = start_row; i < end_row; ++i)
-            {
-                if (sudoku_possible[i] & val_bit) {
-                    ++count;
-                    found_index = i;
-                }
-            }
-            
-            if (count == 1) {
-                hidden_single[found_index] |= val_bit;
-                printf("row found hidden single at: %d val %d\n", found_index, val);
-            }
-        }
-    }
-    
-    // col
-    for (int col = 0; col < max_col; ++col) 
-    {
-        for (u32 val = 1; val <= max_row; ++val)
-        {
-            u16 val_bit = (1 << val);
-            u32 count = 0;
-            u32 found_index = 0;
-            for(int i = 0; i < max_row; ++i)
-            {
-                int col_i = i * max_row + col;
-                if (sudoku_possible[col_i] & val_bit) {
-                    ++count;
-                    found_index = col_i;
-                }
-            }
-            
-            if (count == 1) {
-                hidden_single[found_index] |= val_bit;
-                print_candidates(sudoku_possible[found_index]);
-                printf("col found hidden single at %d val %d\n", found_index, val);
-            }
-        }
-    }
-    
-    // block
-    delta = 0;
-    for (int b = 0; b < 9; ++b)
-    {
-        int start_block_index = b * block_size + delta * max_col;
-        if ((b + 1)% 3 == 0) delta += 2;
-        
-        int box_indexs[9] = {0};
-        int bi = 0;
-        for (int i = 0; i < block_size; ++i)
-        {
-            for(int j = 0; j < block_size; ++j)
-            {
-                const int block_index = start_block_index +  i * max_col + j;
-                box_indexs[bi++] = block_index;
-            }
-        }
-        
-        // loop through indexs
-        for (u32 val = 1; val <= max_row; ++val)
-        {
-            u16 val_bit = (1 << val);
-            u32 count = 0;
-            u32 found_index = 0;
-            for (int i = 0; i < bi; ++i) {
-                int ki = box_indexs[i];
-                if (sudoku_possible[ki] & val_bit) {
-                    ++count;
-                    found_index = ki;
-                }
-            }
-            
-            if (count == 1) {
-                hidden_single[found_index] |= val_bit;
-                print_candidates(sudoku_possible[found_index]);
-                printf("box found hidden single at %d val %d\n", found_index, val);
-            }
-        }
-    }
-#endif
+    sudoku_mark_hidden_pairs(&state, sudoku_possible, hidden_pair);
+    sudoku_mark_hidden_singles(&state, sudoku_possible, hidden_single);
+    SUDOKU_STAT_TIMER_END(time_fill_start, time_fill);
 }
 
 void sudoku_update_possible(u8 *sudoku, u16* sudoku_possible, int max_row, int max_col, int block_size)
 {
     int max_size = max_row * max_col;
+    
+    SudokuState state;
+    sudoku_state_init(&state, sudoku, max_row, max_col, block_size);
     for(int i = 0; i < max_size; ++i)
     {
         if (sudoku[i] == 0) {
-            u16 possible = 0;
-            for (u8 val = 1; val <= max_row; ++val) {
-                if (valid(sudoku, val, i, max_row, max_col, block_size))
-                {
-                    // first 16 bit for marking possible number, second 16 bit for count possible
-                    possible |= 1 << val;
-                }
-            }
-            
-            sudoku_possible[i] = possible;
+            sudoku_possible[i] = sudoku_state_candidates(&state, i);
         }
     }
     
@@ -563,25 +1041,18 @@ void sudoku_update_possible(u8 *sudoku, u16* sudoku_possible, int max_row, int m
 }
 
 
-int find_possible_min(u8 *sudoku, u32 max_row, u32 max_col, u32 block_size)
+int find_possible_min_state(SudokuState *state)
 {
-    u32 max_size = max_row * max_col;
+    u8 *sudoku = state->sudoku;
+    u32 max_size = state->max_size;
     
     u32 min_index = max_size;
-    u32 min_count = max_row;
+    u32 min_count = state->max_row;
     
     for(u32 i = 0; i < max_size; ++i)
     {
         if (sudoku[i] == 0) {
-            
-            u32 count = 0;
-            for (u8 val = 1; val <= max_row; ++val) {
-                if (valid(sudoku, val, i, max_row, max_col, block_size))
-                {
-                    count += 1;
-                }
-            }
-            
+            u32 count = count_set_bits(sudoku_state_candidates(state, i));
             if (count < min_count) {
                 min_index = i;
                 min_count = count;
@@ -592,28 +1063,41 @@ int find_possible_min(u8 *sudoku, u32 max_row, u32 max_col, u32 block_size)
     return min_index;
 }
 
+int find_possible_min(u8 *sudoku, u32 max_row, u32 max_col, u32 block_size)
+{
+    SudokuState state;
+    sudoku_state_init(&state, sudoku, max_row, max_col, block_size);
+    return find_possible_min_state(&state);
+}
 
-bool sudoku_backtrack_min(u8 *sudoku_ret, u8 max_row, u8 max_col, u8 block_size, u32 *num_guess = 0)
+bool sudoku_state_backtrack_min(SudokuState *state, u32 *num_guess, SudokuBudget *budget = 0)
 {
-    const u32 max_size = max_row * max_col;
-    u32 i = find_possible_min(sudoku_ret, max_row, max_col, block_size);
+    if (sudoku_budget_spend(budget))
+        return false;
+    
+    const u32 max_size = state->max_size;
+    u32 i = find_possible_min_state(state);
     if (i < max_size)
     {
-        for (u8 val = 1; val <= max_row; ++val)
+        u16 candidates = sudoku_state_candidates(state, i);
+        for (u8 val = 1; val <= state->max_row; ++val)
         {
             
-            if (valid(sudoku_ret, val, i, max_row, max_col, block_size)) 
+            if (candidates & (1 << val)) 
             {
                 if (num_guess)
                     ++*num_guess;
-                sudoku_ret[i] = val;
+                sudoku_state_place(state, i, val);
+                SUDOKU_STAT_GUESS();
                 
-                if (sudoku_backtrack_min(sudoku_ret, max_row, max_col, block_size, num_guess))
+                if (sudoku_state_backtrack_min(state, num_guess, budget))
                 {
                     return true;
                 }
                 else {
-                    sudoku_ret[i] = 0;
+                    sudoku_state_unplace(state, i);
+                    SUDOKU_STAT_BACKTRACK();
+                    if (sudoku_budget_gave_up(budget)) return false;
                 }
             }
         }
@@ -624,29 +1108,43 @@ bool sudoku_backtrack_min(u8 *sudoku_ret, u8 max_row, u8 max_col, u8 block_size,
     return true;
 }
 
-bool sudoku_backtrack_with_possible(u8 *sudoku_ret, u16 *sudoku_possible, int index, u8 max_row, u8 max_col, u8 block_size, u32 *num_guess = 0)
+bool sudoku_backtrack_min(u8 *sudoku_ret, u8 max_row, u8 max_col, u8 block_size, u32 *num_guess = 0, SudokuBudget *budget = 0)
 {
-    int max_size = max_row * max_col;
+    SudokuState state;
+    sudoku_state_init(&state, sudoku_ret, max_row, max_col, block_size);
+    return sudoku_state_backtrack_min(&state, num_guess, budget);
+}
+
+bool sudoku_state_backtrack_with_possible(SudokuState *state, u16 *sudoku_possible, int index, u32 *num_guess, SudokuBudget *budget = 0)
+{
+    if (sudoku_budget_spend(budget))
+        return false;
+    
+    u8 *sudoku_ret = state->sudoku;
+    int max_size = state->max_size;
     for(int i = index; i < max_size; ++i)
     {
         if (sudoku_ret[i] == 0)
         {
             u16 possible_data = sudoku_possible[i];
-            for (u8 val = 1; val <= max_row; ++val)
+            for (u8 val = 1; val <= state->max_row; ++val)
             {
                 u16 possible = (1 << val) & possible_data;
                 if (possible)
                 {
                     if (num_guess) ++*num_guess;
                     
-                    if (valid(sudoku_ret, val, i, max_row, max_col, block_size)) {
-                        sudoku_ret[i] = val;
-                        if (sudoku_backtrack_with_possible(sudoku_ret, sudoku_possible, i + 1, max_row, max_col, block_size, num_guess))
+                    if (sudoku_state_valid(state, val, i)) {
+                        sudoku_state_place(state, i, val);
+                        SUDOKU_STAT_GUESS();
+                        if (sudoku_state_backtrack_with_possible(state, sudoku_possible, i + 1, num_guess, budget))
                         {
                             return true;
                         }
                         else {
-                            sudoku_ret[i] = 0;
+                            sudoku_state_unplace(state, i);
+                            SUDOKU_STAT_BACKTRACK();
+                            if (sudoku_budget_gave_up(budget)) return false;
                         }
                     }
                 }
@@ -659,6 +1157,13 @@ bool sudoku_backtrack_with_possible(u8 *sudoku_ret, u16 *sudoku_possible, int in
     return true;
 }
 
+bool sudoku_backtrack_with_possible(u8 *sudoku_ret, u16 *sudoku_possible, int index, u8 max_row, u8 max_col, u8 block_size, u32 *num_guess = 0, SudokuBudget *budget = 0)
+{
+    SudokuState state;
+    sudoku_state_init(&state, sudoku_ret, max_row, max_col, block_size);
+    return sudoku_state_backtrack_with_possible(&state, sudoku_possible, index, num_guess, budget);
+}
+
 int find_possible_min_from_table(u8 *sudoku, u16 *possible, u32 max_size)
 {
     
@@ -681,9 +1186,17 @@ int find_possible_min_from_table(u8 *sudoku, u16 *possible, u32 max_size)
 
 typedef void (*debug_callback)(void *context, u8 *sudoku, u16 *sudoku_possible, u32 index, u32 val);
 
-bool sudoku_backtrack_heuristic(u8 *sudoku, u16 *sudoku_possible, u8 max_row, u8 max_col, u8 block_size, u32 *num_guess, debug_callback db_callback = 0, void *debug_context = 0)
+// the candidate table of every guess is freed on every way out, gave up included
+bool sudoku_state_backtrack_heuristic(SudokuState *state, u16 *sudoku_possible, u32 *num_guess, debug_callback db_callback, void *debug_context, SudokuBudget *budget = 0)
 {
-    u32 max_size = max_row * max_col;
+    if (sudoku_budget_spend(budget))
+        return false;
+    
+    u8 *sudoku = state->sudoku;
+    u8 max_row = state->max_row;
+    u8 max_col = state->max_col;
+    u8 block_size = state->block_size;
+    u32 max_size = state->max_size;
     
     u32 i = find_possible_min_from_table(sudoku, sudoku_possible, max_size);
     if (i < max_size)
@@ -695,9 +1208,10 @@ bool sudoku_backtrack_heuristic(u8 *sudoku, u16 *sudoku_possible, u8 max_row, u8
             if (possible)
             {
                 
-                if (valid(sudoku, val, i, max_row, max_col, block_size)) {
+                if (sudoku_state_valid(state, val, i)) {
                     if (num_guess) ++*num_guess;
-                    sudoku[i] = val;
+                    sudoku_state_place(state, i, val);
+                    SUDOKU_STAT_GUESS();
                     
                     
                     u32 size = sizeof(u16) * max_size * 3;
@@ -708,14 +1222,16 @@ bool sudoku_backtrack_heuristic(u8 *sudoku, u16 *sudoku_possible, u8 max_row, u8
                     if (db_callback) {
                         db_callback(debug_context, sudoku, new_possible, i, val);
                     }
-                    if (valid_pick && sudoku_backtrack_heuristic(sudoku, new_possible, max_row, max_col, block_size, num_guess, db_callback, debug_context))
+                    if (valid_pick && sudoku_state_backtrack_heuristic(state, new_possible, num_guess, db_callback, debug_context, budget))
                     {
                         free(new_possible);
                         return true;
                     }
                     else {
                         free(new_possible);
-                        sudoku[i] = 0;
+                        sudoku_state_unplace(state, i);
+                        SUDOKU_STAT_BACKTRACK();
+                        if (sudoku_budget_gave_up(budget)) return false;
                     }
                 }
             }
@@ -727,206 +1243,1593 @@ bool sudoku_backtrack_heuristic(u8 *sudoku, u16 *sudoku_possible, u8 max_row, u8
     return true;
 }
 
-void test(char *fproblem, char *fsolution, bool print_result, int algorithm = 0)
+bool sudoku_backtrack_heuristic(u8 *sudoku, u16 *sudoku_possible, u8 max_row, u8 max_col, u8 block_size, u32 *num_guess, debug_callback db_callback = 0, void *debug_context = 0, SudokuBudget *budget = 0)
 {
-    const u8 max_row = 9;
-    const u8 max_col = 9;
-    const u8 block_size = 3;
+    SudokuState state;
+    sudoku_state_init(&state, sudoku, max_row, max_col, block_size);
+    return sudoku_state_backtrack_heuristic(&state, sudoku_possible, num_guess, db_callback, debug_context, budget);
+}
+
+// undo trail for candidate eliminations, heuristic search work on one candidate table
+// and restore it on backtrack instead of malloc + memcpy a new table for every guess
+struct SudokuTrailEntry {
+    u16 index;
+    u16 bits; // bits removed from sudoku_possible[index], 0 mean a digit was placed at index
+};
+
+// every entry remove at least one candidate bit or place one cell along a search path
+#define SUDOKU_TRAIL_SIZE (SUDOKU_MAX_CELLS * SUDOKU_MAX_SIDE * 3)
+
+struct SudokuTrail {
+    u32 count;
+    SudokuTrailEntry entries[SUDOKU_TRAIL_SIZE];
+};
+
+inline void sudoku_trail_remove(SudokuTrail *trail, u16 *sudoku_possible, u32 index, u16 bits)
+{
+    assert(trail->count < SUDOKU_TRAIL_SIZE);
+    SudokuTrailEntry *entry = trail->entries + trail->count++;
+    entry->index = (u16)index;
+    entry->bits = bits;
+    sudoku_possible[index] &= ~bits;
+    SUDOKU_STAT_ADD(eliminations, count_set_bits(bits));
+}
+
+inline void sudoku_trail_place(SudokuTrail *trail, SudokuState *state, u32 index, u8 val)
+{
+    assert(trail->count < SUDOKU_TRAIL_SIZE);
+    SudokuTrailEntry *entry = trail->entries + trail->count++;
+    entry->index = (u16)index;
+    entry->bits = 0;
+    sudoku_state_place(state, index, val);
+}
+
+inline void sudoku_trail_undo(SudokuTrail *trail, SudokuState *state, u16 *sudoku_possible, u32 mark)
+{
+    while (trail->count > mark)
+    {
+        SudokuTrailEntry *entry = trail->entries + --trail->count;
+        if (entry->bits)
+            sudoku_possible[entry->index] |= entry->bits;
+        else
+            sudoku_state_unplace(state, entry->index);
+    }
+}
+
+// same as sudoku_reduce_possible but every removed bit go to the trail
+bool sudoku_reduce_possible_trail(SudokuState *state, u16 *sudoku_possible, SudokuTrail *trail, u32 index, u8 val)
+{
+    u32 max_row = state->max_row;
+    u32 max_col = state->max_col;
+    u32 block_size = state->block_size;
+    u32 row = state->cell_row[index];
+    u32 col = state->cell_col[index];
     
-    const int max_size = max_row * max_col;
-    u16 sudoku_possible[max_size] = {};
-    u8 sudoku[max_size] = {};
-    u8 sudoku_s[max_size] = {};
+    if (sudoku_possible[index])
+        sudoku_trail_remove(trail, sudoku_possible, index, sudoku_possible[index]);
     
-    assert(read_sudoku_file(fproblem, sudoku, max_row, max_col, max_size));
-    assert(read_sudoku_file(fsolution, sudoku_s, max_row, max_col, max_size));
+    u16 possible = 1 << val;
     
-    if (print_result)
+    // row
+    u32 start_row = row * max_col;
+    for (u32 i = start_row; i < start_row + max_col; ++i)
     {
-        sudoku_print(sudoku, max_size);
-        sudoku_print(sudoku_s, max_size);
+        if (sudoku_possible[i] & possible) {
+            sudoku_trail_remove(trail, sudoku_possible, i, possible);
+            
+            if (!sudoku_possible[i]) // zero possible mean we pick wrong number
+                return false;
+        }
     }
     
-    if (algorithm == 0)
-    {
-        sudoku_backtrack_min(sudoku, max_row, max_col, block_size);
-    }
-    else if (algorithm == 1)
-    {
-        sudoku_fill_possible(sudoku, sudoku_possible, max_row, max_col, block_size);
-        int index = find_free(sudoku, 0, max_size);
-        sudoku_backtrack_with_possible(sudoku,  sudoku_possible, index, max_row, max_col, block_size);
-    }
-    else if (algorithm == 2)
+    // col
+    for (u32 i = 0; i < max_row; ++i)
     {
-        
-        u32 count = 0;
-        sudoku_backtrack(sudoku, 0, max_row, max_col, block_size, &count);
+        u32 col_index = i * max_col + col;
+        if (sudoku_possible[col_index] & possible) {
+            sudoku_trail_remove(trail, sudoku_possible, col_index, possible);
+            
+            if (!sudoku_possible[col_index])
+                return false;
+        }
     }
     
-    if (print_result)
+    // block
+    u32 start_block_index = (row / block_size * block_size) * max_col + col / block_size * block_size;
+    for (u32 i = 0; i < block_size; ++i)
     {
-        sudoku_print(sudoku, max_size);
+        for (u32 j = 0; j < block_size; ++j)
+        {
+            u32 block_index = start_block_index + i * max_col + j;
+            if (sudoku_possible[block_index] & possible) {
+                sudoku_trail_remove(trail, sudoku_possible, block_index, possible);
+                
+                if (!sudoku_possible[block_index])
+                    return false;
+            }
+        }
     }
-    int ret = memcmp(sudoku, sudoku_s, max_size);
-    assert(ret == 0);
     
+    return true;
 }
 
-void generate_sudoku(u32 level, u32 max_row, u32 max_col, u32 block_size) 
+// propagation run after every placement of the heuristic search
+enum SudokuPropagate {
+    SUDOKU_PROPAGATE_NONE = 0,
+    SUDOKU_PROPAGATE_SINGLES = 1 << 0, // naked + hidden singles to fixpoint
+    SUDOKU_PROPAGATE_SUBSETS = 1 << 1, // naked/hidden pairs + triples, pointing + box/line, run when singles are stuck
+};
+
+// naked singles (one candidate left) and hidden singles (digit with one place left in a house)
+// until nothing change, placements and eliminations go to the trail. false on contradiction
+bool sudoku_propagate_singles(SudokuState *state, u16 *sudoku_possible, SudokuTrail *trail)
 {
-    srand((u32)time(NULL));
-    
-    u8 sudoku[9 * 9] = {};
+    u8 *sudoku = state->sudoku;
+    u32 max_size = state->max_size;
     
-    const u32 max_size = max_col * max_row;
-    assert(max_size == 9 * 9);
-    assert(block_size == 3);
-    
-    u32 count = 0;
-    u32 backtrack_try_times = 0;
-    while(true) {
-        u32 i = 0;
-        do {
-            i = rand() % max_size;
-            assert(i < max_size); 
-        } while (sudoku[i] != 0); 
-        
-        int val = 0;
-        int try_times = 0;
-        do {
-            if (try_times > 100) { val = 0; break; }
-            val = rand() % max_row + 1;
-        }while (!valid(sudoku, val, i, max_row, max_col, block_size));
+    for (;;)
+    {
+        bool changed = false;
         
-        if (backtrack_try_times > 100) {
-            memset(sudoku, 0, max_size);
-            count = 0;
-            backtrack_try_times = 0;
+        for (u32 i = 0; i < max_size; ++i)
+        {
+            u16 m = sudoku_possible[i];
+            if (sudoku[i] || (m & (m - 1))) continue;
+            if (!m) return false;
             
-            printf("reset\n");
+            u8 val = (u8)lowest_bit_index(m);
+            if (!sudoku_state_valid(state, val, i)) return false;
             
-            continue;
+            sudoku_trail_place(trail, state, i, val);
+            SUDOKU_STAT_ADD(propagations, 1);
+            if (!sudoku_reduce_possible_trail(state, sudoku_possible, trail, i, val))
+                return false;
+            changed = true;
         }
         
-        if (val > 0) {
-            assert(valid(sudoku, val, i, max_row, max_col, block_size));
-            
-            u8 sudoku_temp[9 * 9]  = {};
-            memcpy(sudoku_temp, sudoku, max_size);
-            sudoku_temp[i] = val;
+        for (u32 h = 0; h < state->num_houses; ++h)
+        {
+            u16 unique = 0;
+            if (!sudoku_house_unique(state, sudoku_possible, h, &unique))
+                return false;
+            if (!unique) continue;
             
-            u32 bcount = 0;
-            if (sudoku_backtrack(sudoku_temp, 0, max_row, max_col, block_size, &bcount)) {
-                sudoku[i] = val;
-                ++count;
-                if (count >= level * max_size / 100) {
-                    
-                    u8 sudoku_temp1[9 * 9];
-                    memcpy(sudoku_temp1, sudoku, max_size);
-                    bcount = 0;
-                    sudoku_backtrack_r(sudoku_temp1, 0, max_row, max_col, block_size, &bcount);
-                    int ret = memcmp(sudoku_temp, sudoku_temp1, max_size);
-                    if (ret == 0)
-                    {
-                        u8 sudoku_temp2[9 * 9];
-                        memcpy(sudoku_temp2, sudoku, max_size);
-                        sudoku_backtrack_min(sudoku_temp2, max_row, max_col, block_size);
-                        assert(memcmp(sudoku_temp2, sudoku_temp, max_size) == 0);
-                        break; // found it
-                    }
-                }
-            }
-            else {
-                if (bcount > 387420489) {
-                    printf("count: %d\n", bcount);
-                    sudoku[i] = val;
-                    char fname[256] = {};
-                    sprintf(fname, "su_deadlock_%d_%d.txt", i, val);
-                    write_sudoku_file(fname, sudoku, max_size, max_row);
-                    sudoku[i] = 0;
-                }
+            u8 *house = state->houses[h];
+            for (u32 k = 0; k < state->max_col; ++k)
+            {
+                u32 index = house[k];
+                u16 hidden = sudoku_possible[index] & unique;
+                if (!hidden) continue;
+                if (hidden & (hidden - 1)) return false; // two digits need this cell
                 
-                ++backtrack_try_times;
+                if (sudoku_possible[index] != hidden) {
+                    sudoku_trail_remove(trail, sudoku_possible, index, sudoku_possible[index] & ~hidden);
+                    changed = true;
+                }
             }
-        } 
-        else 
-        {
-            ++backtrack_try_times;
         }
         
+        if (!changed)
+            return true;
+    }
+}
+
+// naked and hidden pairs/triples of house h, subsets come from sudoku_subset_table
+// naked: k cells holding only k digits, those digits leave the rest of the house
+// hidden: k digits that only fit in k cells, every other digit leave those cells
+// false on contradiction (k cells with less than k digits or k digits with less than k cells)
+bool sudoku_house_subsets(SudokuState *state, u16 *sudoku_possible, SudokuTrail *trail, u32 h, bool *changed)
+{
+    u8 *house = state->houses[h];
+    u32 limit = 1 << state->max_col;
+    
+    u16 m[SUDOKU_MAX_SIDE];
+    u16 where[SUDOKU_MAX_SIDE + 1];
+    u32 open = sudoku_house_positions(state, sudoku_possible, h, m, where);
+    
+    // digit d at bit d - 1 so digit sets index the same table as cell sets
+    u32 digits = 0;
+    for (u32 d = 1; d <= state->max_row; ++d)
+    {
+        if (where[d])
+            digits |= 1 << (d - 1);
+    }
+    
+    u32 open_count = count_set_bits((u16)open);
+    u32 digit_count = count_set_bits((u16)digits);
+    
+    u16 *masks = sudoku_subset_table.masks;
+    for (u32 t = 0; t < sudoku_subset_table.count && masks[t] < limit; ++t)
+    {
+        u32 subset = masks[t];
+        u32 size = count_set_bits((u16)subset);
+        
+        if ((subset & open) == subset && size < open_count)
+        {
+            u16 naked = 0;
+            for (u32 bits = subset; bits; bits &= bits - 1)
+                naked |= m[lowest_bit_index(bits)];
+            
+            u32 naked_count = count_set_bits(naked);
+            if (naked_count < size) return false;
+            if (naked_count == size)
+            {
+                for (u32 bits = open & ~subset; bits; bits &= bits - 1)
+                {
+                    u32 k = lowest_bit_index(bits);
+                    if (!(m[k] & naked)) continue;
+                    
+                    sudoku_trail_remove(trail, sudoku_possible, house[k], m[k] & naked);
+                    m[k] &= ~naked;
+                    if (!m[k]) return false;
+                    *changed = true;
+                }
+            }
+        }
+        
+        // where is not updated by the naked eliminations above, it can only be too wide
+        // so a hidden subset found with it still hold
+        if ((subset & digits) == subset && size < digit_count)
+        {
+            u32 cells = 0;
+            for (u32 bits = subset; bits; bits &= bits - 1)
+                cells |= where[lowest_bit_index(bits) + 1];
+            
+            u32 cell_count = count_set_bits((u16)cells);
+            if (cell_count < size) return false;
+            if (cell_count == size)
+            {
+                u16 keep = (u16)(subset << 1);
+                for (u32 bits = cells; bits; bits &= bits - 1)
+                {
+                    u32 k = lowest_bit_index(bits);
+                    if (!(m[k] & ~keep)) continue;
+                    
+                    sudoku_trail_remove(trail, sudoku_possible, house[k], m[k] & ~keep);
+                    m[k] &= keep;
+                    if (!m[k]) return false;
+                    *changed = true;
+                }
+            }
+        }
+    }
+    
+    return true;
+}
+
+// intersections of line h (a row or a col) with every block it cross
+// pointing: digit of a block that only sit on this line leave the rest of the line
+// box/line reduction: digit of the line that only sit in this block leave the rest of the block
+// false when a cell lose its last candidate
+bool sudoku_line_intersections(SudokuState *state, u16 *sudoku_possible, SudokuTrail *trail, u32 h, bool *changed)
+{
+    u32 n = state->max_row;
+    u32 block_size = state->block_size;
+    bool is_row = h < n;
+    u32 line_index = is_row ? h : h - n;
+    u8 *line_of_cell = is_row ? state->cell_row : state->cell_col;
+    u8 *line = state->houses[h];
+    
+    // candidates of the line segment inside every block it cross
+    u16 segment[SUDOKU_MAX_SIDE];
+    for (u32 k = 0; k < n; k += block_size)
+    {
+        u16 bits = 0;
+        for (u32 j = k; j < k + block_size; ++j)
+            bits |= sudoku_possible[line[j]];
+        segment[k / block_size] = bits;
+    }
+    
+    for (u32 k = 0; k < n; k += block_size)
+    {
+        u16 seg = segment[k / block_size];
+        if (!seg) continue;
+        
+        u16 line_rest = 0;
+        for (u32 j = 0; j < n; j += block_size)
+        {
+            if (j != k)
+                line_rest |= segment[j / block_size];
+        }
+        
+        u32 b = state->cell_box[line[k]];
+        u8 *box = state->houses[2 * n + b];
+        u16 box_rest = 0;
+        for (u32 j = 0; j < n; ++j)
+        {
+            if (line_of_cell[box[j]] != line_index)
+                box_rest |= sudoku_possible[box[j]];
+        }
+        
+        u16 pointing = seg & ~box_rest & line_rest;
+        u16 claiming = seg & ~line_rest & box_rest;
+        
+        for (u32 j = 0; pointing && j < n; ++j)
+        {
+            u32 index = line[j];
+            if (state->cell_box[index] == b || !(sudoku_possible[index] & pointing)) continue;
+            
+            sudoku_trail_remove(trail, sudoku_possible, index, sudoku_possible[index] & pointing);
+            if (!sudoku_possible[index]) return false;
+            *changed = true;
+        }
+        
+        for (u32 j = 0; claiming && j < n; ++j)
+        {
+            u32 index = box[j];
+            if (line_of_cell[index] == line_index || !(sudoku_possible[index] & claiming)) continue;
+            
+            sudoku_trail_remove(trail, sudoku_possible, index, sudoku_possible[index] & claiming);
+            if (!sudoku_possible[index]) return false;
+            *changed = true;
+        }
+    }
+    
+    return true;
+}
+
+// one pass of subsets and intersections over every house, false on contradiction
+bool sudoku_propagate_subsets(SudokuState *state, u16 *sudoku_possible, SudokuTrail *trail, bool *changed)
+{
+    assert(sudoku_subset_table.ready);
+    
+    for (u32 h = 0; h < state->num_houses; ++h)
+    {
+        if (!sudoku_house_subsets(state, sudoku_possible, trail, h, changed))
+            return false;
+    }
+    
+    for (u32 h = 0; h < 2 * state->max_row; ++h)
+    {
+        if (!sudoku_line_intersections(state, sudoku_possible, trail, h, changed))
+            return false;
+    }
+    
+    return true;
+}
+
+// run the tiers picked by propagate until nothing change, cheap tier first
+bool sudoku_propagate(SudokuState *state, u16 *sudoku_possible, SudokuTrail *trail, u32 propagate)
+{
+    for (;;)
+    {
+        if ((propagate & SUDOKU_PROPAGATE_SINGLES) && !sudoku_propagate_singles(state, sudoku_possible, trail))
+            return false;
+        
+        if (!(propagate & SUDOKU_PROPAGATE_SUBSETS))
+            return true;
+        
+        bool changed = false;
+        if (!sudoku_propagate_subsets(state, sudoku_possible, trail, &changed))
+            return false;
+        if (!changed)
+            return true;
+    }
+}
+
+bool sudoku_state_backtrack_heuristic_trail(SudokuState *state, u16 *sudoku_possible, SudokuTrail *trail, u32 *num_guess, debug_callback db_callback, void *debug_context, u32 propagate = SUDOKU_PROPAGATE_NONE, SudokuBudget *budget = 0)
+{
+    if (sudoku_budget_spend(budget))
+        return false;
+    
+    u8 *sudoku = state->sudoku;
+    u32 max_size = state->max_size;
+    
+    u32 i = find_possible_min_from_table(sudoku, sudoku_possible, max_size);
+    if (i < max_size)
+    {
+        u16 possible_data = sudoku_possible[i];
+        for (u8 val = 1; val <= state->max_row; ++val)
+        {
+            u16 possible = (1 << val) & possible_data;
+            if (possible && sudoku_state_valid(state, val, i))
+            {
+                if (num_guess) ++*num_guess;
+                sudoku_state_place(state, i, val);
+                SUDOKU_STAT_GUESS();
+                
+                u32 mark = trail->count;
+                bool valid_pick = sudoku_reduce_possible_trail(state, sudoku_possible, trail, i, val);
+                if (valid_pick && propagate)
+                    valid_pick = sudoku_propagate(state, sudoku_possible, trail, propagate);
+                
+                if (db_callback) {
+                    db_callback(debug_context, sudoku, sudoku_possible, i, val);
+                }
+                if (valid_pick && sudoku_state_backtrack_heuristic_trail(state, sudoku_possible, trail, num_guess, db_callback, debug_context, propagate, budget))
+                {
+                    return true;
+                }
+                
+                sudoku_trail_undo(trail, state, sudoku_possible, mark);
+                sudoku_state_unplace(state, i);
+                SUDOKU_STAT_BACKTRACK();
+                if (sudoku_budget_gave_up(budget)) return false;
+            }
+        }
+        
+        return false;
+    }
+    
+    return true;
+}
+
+// propagate the givens then search, board is left solved on success and untouched on failure
+bool sudoku_state_solve_trail(SudokuState *state, u16 *sudoku_possible, SudokuTrail *trail, u32 *num_guess, debug_callback db_callback, void *debug_context, u32 propagate, SudokuBudget *budget = 0)
+{
+    if (propagate && !sudoku_propagate(state, sudoku_possible, trail, propagate))
+    {
+        sudoku_trail_undo(trail, state, sudoku_possible, 0);
+        return false;
+    }
+    
+    bool ret = sudoku_state_backtrack_heuristic_trail(state, sudoku_possible, trail, num_guess, db_callback, debug_context, propagate, budget);
+    if (!ret)
+        sudoku_trail_undo(trail, state, sudoku_possible, 0);
+    
+    return ret;
+}
+
+// no heap allocation, sudoku_possible is left as it was passed in like sudoku_backtrack_heuristic
+bool sudoku_backtrack_heuristic_trail(u8 *sudoku, u16 *sudoku_possible, u8 max_row, u8 max_col, u8 block_size, u32 *num_guess, debug_callback db_callback = 0, void *debug_context = 0, u32 propagate = SUDOKU_PROPAGATE_NONE, SudokuBudget *budget = 0)
+{
+    if (propagate & SUDOKU_PROPAGATE_SUBSETS)
+        sudoku_subset_table_init();
+    
+    SudokuState state;
+    sudoku_state_init(&state, sudoku, max_row, max_col, block_size);
+    
+    SudokuTrail trail;
+    trail.count = 0;
+    bool ret = sudoku_state_solve_trail(&state, sudoku_possible, &trail, num_guess, db_callback, debug_context, propagate, budget);
+    
+    // only give back the candidate table, keep the solved board
+    u8 solution[SUDOKU_MAX_CELLS];
+    memcpy(solution, sudoku, state.max_size);
+    sudoku_trail_undo(&trail, &state, sudoku_possible, 0);
+    memcpy(sudoku, solution, state.max_size);
+    
+    return ret;
+}
+
+// solve with a caller owned trail, for loops that solve many puzzles in a row
+bool sudoku_solve_with_trail(u8 *sudoku, u8 max_row, u8 max_col, u8 block_size, SudokuTrail *trail, u32 *num_guess, u32 propagate = SUDOKU_PROPAGATE_NONE, SudokuBudget *budget = 0)
+{
+    u16 sudoku_possible[SUDOKU_MAX_CELLS * 3] = {0};
+    SUDOKU_STAT_TIMER_BEGIN(time_fill_start);
+    
+    SudokuState state;
+    if (!sudoku_state_init(&state, sudoku, max_row, max_col, block_size))
+        return false;
+    
+    for (u32 i = 0; i < state.max_size; ++i)
+    {
+        if (sudoku[i] == 0)
+            sudoku_possible[i] = sudoku_state_candidates(&state, i);
+    }
+    SUDOKU_STAT_TIMER_END(time_fill_start, time_fill);
+    
+    trail->count = 0;
+    return sudoku_state_solve_trail(&state, sudoku_possible, trail, num_guess, 0, 0, propagate, budget);
+}
+
+// exact cover engine (knuth's dancing links / algorithm x)
+//
+// one column per constraint: every cell filled, every digit once per row, col
+// and block (4 * n * n), one matrix row per (cell, digit) placement (n * n * n).
+// the matrix is built once from the givens: columns already satisfied are left
+// out and only candidate placements of empty cells become rows, then the
+// search cover the column with fewest rows left and try each of its rows
+#define DLX_MAX_COLUMNS (4 * SUDOKU_MAX_CELLS)
+#define DLX_MAX_NODES (1 + DLX_MAX_COLUMNS + 4 * SUDOKU_MAX_CELLS * SUDOKU_MAX_SIDE)
+
+// called for every solution found while counting, solution_index start at 0
+typedef void (*solution_callback)(void *context, u8 *sudoku, u32 solution_index);
+
+struct SudokuDlx {
+    u8 *sudoku;
+    u32 max_size;
+    u32 node_count;
+    
+    // node 0 is the root, nodes 1..num_columns are the column headers, matrix rows come after
+    u16 left[DLX_MAX_NODES];
+    u16 right[DLX_MAX_NODES];
+    u16 up[DLX_MAX_NODES];
+    u16 down[DLX_MAX_NODES];
+    u16 column[DLX_MAX_NODES];
+    u8 cell[DLX_MAX_NODES];  // placement of the matrix row this node belong to
+    u8 digit[DLX_MAX_NODES];
+    u16 size[DLX_MAX_COLUMNS + 1];
+    
+    u8 *first_solution;
+    solution_callback on_solution;
+    void *solution_context;
+    debug_callback db_callback;
+    void *debug_context;
+    u16 *sudoku_possible;
+    SudokuBudget *budget;
+};
+
+// build the matrix for the board, false when the givens already conflict
+bool sudoku_dlx_init(SudokuDlx *dlx, u8 *sudoku, u8 max_row, u8 max_col, u8 block_size)
+{
+    SUDOKU_STAT_TIMER_BEGIN(time_fill_start);
+    SudokuState state;
+    if (!sudoku_state_init(&state, sudoku, max_row, max_col, block_size))
+        return false;
+    
+    u32 n = max_row;
+    u32 cells = state.max_size;
+    u32 num_columns = 4 * cells;
+    
+    dlx->sudoku = sudoku;
+    dlx->max_size = cells;
+    dlx->first_solution = 0;
+    dlx->on_solution = 0;
+    dlx->solution_context = 0;
+    dlx->db_callback = 0;
+    dlx->debug_context = 0;
+    dlx->sudoku_possible = 0;
+    dlx->budget = 0;
+    
+    dlx->left[0] = 0;
+    dlx->right[0] = 0;
+    for (u32 c = 0; c < num_columns; ++c)
+    {
+        u32 h = c + 1;
+        dlx->up[h] = (u16)h;
+        dlx->down[h] = (u16)h;
+        dlx->column[h] = (u16)h;
+        dlx->size[h] = 0;
+        
+        // constraint kind: cell, row digit, col digit, block digit
+        u32 kind = c / cells;
+        u32 unit = c % cells / n;
+        u16 bit = 1 << (c % n + 1);
+        bool satisfied = false;
+        if (kind == 0) satisfied = sudoku[c] != 0;
+        else if (kind == 1) satisfied = (state.row_used[unit] & bit) != 0;
+        else if (kind == 2) satisfied = (state.col_used[unit] & bit) != 0;
+        else satisfied = (state.box_used[unit] & bit) != 0;
+        
+        if (!satisfied) {
+            dlx->left[h] = dlx->left[0];
+            dlx->right[h] = 0;
+            dlx->right[dlx->left[0]] = (u16)h;
+            dlx->left[0] = (u16)h;
+        }
+    }
+    
+    u32 node = num_columns + 1;
+    for (u32 i = 0; i < cells; ++i)
+    {
+        if (sudoku[i]) continue;
+        
+        for (u32 bits = sudoku_state_candidates(&state, i); bits; bits &= bits - 1)
+        {
+            u32 val = lowest_bit_index(bits);
+            u32 columns[4] = {
+                i,
+                cells + state.cell_row[i] * n + val - 1,
+                2 * cells + state.cell_col[i] * n + val - 1,
+                3 * cells + state.cell_box[i] * n + val - 1,
+            };
+            
+            u32 first = node;
+            for (u32 k = 0; k < 4; ++k, ++node)
+            {
+                u32 h = columns[k] + 1;
+                dlx->column[node] = (u16)h;
+                dlx->cell[node] = (u8)i;
+                dlx->digit[node] = (u8)val;
+                
+                dlx->up[node] = dlx->up[h];
+                dlx->down[node] = (u16)h;
+                dlx->down[dlx->up[h]] = (u16)node;
+                dlx->up[h] = (u16)node;
+                ++dlx->size[h];
+                
+                dlx->left[node] = (u16)(k ? node - 1 : first + 3);
+                dlx->right[node] = (u16)(k < 3 ? node + 1 : first);
+            }
+        }
+    }
+    dlx->node_count = node;
+    SUDOKU_STAT_TIMER_END(time_fill_start, time_fill);
+    
+    return true;
+}
+
+inline void sudoku_dlx_cover(SudokuDlx *dlx, u32 c)
+{
+    dlx->right[dlx->left[c]] = dlx->right[c];
+    dlx->left[dlx->right[c]] = dlx->left[c];
+    for (u32 i = dlx->down[c]; i != c; i = dlx->down[i])
+    {
+        for (u32 j = dlx->right[i]; j != i; j = dlx->right[j])
+        {
+            dlx->down[dlx->up[j]] = dlx->down[j];
+            dlx->up[dlx->down[j]] = dlx->up[j];
+            --dlx->size[dlx->column[j]];
+        }
+    }
+}
+
+inline void sudoku_dlx_uncover(SudokuDlx *dlx, u32 c)
+{
+    for (u32 i = dlx->up[c]; i != c; i = dlx->up[i])
+    {
+        for (u32 j = dlx->left[i]; j != i; j = dlx->left[j])
+        {
+            ++dlx->size[dlx->column[j]];
+            dlx->down[dlx->up[j]] = (u16)j;
+            dlx->up[dlx->down[j]] = (u16)j;
+        }
+    }
+    dlx->right[dlx->left[c]] = (u16)c;
+    dlx->left[dlx->right[c]] = (u16)c;
+}
+
+// every tried row is one guess, same as a tried digit in the heuristic search
+// return true once count reach limit, the board then hold the last solution found
+bool sudoku_dlx_search(SudokuDlx *dlx, u32 *num_guess, u32 *count, u32 limit)
+{
+    if (sudoku_budget_spend(dlx->budget))
+        return false;
+    
+    if (dlx->right[0] == 0)
+    {
+        ++*count;
+        if (*count == 1 && dlx->first_solution)
+            memcpy(dlx->first_solution, dlx->sudoku, dlx->max_size);
+        if (dlx->on_solution)
+            dlx->on_solution(dlx->solution_context, dlx->sudoku, *count - 1);
+        return *count >= limit;
+    }
+    
+    // column with fewest rows left, a dead column end the branch
+    u32 best = dlx->right[0];
+    for (u32 c = dlx->right[best]; c && dlx->size[best] > 1; c = dlx->right[c])
+    {
+        if (dlx->size[c] < dlx->size[best])
+            best = c;
+    }
+    if (!dlx->size[best])
+        return false;
+    
+    sudoku_dlx_cover(dlx, best);
+    for (u32 r = dlx->down[best]; r != best; r = dlx->down[r])
+    {
+        if (num_guess) ++*num_guess;
+        SUDOKU_STAT_GUESS();
+        dlx->sudoku[dlx->cell[r]] = dlx->digit[r];
+        for (u32 j = dlx->right[r]; j != r; j = dlx->right[j])
+            sudoku_dlx_cover(dlx, dlx->column[j]);
+        
+        if (dlx->db_callback) {
+            dlx->db_callback(dlx->debug_context, dlx->sudoku, dlx->sudoku_possible, dlx->cell[r], dlx->digit[r]);
+        }
+        bool done = sudoku_dlx_search(dlx, num_guess, count, limit);
+        
+        for (u32 j = dlx->left[r]; j != r; j = dlx->left[j])
+            sudoku_dlx_uncover(dlx, dlx->column[j]);
+        
+        if (done) {
+            sudoku_dlx_uncover(dlx, best);
+            return true;
+        }
+        dlx->sudoku[dlx->cell[r]] = 0;
+        SUDOKU_STAT_BACKTRACK();
+        if (sudoku_budget_gave_up(dlx->budget)) break;
+    }
+    sudoku_dlx_uncover(dlx, best);
+    
+    return false;
+}
+
+// solve a board already built by sudoku_dlx_init, untouched on failure
+bool sudoku_dlx_solve(SudokuDlx *dlx, u32 *num_guess)
+{
+    u32 count = 0;
+    return sudoku_dlx_search(dlx, num_guess, &count, 1);
+}
+
+// count solutions, stop at limit (0 = no limit). board is left as it was passed in,
+// first_solution (optional) get the first solution found
+u32 sudoku_dlx_count(SudokuDlx *dlx, u32 limit, u8 *first_solution = 0, u32 *num_guess = 0)
+{
+    u8 givens[SUDOKU_MAX_CELLS];
+    memcpy(givens, dlx->sudoku, dlx->max_size);
+    
+    u32 count = 0;
+    dlx->first_solution = first_solution;
+    sudoku_dlx_search(dlx, num_guess, &count, limit ? limit : 0xFFFFFFFF);
+    dlx->first_solution = 0;
+    
+    memcpy(dlx->sudoku, givens, dlx->max_size);
+    return count;
+}
+
+// drop the row that place val at index (index must be empty), so a search answer
+// "is there a solution without this placement"
+void sudoku_dlx_remove_placement(SudokuDlx *dlx, u32 index, u8 val)
+{
+    u32 c = index + 1; // cell constraint column
+    for (u32 r = dlx->down[c]; r != c; r = dlx->down[r])
+    {
+        if (dlx->digit[r] != val) continue;
+        
+        u32 j = r;
+        do {
+            dlx->down[dlx->up[j]] = dlx->down[j];
+            dlx->up[dlx->down[j]] = dlx->up[j];
+            --dlx->size[dlx->column[j]];
+            j = dlx->right[j];
+        } while (j != r);
+        return;
+    }
+}
+
+// count solutions up to limit (0 = all of them), limit 2 is the uniqueness check:
+// 0 no solution, 1 unique, 2 more than one. every solution found is streamed to on_solution
+// with a budget that run out the count is only a lower bound, check budget->gave_up
+u32 sudoku_count_solutions(u8 *sudoku, u8 max_row, u8 max_col, u8 block_size, u32 limit, u8 *first_solution = 0, solution_callback on_solution = 0, void *solution_context = 0, SudokuBudget *budget = 0)
+{
+    SudokuDlx *dlx = (SudokuDlx*)malloc(sizeof(SudokuDlx));
+    u32 count = 0;
+    if (sudoku_dlx_init(dlx, sudoku, max_row, max_col, block_size))
+    {
+        dlx->on_solution = on_solution;
+        dlx->solution_context = solution_context;
+        dlx->budget = budget;
+        count = sudoku_dlx_count(dlx, limit, first_solution);
+    }
+    free(dlx);
+    
+    return count;
+}
+
+// same interface as sudoku_backtrack_heuristic, sudoku_possible is only handed to the callback
+// the matrix is too big for the stack of worker threads, batch code keep one SudokuDlx per worker instead
+bool sudoku_backtrack_dlx(u8 *sudoku, u16 *sudoku_possible, u8 max_row, u8 max_col, u8 block_size, u32 *num_guess, debug_callback db_callback = 0, void *debug_context = 0, SudokuBudget *budget = 0)
+{
+    SudokuDlx *dlx = (SudokuDlx*)malloc(sizeof(SudokuDlx));
+    bool ret = sudoku_dlx_init(dlx, sudoku, max_row, max_col, block_size);
+    if (ret)
+    {
+        dlx->db_callback = db_callback;
+        dlx->debug_context = debug_context;
+        dlx->sudoku_possible = sudoku_possible;
+        dlx->budget = budget;
+        ret = sudoku_dlx_solve(dlx, num_guess);
+    }
+    free(dlx);
+    
+    return ret;
+}
+
+void test(char *fproblem, char *fsolution, bool print_result, int algorithm = 0)
+{
+    const u8 max_row = 9;
+    const u8 max_col = 9;
+    const u8 block_size = 3;
+    
+    const int max_size = max_row * max_col;
+    u16 sudoku_possible[max_size * 3] = {};
+    u8 sudoku[max_size] = {};
+    u8 sudoku_s[max_size] = {};
+    
+    assert(read_sudoku_file(fproblem, sudoku, max_row, max_col, max_size));
+    assert(read_sudoku_file(fsolution, sudoku_s, max_row, max_col, max_size));
+    
+    if (print_result)
+    {
+        sudoku_print(sudoku, max_size);
+        sudoku_print(sudoku_s, max_size);
+    }
+    
+    if (algorithm == 0)
+    {
+        sudoku_backtrack_min(sudoku, max_row, max_col, block_size);
+    }
+    else if (algorithm == 1)
+    {
+        sudoku_fill_possible(sudoku, sudoku_possible, max_row, max_col, block_size);
+        int index = find_free(sudoku, 0, max_size);
+        sudoku_backtrack_with_possible(sudoku,  sudoku_possible, index, max_row, max_col, block_size);
+    }
+    else if (algorithm == 2)
+    {
+        
+        u32 count = 0;
+        sudoku_backtrack(sudoku, 0, max_row, max_col, block_size, &count);
+    }
+    else if (algorithm == 3)
+    {
+        u32 num_guess = 0;
+        sudoku_fill_possible(sudoku, sudoku_possible, max_row, max_col, block_size);
+        sudoku_backtrack_heuristic(sudoku, sudoku_possible, max_row, max_col, block_size, &num_guess);
+    }
+    else if (algorithm == 4)
+    {
+        u32 num_guess = 0;
+        sudoku_fill_possible(sudoku, sudoku_possible, max_row, max_col, block_size);
+        sudoku_backtrack_heuristic_trail(sudoku, sudoku_possible, max_row, max_col, block_size, &num_guess);
+    }
+    else if (algorithm == 5)
+    {
+        u32 num_guess = 0;
+        sudoku_fill_possible(sudoku, sudoku_possible, max_row, max_col, block_size);
+        sudoku_backtrack_heuristic_trail(sudoku, sudoku_possible, max_row, max_col, block_size, &num_guess, 0, 0, SUDOKU_PROPAGATE_SINGLES);
+    }
+    else if (algorithm == 6)
+    {
+        u32 num_guess = 0;
+        sudoku_fill_possible(sudoku, sudoku_possible, max_row, max_col, block_size);
+        sudoku_backtrack_heuristic_trail(sudoku, sudoku_possible, max_row, max_col, block_size, &num_guess, 0, 0, SUDOKU_PROPAGATE_SINGLES | SUDOKU_PROPAGATE_SUBSETS);
+    }
+    else if (algorithm == 7)
+    {
+        u32 num_guess = 0;
+        sudoku_fill_possible(sudoku, sudoku_possible, max_row, max_col, block_size);
+        sudoku_backtrack_dlx(sudoku, sudoku_possible, max_row, max_col, block_size, &num_guess);
+    }
+    
+    if (print_result)
+    {
+        sudoku_print(sudoku, max_size);
+    }
+    int ret = memcmp(sudoku, sudoku_s, max_size);
+    assert(ret == 0);
+    
+}
+
+// xorshift64* seeded through splitmix64, one per thread (or per puzzle) so generation
+// is reproducible from a seed no matter how many threads run
+struct SudokuRng {
+    u64 state;
+};
+
+inline void sudoku_rng_seed(SudokuRng *rng, u64 seed)
+{
+    u64 z = seed + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    rng->state = (z ^ (z >> 31)) | 1; // never 0
+}
+
+inline u32 sudoku_rng_next(SudokuRng *rng)
+{
+    u64 x = rng->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+    return (u32)((x * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+// uniform in [0, n)
+inline u32 sudoku_rng_range(SudokuRng *rng, u32 n)
+{
+    return (u32)(((u64)sudoku_rng_next(rng) * n) >> 32);
+}
+
+void sudoku_rng_shuffle(SudokuRng *rng, u8 *values, u32 count)
+{
+    for (u32 i = count - 1; i > 0; --i)
+    {
+        u32 j = sudoku_rng_range(rng, i + 1);
+        u8 temp = values[i];
+        values[i] = values[j];
+        values[j] = temp;
+    }
+}
+
+// random complete grid: blocks on the diagonal don't see each other so they get
+// independent random permutations, the solver fill the rest
+bool sudoku_random_grid(u8 *sudoku, u8 max_row, u8 max_col, u8 block_size, SudokuRng *rng, SudokuTrail *trail)
+{
+    u32 max_size = max_row * max_col;
+    memset(sudoku, 0, max_size);
+    
+    u8 digits[SUDOKU_MAX_SIDE];
+    for (u32 b = 0; b < max_row / block_size; ++b)
+    {
+        for (u32 k = 0; k < max_row; ++k)
+            digits[k] = (u8)(k + 1);
+        sudoku_rng_shuffle(rng, digits, max_row);
+        
+        u32 start_block_index = b * block_size * max_col + b * block_size;
+        for (u32 k = 0; k < max_row; ++k)
+            sudoku[start_block_index + k / block_size * max_col + k % block_size] = digits[k];
+    }
+    
+    u32 num_guess = 0;
+    return sudoku_solve_with_trail(sudoku, max_row, max_col, block_size, trail, &num_guess, SUDOKU_PROPAGATE_SINGLES);
+}
+
+// take clues out of a full grid in random order while the solution stay unique, stop at target_clues.
+// removing the clue val at i keep the puzzle unique exactly when no solution has something else
+// at i, so each step is one search with that placement dropped instead of a full count
+// return the number of clues left
+u32 sudoku_remove_clues(u8 *sudoku, u8 max_row, u8 max_col, u8 block_size, u32 target_clues, SudokuRng *rng, SudokuDlx *dlx)
+{
+    u32 max_size = max_row * max_col;
+    u8 order[SUDOKU_MAX_CELLS];
+    for (u32 i = 0; i < max_size; ++i)
+        order[i] = (u8)i;
+    sudoku_rng_shuffle(rng, order, max_size);
+    
+    u32 clues = 0;
+    for (u32 i = 0; i < max_size; ++i)
+    {
+        if (sudoku[i]) ++clues;
+    }
+    
+    for (u32 k = 0; k < max_size && clues > target_clues; ++k)
+    {
+        u32 i = order[k];
+        u8 val = sudoku[i];
+        if (!val) continue;
+        
+        sudoku[i] = 0;
+        sudoku_dlx_init(dlx, sudoku, max_row, max_col, block_size);
+        sudoku_dlx_remove_placement(dlx, i, val);
+        if (sudoku_dlx_count(dlx, 1))
+            sudoku[i] = val; // another solution show up, the clue has to stay
+        else
+            --clues;
+    }
+    
+    return clues;
+}
+
+// one puzzle with a unique solution and target_clues clues. some grids can't get down to
+// the target, then a new grid is tried up to max_attempts times and the one with fewest
+// clues is kept. return the clue count of the puzzle
+u32 sudoku_generate(u8 *sudoku, u8 max_row, u8 max_col, u8 block_size, u32 target_clues, SudokuRng *rng, SudokuDlx *dlx, SudokuTrail *trail, u32 max_attempts = 64)
+{
+    u32 max_size = max_row * max_col;
+    u32 best_clues = max_size + 1;
+    u8 grid[SUDOKU_MAX_CELLS];
+    
+    for (u32 attempt = 0; attempt < max_attempts && best_clues > target_clues; ++attempt)
+    {
+        if (!sudoku_random_grid(grid, max_row, max_col, block_size, rng, trail))
+            continue;
+        
+        u32 clues = sudoku_remove_clues(grid, max_row, max_col, block_size, target_clues, rng, dlx);
+        if (clues < best_clues) {
+            best_clues = clues;
+            memcpy(sudoku, grid, max_size);
+        }
+    }
+    
+    return best_clues;
+}
+
+// level is the percent of cells left as clues
+void generate_sudoku(u32 level, u32 max_row, u32 max_col, u32 block_size, u64 seed = 0) 
+{
+    const u32 max_size = max_col * max_row;
+    
+    SudokuRng rng;
+    sudoku_rng_seed(&rng, seed ? seed : (u64)time(NULL));
+    
+    SudokuDlx *dlx = (SudokuDlx*)malloc(sizeof(SudokuDlx));
+    SudokuTrail *trail = (SudokuTrail*)malloc(sizeof(SudokuTrail));
+    
+    u8 sudoku[SUDOKU_MAX_CELLS] = {};
+    sudoku_generate(sudoku, (u8)max_row, (u8)max_col, (u8)block_size, level * max_size / 100, &rng, dlx, trail);
+    
+    free(trail);
+    free(dlx);
+    sudoku_print(sudoku, max_size);
+}
+
+#define SUDOKU_TEST_ALGORITHMS 8 // the algorithm values of test()
+
+void run_tests(bool print_result)
+{
+    for (int algorithm = 0; algorithm < SUDOKU_TEST_ALGORITHMS; ++algorithm)
+    {
+        test("sudokus/s01a.txt", "solutions/s01a_s.txt", print_result, algorithm);
+        test("sudokus/s01b.txt", "solutions/s01b_s.txt", print_result, algorithm);
+        test("sudokus/s01c.txt", "solutions/s01c_s.txt", print_result, algorithm);
+        test("sudokus/s02a.txt", "solutions/s02a_s.txt", print_result, algorithm);
+        test("sudokus/s02b.txt", "solutions/s02b_s.txt", print_result, algorithm);
+        test("sudokus/s02c.txt", "solutions/s02c_s.txt", print_result, algorithm);
+        test("sudokus/s03a.txt", "solutions/s03a_s.txt", print_result, algorithm);
+        test("sudokus/s03b.txt", "solutions/s03b_s.txt", print_result, algorithm);
+        test("sudokus/s03c.txt", "solutions/s03c_s.txt", print_result, algorithm);
+        test("sudokus/s04a.txt", "solutions/s04a_s.txt", print_result, algorithm);
+        test("sudokus/s04b.txt", "solutions/s04b_s.txt", print_result, algorithm);
+        test("sudokus/s04c.txt", "solutions/s04c_s.txt", print_result, algorithm);
+        test("sudokus/s05a.txt", "solutions/s05a_s.txt", print_result, algorithm);
+        test("sudokus/s05b.txt", "solutions/s05b_s.txt", print_result, algorithm);
+        test("sudokus/s05c.txt", "solutions/s05c_s.txt", print_result, algorithm);
+        test("sudokus/s06a.txt", "solutions/s06a_s.txt", print_result, algorithm);
+        test("sudokus/s06b.txt", "solutions/s06b_s.txt", print_result, algorithm);
+        test("sudokus/s06c.txt", "solutions/s06c_s.txt", print_result, algorithm);
+        test("sudokus/s07a.txt", "solutions/s07a_s.txt", print_result, algorithm);
+        test("sudokus/s07b.txt", "solutions/s07b_s.txt", print_result, algorithm);
+        test("sudokus/s07c.txt", "solutions/s07c_s.txt", print_result, algorithm);
+        test("sudokus/s08a.txt", "solutions/s08a_s.txt", print_result, algorithm);
+        test("sudokus/s08b.txt", "solutions/s08b_s.txt", print_result, algorithm);
+        test("sudokus/s08c.txt", "solutions/s08c_s.txt", print_result, algorithm);
+        test("sudokus/s09a.txt", "solutions/s09a_s.txt", print_result, algorithm);
+        test("sudokus/s09b.txt", "solutions/s09b_s.txt", print_result, algorithm);
+        test("sudokus/s09c.txt", "solutions/s09c_s.txt", print_result, algorithm);
+        test("sudokus/s10a.txt", "solutions/s10a_s.txt", print_result, algorithm);
+        test("sudokus/s10b.txt", "solutions/s10b_s.txt", print_result, algorithm);
+        test("sudokus/s10c.txt", "solutions/s10c_s.txt", print_result, algorithm);
+        test("sudokus/s11a.txt", "solutions/s11a_s.txt", print_result, algorithm);
+        test("sudokus/s11b.txt", "solutions/s11b_s.txt", print_result, algorithm);
+        test("sudokus/s11c.txt", "solutions/s11c_s.txt", print_result, algorithm);
+        test("sudokus/s12a.txt", "solutions/s12a_s.txt", print_result, algorithm);
+        test("sudokus/s12b.txt", "solutions/s12b_s.txt", print_result, algorithm);
+        test("sudokus/s12c.txt", "solutions/s12c_s.txt", print_result, algorithm);
+        test("sudokus/s13a.txt", "solutions/s13a_s.txt", print_result, algorithm);
+        test("sudokus/s13b.txt", "solutions/s13b_s.txt", print_result, algorithm);
+        test("sudokus/s13c.txt", "solutions/s13c_s.txt", print_result, algorithm);
+        test("sudokus/s14a.txt", "solutions/s14a_s.txt", print_result, algorithm);
+        test("sudokus/s14b.txt", "solutions/s14b_s.txt", print_result, algorithm);
+        test("sudokus/s14c.txt", "solutions/s14c_s.txt", print_result, algorithm);
+        test("sudokus/s15a.txt", "solutions/s15a_s.txt", print_result, algorithm);
+        test("sudokus/s15b.txt", "solutions/s15b_s.txt", print_result, algorithm);
+        test("sudokus/s15c.txt", "solutions/s15c_s.txt", print_result, algorithm);
+        test("sudokus/s16.txt", "solutions/s16_s.txt", print_result, algorithm);
+    }
+}
+
+#define SUDOKU_TEST_FILES (15 * 3 + 1) // s01a .. s15c then s16
+
+// puzzle k of the run_tests set and its solution, 9x9 (run from the sudoku directory)
+bool sudoku_load_test(u32 k, u8 *sudoku, u8 *solution)
+{
+    assert(k < SUDOKU_TEST_FILES);
+    char fproblem[64];
+    char fsolution[64];
+    if (k < 15 * 3) {
+        sprintf(fproblem, "sudokus/s%02d%c.txt", k / 3 + 1, 'a' + k % 3);
+        sprintf(fsolution, "solutions/s%02d%c_s.txt", k / 3 + 1, 'a' + k % 3);
+    }
+    else {
+        sprintf(fproblem, "sudokus/s16.txt");
+        sprintf(fsolution, "solutions/s16_s.txt");
+    }
+    
+    return read_sudoku_file(fproblem, sudoku, 9, 9, 81) && read_sudoku_file(fsolution, solution, 9, 9, 81);
+}
+
+// reference count for run_count_tests, plain backtracking over every empty cell
+u32 sudoku_count_brute(u8 *sudoku, u32 index)
+{
+    while (index < 81 && sudoku[index]) ++index;
+    if (index == 81) return 1;
+    
+    u32 count = 0;
+    for (u8 val = 1; val <= 9; ++val)
+    {
+        if (!valid(sudoku, val, index, 9, 9, 3)) continue;
+        sudoku[index] = val;
+        count += sudoku_count_brute(sudoku, index + 1);
+        sudoku[index] = 0;
+    }
+    
+    return count;
+}
+
+struct SudokuCountTest {
+    u8 *givens;
+    u8 solutions[64][81];
+    u32 count;
+};
+
+// every streamed solution keep the givens, fill the grid and differ from the ones before
+void sudoku_count_test_solution(void *context, u8 *sudoku, u32 solution_index)
+{
+    SudokuCountTest *test = (SudokuCountTest*)context;
+    assert(solution_index == test->count && solution_index < 64);
+    
+    u8 grid[96] = {};
+    memcpy(grid, sudoku, 81);
+    for (u32 i = 0; i < 81; ++i)
+    {
+        assert(!test->givens[i] || grid[i] == test->givens[i]);
+        u8 val = grid[i];
+        grid[i] = 0;
+        assert(val && valid(grid, val, i, 9, 9, 3));
+        grid[i] = val;
+    }
+    
+    for (u32 k = 0; k < solution_index; ++k)
+        assert(memcmp(test->solutions[k], sudoku, 81) != 0);
+    memcpy(test->solutions[test->count++], sudoku, 81);
+}
+
+// unique puzzles count 1, a grid with whole digits blanked against the brute force count,
+// limit cut the count and a spent budget mark the count gave_up
+void run_count_tests(bool print_result)
+{
+    u8 sudoku[96] = {};
+    u8 solution[96] = {};
+    u8 first[81];
+    for (u32 k = 0; k < SUDOKU_TEST_FILES; ++k)
+    {
+        bool read = sudoku_load_test(k, sudoku, solution);
+        assert(read);
         
+        assert(sudoku_count_solutions(sudoku, 9, 9, 3, 2, first) == 1);
+        assert(memcmp(first, solution, 81) == 0);
     }
     
-    sudoku_print(sudoku, max_size);
+    // the solution of the last puzzle without its 1, 2 and 3, more than one way to put them back
+    static SudokuCountTest test;
+    for (u32 i = 0; i < 81; ++i)
+        sudoku[i] = solution[i] > 3 ? solution[i] : 0;
+    test.givens = sudoku;
+    test.count = 0;
+    
+    u32 expected = sudoku_count_brute(sudoku, 0);
+    assert(expected > 1 && expected <= 64);
+    assert(sudoku_count_solutions(sudoku, 9, 9, 3, 0, first, sudoku_count_test_solution, &test) == expected);
+    assert(test.count == expected);
+    assert(memcmp(first, test.solutions[0], 81) == 0);
+    assert(sudoku_count_solutions(sudoku, 9, 9, 3, 2) == 2);
+    
+    // an empty grid stop at the limit, or when the budget run out before it
+    u8 empty[96] = {};
+    assert(sudoku_count_solutions(empty, 9, 9, 3, 10) == 10);
+    
+    SudokuBudget budget;
+    sudoku_budget_init(&budget, 20, 0);
+    u32 count = sudoku_count_solutions(empty, 9, 9, 3, 1000, 0, 0, 0, &budget);
+    assert(budget.gave_up && count < 1000);
+    
+    // two 1 in the first row
+    empty[0] = empty[1] = 1;
+    assert(sudoku_count_solutions(empty, 9, 9, 3, 2) == 0);
+    
+    if (print_result) printf("count: %u solutions without 1, 2, 3\n", expected);
 }
 
-void run_tests(bool print_result)
+
+// binary corpus, a header then fixed size records (9x9 only)
+//
+// givens only: the 81 cells 4 bits each, 41 bytes instead of an 82 byte line.
+// with solutions the givens are a bit per cell (set = given, value from the
+// solution) and the solution is 4 bits per cell, 52 bytes instead of 164.
+// stats (guesses, solve time) add 8 bytes. numbers are little endian.
+// data_reader_open detect the magic so every data file reader take both formats
+#define CORPUS_MAGIC 0x434B4453 // "SDKC"
+#define CORPUS_VERSION 1
+#define CORPUS_HAS_SOLUTION 0x1
+#define CORPUS_HAS_STATS 0x2
+
+#define CORPUS_CELLS (9 * 9)
+#define CORPUS_NIBBLE_SIZE ((CORPUS_CELLS + 1) / 2)
+#define CORPUS_MASK_SIZE ((CORPUS_CELLS + 7) / 8)
+#define CORPUS_STATS_SIZE 8
+#define CORPUS_MAX_RECORD_SIZE (CORPUS_MASK_SIZE + CORPUS_NIBBLE_SIZE + CORPUS_STATS_SIZE)
+
+struct CorpusHeader {
+    u32 magic;
+    u16 version;
+    u16 flags;
+    u8 max_row;
+    u8 block_size;
+    u16 record_size;
+    u32 reserved;
+    u64 count;  // written when the file is closed
+    u64 reserved2;
+};
+
+struct CorpusStats {
+    u32 num_guess;
+    u32 time_us;
+};
+
+inline u32 corpus_record_size(u32 flags)
+{
+    u32 size = CORPUS_NIBBLE_SIZE;
+    if (flags & CORPUS_HAS_SOLUTION) size += CORPUS_MASK_SIZE;
+    if (flags & CORPUS_HAS_STATS) size += CORPUS_STATS_SIZE;
+    return size;
+}
+
+// two cells per byte, low nibble first. 16 cells at a time: every 16 bit lane hold two
+// cells, fold the high one next to the low one then packus narrow the lanes back to bytes
+void corpus_pack_cells(u8 *cells, u8 *packed)
 {
-    test("sudokus/s01a.txt", "solutions/s01a_s.txt", print_result);
-    test("sudokus/s01b.txt", "solutions/s01b_s.txt", print_result);
-    test("sudokus/s01c.txt", "solutions/s01c_s.txt", print_result);
-    test("sudokus/s02a.txt", "solutions/s02a_s.txt", print_result);
-    test("sudokus/s02b.txt", "solutions/s02b_s.txt", print_result);
-    test("sudokus/s02c.txt", "solutions/s02c_s.txt", print_result);
-    test("sudokus/s03a.txt", "solutions/s03a_s.txt", print_result);
-    test("sudokus/s03b.txt", "solutions/s03b_s.txt", print_result);
-    test("sudokus/s03c.txt", "solutions/s03c_s.txt", print_result);
-    test("sudokus/s04a.txt", "solutions/s04a_s.txt", print_result);
-    test("sudokus/s04b.txt", "solutions/s04b_s.txt", print_result);
-    test("sudokus/s04c.txt", "solutions/s04c_s.txt", print_result);
-    test("sudokus/s05a.txt", "solutions/s05a_s.txt", print_result);
-    test("sudokus/s05b.txt", "solutions/s05b_s.txt", print_result);
-    test("sudokus/s05c.txt", "solutions/s05c_s.txt", print_result);
-    test("sudokus/s06a.txt", "solutions/s06a_s.txt", print_result);
-    test("sudokus/s06b.txt", "solutions/s06b_s.txt", print_result);
-    test("sudokus/s06c.txt", "solutions/s06c_s.txt", print_result);
-    test("sudokus/s07a.txt", "solutions/s07a_s.txt", print_result);
-    test("sudokus/s07b.txt", "solutions/s07b_s.txt", print_result);
-    test("sudokus/s07c.txt", "solutions/s07c_s.txt", print_result);
-    test("sudokus/s08a.txt", "solutions/s08a_s.txt", print_result);
-    test("sudokus/s08b.txt", "solutions/s08b_s.txt", print_result);
-    test("sudokus/s08c.txt", "solutions/s08c_s.txt", print_result);
-    test("sudokus/s09a.txt", "solutions/s09a_s.txt", print_result);
-    test("sudokus/s09b.txt", "solutions/s09b_s.txt", print_result);
-    test("sudokus/s09c.txt", "solutions/s09c_s.txt", print_result);
-    test("sudokus/s10a.txt", "solutions/s10a_s.txt", print_result);
-    test("sudokus/s10b.txt", "solutions/s10b_s.txt", print_result);
-    test("sudokus/s10c.txt", "solutions/s10c_s.txt", print_result);
-    test("sudokus/s11a.txt", "solutions/s11a_s.txt", print_result);
-    test("sudokus/s11b.txt", "solutions/s11b_s.txt", print_result);
-    test("sudokus/s11c.txt", "solutions/s11c_s.txt", print_result);
-    test("sudokus/s12a.txt", "solutions/s12a_s.txt", print_result);
-    test("sudokus/s12b.txt", "solutions/s12b_s.txt", print_result);
-    test("sudokus/s12c.txt", "solutions/s12c_s.txt", print_result);
-    test("sudokus/s13a.txt", "solutions/s13a_s.txt", print_result);
-    test("sudokus/s13b.txt", "solutions/s13b_s.txt", print_result);
-    test("sudokus/s13c.txt", "solutions/s13c_s.txt", print_result);
-    test("sudokus/s14a.txt", "solutions/s14a_s.txt", print_result);
-    test("sudokus/s14b.txt", "solutions/s14b_s.txt", print_result);
-    test("sudokus/s14c.txt", "solutions/s14c_s.txt", print_result);
-    test("sudokus/s15a.txt", "solutions/s15a_s.txt", print_result);
-    test("sudokus/s15b.txt", "solutions/s15b_s.txt", print_result);
-    test("sudokus/s15c.txt", "solutions/s15c_s.txt", print_result);
-    test("sudokus/s16.txt", "solutions/s16_s.txt", print_result);
+    __m128i low_byte = _mm_set1_epi16(0x00FF);
+    u32 i = 0;
+    for (; i + 16 <= CORPUS_CELLS; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((__m128i*)(cells + i));
+        __m128i pairs = _mm_or_si128(_mm_and_si128(v, low_byte), _mm_slli_epi16(_mm_srli_epi16(v, 8), 4));
+        _mm_storel_epi64((__m128i*)(packed + i / 2), _mm_packus_epi16(pairs, pairs));
+    }
+    for (; i < CORPUS_CELLS; i += 2)
+        packed[i / 2] = cells[i] | (i + 1 < CORPUS_CELLS ? cells[i + 1] << 4 : 0);
 }
 
+void corpus_unpack_cells(u8 *packed, u8 *cells)
+{
+    __m128i low_nibble = _mm_set1_epi8(0x0F);
+    u32 i = 0;
+    for (; i + 16 <= CORPUS_CELLS; i += 16)
+    {
+        __m128i v = _mm_loadl_epi64((__m128i*)(packed + i / 2));
+        __m128i lo = _mm_and_si128(v, low_nibble);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble);
+        _mm_storeu_si128((__m128i*)(cells + i), _mm_unpacklo_epi8(lo, hi));
+    }
+    for (; i < CORPUS_CELLS; ++i)
+        cells[i] = (packed[i / 2] >> (4 * (i & 1))) & 0x0F;
+}
 
-void solve_data_file(char *fname)
+// bit i set when cell i is not blank
+void corpus_pack_mask(u8 *cells, u8 *mask)
 {
-    FILE *f = fopen(fname, "rb");
-    if(f) {
+    memset(mask, 0, CORPUS_MASK_SIZE);
+    __m128i zero = _mm_setzero_si128();
+    u32 i = 0;
+    for (; i + 16 <= CORPUS_CELLS; i += 16)
+    {
+        u32 blank = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)(cells + i)), zero));
+        u32 given = ~blank & 0xFFFF;
+        mask[i / 8] = (u8)given;
+        mask[i / 8 + 1] = (u8)(given >> 8);
+    }
+    for (; i < CORPUS_CELLS; ++i)
+    {
+        if (cells[i])
+            mask[i / 8] |= 1 << (i & 7);
+    }
+}
+
+// encode one record, false when a given doesn't match the solution
+bool corpus_encode(u32 flags, u8 *sudoku, u8 *solution, CorpusStats *stats, u8 *record)
+{
+    if (flags & CORPUS_HAS_SOLUTION)
+    {
+        for (u32 i = 0; i < CORPUS_CELLS; ++i)
+        {
+            if (sudoku[i] && sudoku[i] != solution[i])
+                return false;
+        }
+        
+        corpus_pack_mask(sudoku, record);
+        record += CORPUS_MASK_SIZE;
+        corpus_pack_cells(solution, record);
+    }
+    else
+    {
+        corpus_pack_cells(sudoku, record);
+    }
+    record += CORPUS_NIBBLE_SIZE;
+    
+    if (flags & CORPUS_HAS_STATS)
+    {
+        CorpusStats empty = {};
+        memcpy(record, stats ? stats : &empty, CORPUS_STATS_SIZE);
+    }
+    
+    return true;
+}
+
+// decode one record, solution and stats are optional and left alone when the file has none
+void corpus_decode(u32 flags, u8 *record, u8 *sudoku, u8 *solution, CorpusStats *stats)
+{
+    if (flags & CORPUS_HAS_SOLUTION)
+    {
+        u8 *mask = record;
+        u8 full[CORPUS_CELLS];
+        corpus_unpack_cells(record + CORPUS_MASK_SIZE, full);
+        for (u32 i = 0; i < CORPUS_CELLS; ++i)
+            sudoku[i] = (mask[i / 8] >> (i & 7)) & 1 ? full[i] : 0;
+        if (solution)
+            memcpy(solution, full, CORPUS_CELLS);
+        record += CORPUS_MASK_SIZE;
+    }
+    else
+    {
+        u8 cells[CORPUS_CELLS];
+        corpus_unpack_cells(record, cells);
+        memcpy(sudoku, cells, CORPUS_CELLS);
+    }
+    record += CORPUS_NIBBLE_SIZE;
+    
+    if (stats && (flags & CORPUS_HAS_STATS))
+        memcpy(stats, record, CORPUS_STATS_SIZE);
+}
+
+// records are buffered and written in big blocks, the count go in the header at close
+#define CORPUS_WRITER_BUFFER_SIZE (1024 * 1024)
+
+struct CorpusWriter {
+    FILE *file;
+    CorpusHeader header;
+    u8 *buffer;
+    u32 used;
+};
+
+bool corpus_writer_open(CorpusWriter *writer, char *fname, u32 flags)
+{
+    memset(writer, 0, sizeof(CorpusWriter));
+    writer->file = fopen(fname, "wb");
+    if (!writer->file)
+        return false;
+    
+    writer->header.magic = CORPUS_MAGIC;
+    writer->header.version = CORPUS_VERSION;
+    writer->header.flags = (u16)flags;
+    writer->header.max_row = 9;
+    writer->header.block_size = 3;
+    writer->header.record_size = (u16)corpus_record_size(flags);
+    fwrite(&writer->header, sizeof(CorpusHeader), 1, writer->file);
+    
+    writer->buffer = (u8*)malloc(CORPUS_WRITER_BUFFER_SIZE);
+    return true;
+}
+
+bool corpus_writer_add(CorpusWriter *writer, u8 *sudoku, u8 *solution = 0, CorpusStats *stats = 0)
+{
+    u32 record_size = writer->header.record_size;
+    if (writer->used + record_size > CORPUS_WRITER_BUFFER_SIZE)
+    {
+        fwrite(writer->buffer, writer->used, 1, writer->file);
+        writer->used = 0;
+    }
+    
+    if (!corpus_encode(writer->header.flags, sudoku, solution, stats, writer->buffer + writer->used))
+        return false;
+    
+    writer->used += record_size;
+    ++writer->header.count;
+    return true;
+}
+
+void corpus_writer_close(CorpusWriter *writer)
+{
+    if (writer->used)
+        fwrite(writer->buffer, writer->used, 1, writer->file);
+    
+    fseek(writer->file, 0, SEEK_SET);
+    fwrite(&writer->header, sizeof(CorpusHeader), 1, writer->file);
+    fclose(writer->file);
+    free(writer->buffer);
+    writer->file = 0;
+    writer->buffer = 0;
+}
+
+// streaming reader for data files, read fixed size chunks so memory stay bounded
+// no matter how big the file is and the first puzzle is ready after the first chunk
+#define DATA_READER_CHUNK_SIZE (1024 * 1024)
+
+struct DataReader {
+    FILE *file;
+    u8 *buffer;
+    u32 used;  // valid bytes in buffer
+    u32 pos;   // start of next line in buffer
+    bool eof;
+    
+    u64 bytes_read;
+    u64 puzzle_count;
+    u64 rejected_count; // malformed or conflicting lines
+    
+    SudokuFormat format; // text files, detected like sudoku_parse_text on the first chunk
+    bool binary; // corpus file, records instead of lines
+    CorpusHeader header;
+};
+
+// keep leftover of the current line and refill the rest of the buffer
+bool data_reader_refill(DataReader *reader)
+{
+    if (reader->eof)
+        return false;
+    
+    u32 left = reader->used - reader->pos;
+    memmove(reader->buffer, reader->buffer + reader->pos, left);
+    reader->used = left;
+    reader->pos = 0;
+    
+    u32 read = (u32)fread(reader->buffer + left, 1, DATA_READER_CHUNK_SIZE - left, reader->file);
+    reader->used += read;
+    reader->bytes_read += read;
+    if (read == 0)
+        reader->eof = true;
+    
+    return read > 0;
+}
+
+bool data_reader_open(DataReader *reader, char *fname)
+{
+    memset(reader, 0, sizeof(DataReader));
+    reader->file = fopen(fname, "rb");
+    if (!reader->file)
+        return false;
+    
+    reader->buffer = (u8*)malloc(DATA_READER_CHUNK_SIZE);
+    
+    // a corpus start with its header, anything else is read as text lines
+    data_reader_refill(reader);
+    if (reader->used >= sizeof(CorpusHeader))
+    {
+        CorpusHeader *header = (CorpusHeader*)reader->buffer;
+        if (header->magic == CORPUS_MAGIC && header->version == CORPUS_VERSION &&
+            header->record_size == corpus_record_size(header->flags))
+        {
+            reader->binary = true;
+            reader->header = *header;
+            reader->pos = sizeof(CorpusHeader);
+        }
+    }
+    
+    return true;
+}
+
+void data_reader_close(DataReader *reader)
+{
+    if (reader->file) fclose(reader->file);
+    if (reader->buffer) free(reader->buffer);
+    reader->file = 0;
+    reader->buffer = 0;
+}
+
+// next record of a corpus file, solution and stats are optional (left alone when the file has none)
+bool data_reader_next_record(DataReader *reader, u8 *sudoku, u8 *solution = 0, CorpusStats *stats = 0)
+{
+    if (!reader->binary || reader->puzzle_count >= reader->header.count)
+        return false;
+    
+    u32 record_size = reader->header.record_size;
+    if (reader->used - reader->pos < record_size)
+    {
+        data_reader_refill(reader);
+        if (reader->used - reader->pos < record_size)
+            return false;
+    }
+    
+    corpus_decode(reader->header.flags, reader->buffer + reader->pos, sudoku, solution, stats);
+    reader->pos += record_size;
+    ++reader->puzzle_count;
+    return true;
+}
+
+// grid and comma files, a puzzle span several lines. a puzzle is far smaller than a chunk so
+// keeping half a chunk ahead is enough for a whole one, a rejected puzzle is skipped up to
+// the next blank line
+bool data_reader_next_cells(DataReader *reader, u8 *sudoku, u32 max_row, u32 max_size, bool *rejected)
+{
+    for (;;)
+    {
+        if (reader->used - reader->pos < DATA_READER_CHUNK_SIZE / 2)
+            data_reader_refill(reader);
         
-        fseek(f, 0, SEEK_END);
-        u32 file_size = ftell(f);
-        fseek(f, 0, SEEK_SET);
+        u8 *text = reader->buffer + reader->pos;
+        u64 size = reader->used - reader->pos;
         
-        u8 *file_contents = (u8*)malloc(file_size + 1);
-        file_contents[file_size] = 0;
-        fread(file_contents, file_size, 1, f);
-        fclose(f);
+        // layout and comments between puzzles
+        u64 i = 0;
+        while (i < size)
+        {
+            u8 c = text[i];
+            if (c == '#' || c == '=')
+                i = sudoku_skip_line(text, i, size);
+            else if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '|' || c == '-' || c == '+' || c == ',')
+                ++i;
+            else
+                break;
+        }
+        if (i == size)
+        {
+            reader->pos = reader->used;
+            return false;
+        }
+        
+        u64 parsed = 0;
+        SudokuParse parse = sudoku_parse_cells(text + i, size - i, sudoku, max_row, max_size, reader->format == SUDOKU_FORMAT_COMMA, &parsed);
+        if (parse == SUDOKU_PARSE_OK)
+        {
+            reader->pos += (u32)(i + parsed);
+            ++reader->puzzle_count;
+            return true;
+        }
+        
+        u64 end = sudoku_skip_line(text, i, size);
+        while (end < size)
+        {
+            u64 next = sudoku_skip_line(text, end + 1, size);
+            u64 k = end + 1;
+            while (k < next && (text[k] == ' ' || text[k] == '\t' || text[k] == '\r'))
+                ++k;
+            end = next;
+            if (k == next)
+                break;
+        }
+        reader->pos += (u32)(end < size ? end + 1 : size);
+        
+        ++reader->rejected_count;
+        if (rejected)
+        {
+            memset(sudoku, 0, max_size);
+            *rejected = true;
+            return true;
+        }
+    }
+}
+
+// parse next puzzle into sudoku, skip '#' comments, empty lines and puzzles the parser reject, false at end of file.
+// text files are line, grid or comma (sudoku_detect_format on the first chunk), lines are one puzzle each.
+// with rejected given a rejected puzzle is returned too, as an empty sudoku with *rejected set, so callers
+// that keep input puzzle N on output line N can hold its slot. corpus files give their records instead,
+// they only hold 9x9 puzzles
+bool data_reader_next(DataReader *reader, u8 *sudoku, u32 max_row, u32 max_size, bool *rejected = 0)
+{
+    if (rejected)
+        *rejected = false;
+    if (reader->binary)
+        return max_size == CORPUS_CELLS && data_reader_next_record(reader, sudoku);
+    
+    if (reader->format == SUDOKU_FORMAT_UNKNOWN)
+        reader->format = sudoku_detect_format(reader->buffer + reader->pos, reader->used - reader->pos, max_row, max_size);
+    if (reader->format == SUDOKU_FORMAT_GRID || reader->format == SUDOKU_FORMAT_COMMA)
+        return data_reader_next_cells(reader, sudoku, max_row, max_size, rejected);
+    
+    for (;;)
+    {
+        // find end of line, refill when the line cross the chunk boundary
+        u32 end = reader->pos;
+        for (;;)
+        {
+            u8 *newline = (u8*)memchr(reader->buffer + end, '\n', reader->used - end);
+            end = newline ? (u32)(newline - reader->buffer) : reader->used;
+            if (end < reader->used || reader->eof)
+                break;
+            
+            // line longer than a whole chunk, not a puzzle line, cut it
+            if (reader->pos == 0 && reader->used == DATA_READER_CHUNK_SIZE)
+                break;
+            
+            end -= reader->pos;
+            data_reader_refill(reader);
+        }
+        
+        if (reader->pos >= reader->used)
+            return false;
+        
+        u8 *line = reader->buffer + reader->pos;
+        u32 line_size = end - reader->pos;
+        reader->pos = end < reader->used ? end + 1 : end;
+        
+        if (line_size && line[line_size - 1] == '\r')
+            --line_size;
+        
+        if (line_size == 0 || line[0] == '#')
+            continue;
         
-        u8 c = 0;
+        if (sudoku_parse_line(line, line_size, sudoku, max_row, max_size) != SUDOKU_PARSE_OK)
+        {
+            ++reader->rejected_count;
+            if (!rejected)
+                continue;
+            
+            memset(sudoku, 0, max_size);
+            *rejected = true;
+            return true;
+        }
+        
+        ++reader->puzzle_count;
+        return true;
+    }
+}
+
+void solve_data_file(char *fname)
+{
+    DataReader reader;
+    if(data_reader_open(&reader, fname)) {
         
         const u32 max_row = 9;
         const u32 max_col = 9;
@@ -936,52 +2839,34 @@ void solve_data_file(char *fname)
         u16 sudoku_possible[max_size * 3] = {0};
         u32 solved_count = 0;
         
-        u32 i = 0;
-        
-        // skip comment stuff
-        while(i < file_size && file_contents[i] == '#')
-        {
-            while (i < file_size && file_contents[++i] != '\n');
-            ++i;
-        }
-        
         u64 total_guess = 0;
-        while (i < file_size)
+        while (data_reader_next(&reader, sudoku, max_row, max_size))
         {
-            u8* buffer = file_contents + i;
-            i += max_size;
-            while (file_contents[i++] != '\n');
-            
-            for (int j = 0; j < max_size; ++j)
-            {
-                c = buffer[j];
-                
-                if (c == '.') c = '0';
-                
-                // 0 to 9 ascii
-                if (c >= '0' && c <= (max_row + 48))
-                {
-                    sudoku[j] = c - 48;
-                }
-            }
-            
             u32 bcount = 0;
             //bool ret = sudoku_backtrack(sudoku, 0, 9, 9, 3, &bcount);
             //advance_sudoku(sudoku, 9, max_size, padding);
             u32 num_guess = 0;
             u32 block_size = 3;
-            sudoku_print(sudoku, max_size);
+            u8 puzzle[max_size];
+            memcpy(puzzle, sudoku, max_size);
             sudoku_fill_possible(sudoku, sudoku_possible, max_row, max_col, block_size);
-            bool ret = sudoku_backtrack_heuristic(sudoku, sudoku_possible, max_row, max_col, block_size, &num_guess);
+            bool ret = sudoku_backtrack_heuristic_trail(sudoku, sudoku_possible, max_row, max_col, block_size, &num_guess, 0, 0, SUDOKU_PROPAGATE_SINGLES);
             
             //bool ret = sudoku_backtrack_min(sudoku, max_row, max_col, block_size, &num_guess);
             
             total_guess += num_guess;
             
             
-            printf("Number of guess: %d\n", num_guess);
-            sudoku_print(sudoku, max_size);
-            fflush(stdout);
+            // puzzle, guesses and solution as lines in one write, no printf per cell or flush per puzzle
+            char text[(max_size + 1) * 2 + 32];
+            u32 used = 0;
+            for (u32 i = 0; i < max_size; ++i)
+                text[used++] = '0' + puzzle[i];
+            used += sprintf(text + used, "\nNumber of guess: %d\n", num_guess);
+            for (u32 i = 0; i < max_size; ++i)
+                text[used++] = '0' + sudoku[i];
+            text[used++] = '\n';
+            fwrite(text, used, 1, stdout);
             //assert(ret == true);
             
             solved_count++;
@@ -997,7 +2882,246 @@ void solve_data_file(char *fname)
             printf("Total guess/problem %lld/%d=%lld\n", total_guess, solved_count, total_guess/solved_count);
         }
         
-        if (file_contents) free(file_contents);
+        data_reader_close(&reader);
+    }
+    
+}
+
+void stream_solution(void *context, u8 *sudoku, u32)
+{
+    char line[9 * 9 + 1];
+    for (u32 i = 0; i < 9 * 9; ++i)
+        line[i] = '0' + sudoku[i];
+    line[9 * 9] = '\n';
+    fwrite(line, sizeof(line), 1, (FILE*)context);
+}
+
+// every solution of every puzzle to stdout one line each (up to limit per puzzle, 0 = all),
+// an empty line after each puzzle
+bool stream_solutions_data_file(char *fname, u32 limit)
+{
+    DataReader reader;
+    if (!data_reader_open(&reader, fname))
+        return false;
+    
+    u8 sudoku[9 * 9];
+    while (data_reader_next(&reader, sudoku, 9, 9 * 9))
+    {
+        sudoku_count_solutions(sudoku, 9, 9, 3, limit, 0, stream_solution, stdout);
+        fwrite("\n", 1, 1, stdout);
+    }
+    fflush(stdout);
+    
+    data_reader_close(&reader);
+    return true;
+}
+
+// text data file to corpus. solution_fname (optional) is a data file with the solution of every
+// puzzle on the same line, with solve the puzzles are solved here and guesses / time kept too.
+// puzzles that don't match their solution, can't be solved or sit on a rejected line (either file) are left out
+bool pack_data_file(char *fname, char *out_fname, char *solution_fname = 0, bool solve = false)
+{
+    DataReader reader;
+    if (!data_reader_open(&reader, fname))
+        return false;
+    
+    DataReader solution_reader = {};
+    if (solution_fname && !data_reader_open(&solution_reader, solution_fname))
+    {
+        data_reader_close(&reader);
+        return false;
+    }
+    
+    u32 flags = 0;
+    if (solution_fname) flags = CORPUS_HAS_SOLUTION;
+    if (solve) flags = CORPUS_HAS_SOLUTION | CORPUS_HAS_STATS;
+    
+    CorpusWriter writer;
+    if (!corpus_writer_open(&writer, out_fname, flags))
+    {
+        data_reader_close(&reader);
+        data_reader_close(&solution_reader);
+        return false;
+    }
+    
+    SudokuTrail *trail = solve ? (SudokuTrail*)malloc(sizeof(SudokuTrail)) : 0;
+    u8 sudoku[CORPUS_CELLS];
+    u8 solution[CORPUS_CELLS];
+    u64 skipped_count = 0;
+    
+    // rejected lines keep their place so puzzle line N stay paired with solution line N
+    bool rejected = false;
+    bool solution_rejected = false;
+    while (data_reader_next(&reader, sudoku, 9, CORPUS_CELLS, &rejected))
+    {
+        CorpusStats stats = {};
+        bool ok = !rejected;
+        if (solution_fname)
+        {
+            ok = data_reader_next(&solution_reader, solution, 9, CORPUS_CELLS, &solution_rejected) && !solution_rejected && ok;
+        }
+        else if (ok && solve)
+        {
+            memcpy(solution, sudoku, CORPUS_CELLS);
+            double time_start = sudoku_time();
+            ok = sudoku_solve_with_trail(solution, 9, 9, 3, trail, &stats.num_guess, SUDOKU_PROPAGATE_SINGLES);
+            stats.time_us = (u32)((sudoku_time() - time_start) * 1e6);
+        }
+        
+        if (!ok || !corpus_writer_add(&writer, sudoku, solution, &stats))
+            ++skipped_count;
+    }
+    
+    u64 record_count = writer.header.count;
+    u64 out_size = sizeof(CorpusHeader) + record_count * writer.header.record_size;
+    corpus_writer_close(&writer);
+    
+    fprintf(stderr, "Records: %lld, Skipped: %lld, Text: %lld bytes, Corpus: %lld bytes\n",
+            record_count, skipped_count, reader.bytes_read + solution_reader.bytes_read, out_size);
+    
+    if (trail) free(trail);
+    data_reader_close(&reader);
+    data_reader_close(&solution_reader);
+    return skipped_count == 0;
+}
+
+// corpus back to text, puzzles as 81 char lines or comma grids (a blank line after each one).
+// solution_fname (optional) get the solutions the same way, stats_fname one "guesses,time_us" line per record
+bool unpack_data_file(char *fname, char *out_fname, bool grid = false, char *solution_fname = 0, char *stats_fname = 0)
+{
+    DataReader reader;
+    if (!data_reader_open(&reader, fname))
+        return false;
+    
+    u32 flags = reader.header.flags;
+    FILE *out = reader.binary ? fopen(out_fname, "wb") : 0;
+    FILE *solution_out = out && solution_fname && (flags & CORPUS_HAS_SOLUTION) ? fopen(solution_fname, "wb") : 0;
+    FILE *stats_out = out && stats_fname && (flags & CORPUS_HAS_STATS) ? fopen(stats_fname, "wb") : 0;
+    if (!out)
+    {
+        data_reader_close(&reader);
+        return false;
+    }
+    
+    u8 sudoku[CORPUS_CELLS];
+    u8 solution[CORPUS_CELLS];
+    CorpusStats stats;
+    while (data_reader_next_record(&reader, sudoku, solution, &stats))
+    {
+        for (u32 f = 0; f < 2; ++f)
+        {
+            FILE *file = f ? solution_out : out;
+            u8 *cells = f ? solution : sudoku;
+            if (!file)
+                continue;
+            
+            if (grid)
+            {
+                write_sudoku_grid(file, cells, CORPUS_CELLS, 9);
+                fwrite("\n", 1, 1, file);
+            }
+            else
+            {
+                stream_solution(file, cells, 0);
+            }
+        }
+        
+        if (stats_out)
+            fprintf(stats_out, "%u,%u\n", stats.num_guess, stats.time_us);
+    }
+    
+    bool complete = reader.puzzle_count == reader.header.count;
+    fclose(out);
+    if (solution_out) fclose(solution_out);
+    if (stats_out) fclose(stats_out);
+    data_reader_close(&reader);
+    return complete;
+}
+
+// the run_tests puzzles through records of every flag set, then a corpus file back to
+// line and grid text, each read back has to give the same puzzles (files are written to the current directory)
+void run_corpus_tests(bool print_result)
+{
+    static u8 puzzles[SUDOKU_TEST_FILES][CORPUS_CELLS];
+    static u8 solutions[SUDOKU_TEST_FILES][CORPUS_CELLS];
+    u8 sudoku[CORPUS_CELLS];
+    u8 solution[CORPUS_CELLS];
+    u8 record[CORPUS_MAX_RECORD_SIZE];
+    for (u32 k = 0; k < SUDOKU_TEST_FILES; ++k)
+    {
+        bool read = sudoku_load_test(k, puzzles[k], solutions[k]);
+        assert(read);
+        
+        CorpusStats stats = {k, 1000 * k};
+        for (u32 flags = 0; flags <= (CORPUS_HAS_SOLUTION | CORPUS_HAS_STATS); ++flags)
+        {
+            CorpusStats back = {};
+            memset(solution, 0, CORPUS_CELLS);
+            bool encoded = corpus_encode(flags, puzzles[k], solutions[k], &stats, record);
+            assert(encoded);
+            corpus_decode(flags, record, sudoku, solution, &back);
+            assert(memcmp(sudoku, puzzles[k], CORPUS_CELLS) == 0);
+            if (flags & CORPUS_HAS_SOLUTION) assert(memcmp(solution, solutions[k], CORPUS_CELLS) == 0);
+            if (flags & CORPUS_HAS_STATS) assert(back.num_guess == stats.num_guess && back.time_us == stats.time_us);
+        }
+        
+        // a given that doesn't match the solution
+        u32 given = 0;
+        while (!puzzles[k][given]) ++given;
+        memcpy(sudoku, puzzles[k], CORPUS_CELLS);
+        sudoku[given] = sudoku[given] % 9 + 1;
+        assert(!corpus_encode(CORPUS_HAS_SOLUTION, sudoku, solutions[k], 0, record));
+    }
+    
+    CorpusWriter writer;
+    bool opened = corpus_writer_open(&writer, "test_corpus.bin", CORPUS_HAS_SOLUTION | CORPUS_HAS_STATS);
+    assert(opened);
+    for (u32 k = 0; k < SUDOKU_TEST_FILES; ++k)
+    {
+        CorpusStats stats = {k, 1000 * k};
+        bool added = corpus_writer_add(&writer, puzzles[k], solutions[k], &stats);
+        assert(added);
+    }
+    corpus_writer_close(&writer);
+    
+    DataReader reader;
+    opened = data_reader_open(&reader, "test_corpus.bin");
+    assert(opened && reader.binary && reader.header.count == SUDOKU_TEST_FILES);
+    CorpusStats stats;
+    for (u32 k = 0; k < SUDOKU_TEST_FILES; ++k)
+    {
+        bool read = data_reader_next_record(&reader, sudoku, solution, &stats);
+        assert(read);
+        assert(memcmp(sudoku, puzzles[k], CORPUS_CELLS) == 0 && memcmp(solution, solutions[k], CORPUS_CELLS) == 0);
+        assert(stats.num_guess == k && stats.time_us == 1000 * k);
+    }
+    assert(!data_reader_next_record(&reader, sudoku, solution, &stats));
+    data_reader_close(&reader);
+    
+    for (u32 grid = 0; grid < 2; ++grid)
+    {
+        bool unpacked = unpack_data_file("test_corpus.bin", "test_corpus.txt", grid, "test_corpus_s.txt");
+        assert(unpacked);
+        
+        DataReader solution_reader;
+        opened = data_reader_open(&reader, "test_corpus.txt") && data_reader_open(&solution_reader, "test_corpus_s.txt");
+        assert(opened);
+        bool rejected = false;
+        for (u32 k = 0; k < SUDOKU_TEST_FILES; ++k)
+        {
+            bool read = data_reader_next(&reader, sudoku, 9, CORPUS_CELLS, &rejected) && !rejected;
+            read = read && data_reader_next(&solution_reader, solution, 9, CORPUS_CELLS, &rejected) && !rejected;
+            assert(read);
+            assert(memcmp(sudoku, puzzles[k], CORPUS_CELLS) == 0 && memcmp(solution, solutions[k], CORPUS_CELLS) == 0);
+        }
+        assert(!data_reader_next(&reader, sudoku, 9, CORPUS_CELLS, &rejected));
+        data_reader_close(&reader);
+        data_reader_close(&solution_reader);
+        
+        if (print_result) printf("corpus %s: %u puzzles\n", grid ? "grid" : "line", SUDOKU_TEST_FILES);
     }
     
+    remove("test_corpus.bin");
+    remove("test_corpus.txt");
+    remove("test_corpus_s.txt");
 }
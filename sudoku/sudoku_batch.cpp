@@ -0,0 +1,1305 @@
+#include "base.h"
+#include "platform.h"
+
+// multithreaded batch solving for data files, include after sudoku.cpp, sudoku_canon.cpp, sudoku_grade.cpp and sudoku_simd.cpp
+//
+// every worker own a range of puzzle index [begin, end) packed in one u64,
+// the owner take puzzles from the front and an idle worker steal half of
+// the remaining range from the back of a victim. both side CAS the same
+// word so no lock needed. results are written to their own slot so output
+// stay in input order no matter which worker solved it.
+
+#define BATCH_CHUNK_SIZE 4
+#define BATCH_OUTPUT_BUFFER_SIZE MB(1)
+#define BATCH_BLOCK_SIZE (64 * 1024) // puzzles in flight at once
+#define BATCH_CACHE_SIZE (512 * 1024) // canonical forms, ~48MB
+
+struct BatchResult {
+    u8 sudoku[9 * 9];
+    bool solved;
+    u32 num_guess;
+    u32 num_solutions; // count engine only
+    u32 grade_score;   // grade engine only
+    u8 grade_hardest;  // SudokuTechnique
+    bool gave_up;      // budget ran out before an answer
+    bool rejected;     // line the reader rejected, never solved, hold its output line
+    u8 givens[CORPUS_MASK_SIZE]; // binary output only, which cells were given
+    
+    // cached batch only, canonical form of the puzzle and how to get there
+    bool cached; // answer came from the cache
+    u32 leader;  // first puzzle of the block with the same form, only that one is solved
+    u64 canon_hash;
+    u8 canon[CORPUS_NIBBLE_SIZE];
+    SudokuTransform transform;
+#if SUDOKU_STATS
+    SudokuStats stats;
+#endif
+};
+
+#if SUDOKU_STATS
+// latency histogram with power of two buckets, bucket k count solves up to 2^k us
+#define BATCH_HISTOGRAM_BUCKETS 25 // last finite bucket is ~16 secs
+
+struct BatchHistogram {
+    u64 buckets[BATCH_HISTOGRAM_BUCKETS + 1]; // last one is +Inf
+    u64 count;
+    double sum;
+};
+
+void batch_histogram_add(BatchHistogram *histogram, double seconds)
+{
+    u32 k = 0;
+    double bound = 1e-6;
+    while (k < BATCH_HISTOGRAM_BUCKETS && seconds > bound)
+    {
+        ++k;
+        bound *= 2;
+    }
+    
+    ++histogram->buckets[k];
+    ++histogram->count;
+    histogram->sum += seconds;
+}
+
+void batch_histogram_merge(BatchHistogram *dest, BatchHistogram *src)
+{
+    for (u32 k = 0; k <= BATCH_HISTOGRAM_BUCKETS; ++k)
+        dest->buckets[k] += src->buckets[k];
+    dest->count += src->count;
+    dest->sum += src->sum;
+}
+#endif
+
+struct BatchContext;
+
+struct BatchWorker {
+    volatile u64 range; // begin in low 32 bits, end in high 32 bits
+    u8 padding[56];     // keep ranges of different workers on different cache lines
+    
+    Thread thread;
+    BatchContext *batch;
+    u32 worker_index;
+    
+    u64 total_guess;
+    u64 solved_count;
+    u64 failed_count;
+    u64 gave_up_count;
+    u64 cache_hit_count;
+    u32 steal_count;
+    double time_solve;
+    
+#if SUDOKU_STATS
+    SudokuStats stats; // sum of every puzzle, max_depth is the max
+    BatchHistogram solve_latency;
+    BatchHistogram search_latency;
+#endif
+};
+
+enum BatchEngine {
+    BATCH_ENGINE_HEURISTIC,
+    BATCH_ENGINE_SIMD,
+    BATCH_ENGINE_SINGLES,
+    BATCH_ENGINE_SUBSETS,
+    BATCH_ENGINE_DLX,
+    BATCH_ENGINE_BOARD,
+    BATCH_ENGINE_COUNT, // count solutions up to count_limit instead of solving
+    BATCH_ENGINE_GRADE, // solve with human techniques and rate the puzzle
+};
+
+struct BatchContext {
+    BatchEngine engine;
+    u32 chunk_size;
+    u32 count_limit;
+    
+    // per puzzle budget, 0 = no limit
+    u64 max_nodes;
+    double timeout;
+    
+    BatchResult *results;
+    u32 puzzle_count;
+    
+    // solutions by canonical form, workers only read it, new forms go in between blocks
+    SudokuCache *cache;
+    u32 *leaders; // forms of the block, puzzle index + 1 (0 = empty)
+    
+    BatchWorker *workers;
+    u32 num_workers;
+};
+
+static const char *batch_engine_names[] = {
+    "heuristic",
+    "simd",
+    "singles",
+    "subsets",
+    "dlx",
+    "board",
+    "count",
+    "grade",
+};
+
+inline u64 batch_range(u32 begin, u32 end)
+{
+    return (u64)begin | ((u64)end << 32);
+}
+
+// take up to chunk_size puzzles from the front of own range
+bool batch_take(BatchWorker *worker, u32 *begin_ret, u32 *end_ret)
+{
+    u32 chunk_size = worker->batch->chunk_size;
+    for (;;)
+    {
+        u64 range = atomic_load_u64(&worker->range);
+        u32 begin = (u32)range;
+        u32 end = (u32)(range >> 32);
+        if (begin >= end)
+            return false;
+        
+        u32 take_end = end - begin > chunk_size ? begin + chunk_size : end;
+        if (atomic_cas_u64(&worker->range, range, batch_range(take_end, end)))
+        {
+            *begin_ret = begin;
+            *end_ret = take_end;
+            return true;
+        }
+    }
+}
+
+// move the back half of another worker range into own (empty) range
+bool batch_steal(BatchWorker *worker)
+{
+    BatchContext *batch = worker->batch;
+    for (u32 k = 1; k < batch->num_workers; ++k)
+    {
+        BatchWorker *victim = batch->workers + (worker->worker_index + k) % batch->num_workers;
+        for (;;)
+        {
+            u64 range = atomic_load_u64(&victim->range);
+            u32 begin = (u32)range;
+            u32 end = (u32)(range >> 32);
+            if (end <= begin || end - begin < 2)
+                break;
+            
+            u32 half = (end - begin) / 2;
+            if (atomic_cas_u64(&victim->range, range, batch_range(begin, end - half)))
+            {
+                atomic_store_u64(&worker->range, batch_range(end - half, end));
+                ++worker->steal_count;
+                return true;
+            }
+        }
+    }
+    
+    return false;
+}
+
+// fresh budget for one puzzle, 0 when the batch run without limits so the engines skip the checks
+SudokuBudget *batch_budget(BatchContext *batch, SudokuBudget *budget)
+{
+    if (!batch->max_nodes && batch->timeout <= 0)
+        return 0;
+    
+    sudoku_budget_init(budget, batch->max_nodes, batch->timeout);
+    return budget;
+}
+
+void batch_solve_puzzle(BatchResult *result, SudokuTrail *trail, u32 propagate, SudokuBudget *budget)
+{
+    u32 num_guess = 0;
+    result->solved = sudoku_solve_with_trail(result->sudoku, 9, 9, 3, trail, &num_guess, propagate, budget);
+    result->num_guess = num_guess;
+}
+
+// cached batch run every block in two passes: workers first canonicalize every
+// puzzle and take the answer of forms solved in earlier blocks, the main thread then
+// pick one leader per form left and only leaders are solved. followers and new
+// forms are filled in once the block is solved
+
+// answer from an earlier copy of the puzzle, else the key stay in the result for the insert
+bool batch_cache_find(SudokuCache *cache, BatchResult *result)
+{
+    const u32 max_size = 9 * 9;
+    result->canon_hash = sudoku_canon_key(result->sudoku, result->canon, &result->transform);
+    
+    u8 canonical[max_size];
+    if (!sudoku_cache_find(cache, result->canon, result->canon_hash, canonical))
+        return false;
+    
+    u8 solution[max_size];
+    sudoku_transform_invert(&result->transform, canonical, solution);
+    for (u32 i = 0; i < max_size; ++i)
+    {
+        if (result->sudoku[i] && result->sudoku[i] != solution[i])
+            return false;
+    }
+    
+    memcpy(result->sudoku, solution, max_size);
+    return true;
+}
+
+void batch_key_proc(void *param)
+{
+    BatchWorker *worker = (BatchWorker*)param;
+    BatchContext *batch = worker->batch;
+    for (;;)
+    {
+        u32 begin, end;
+        if (!batch_take(worker, &begin, &end))
+        {
+            if (batch_steal(worker))
+                continue;
+            break;
+        }
+        
+        for (u32 i = begin; i < end; ++i)
+        {
+            BatchResult *result = batch->results + i;
+            result->cached = !result->rejected && batch_cache_find(batch->cache, result);
+        }
+    }
+}
+
+// first puzzle of every form not in the cache lead, the others wait for its answer
+void batch_cache_leaders(BatchContext *batch)
+{
+    u32 mask = BATCH_BLOCK_SIZE * 2 - 1;
+    memset(batch->leaders, 0, BATCH_BLOCK_SIZE * 2 * sizeof(u32));
+    for (u32 i = 0; i < batch->puzzle_count; ++i)
+    {
+        BatchResult *result = batch->results + i;
+        if (result->cached || result->rejected)
+            continue;
+        
+        for (u32 k = (u32)result->canon_hash & mask;; k = (k + 1) & mask)
+        {
+            if (!batch->leaders[k])
+            {
+                batch->leaders[k] = i + 1;
+                break;
+            }
+            
+            BatchResult *leader = batch->results + batch->leaders[k] - 1;
+            if (leader->canon_hash == result->canon_hash && memcmp(leader->canon, result->canon, CORPUS_NIBBLE_SIZE) == 0)
+            {
+                result->leader = batch->leaders[k] - 1;
+                break;
+            }
+        }
+    }
+}
+
+// copy the answer of the leaders to their followers, count every puzzle the workers
+// skipped on worker 0 and put the new forms in the cache
+void batch_cache_finish(BatchContext *batch)
+{
+    const u32 max_size = 9 * 9;
+    BatchWorker *worker = batch->workers;
+    for (u32 i = 0; i < batch->puzzle_count; ++i)
+    {
+        BatchResult *result = batch->results + i;
+        if (result->rejected)
+            continue;
+        if (!result->cached && result->leader == i)
+        {
+            if (result->solved)
+            {
+                u8 canonical[max_size];
+                sudoku_transform_apply(&result->transform, result->sudoku, canonical);
+                sudoku_cache_insert(batch->cache, result->canon, result->canon_hash, canonical);
+            }
+            continue;
+        }
+        
+        result->num_guess = 0;
+        result->gave_up = false;
+#if SUDOKU_STATS
+        memset(&result->stats, 0, sizeof(SudokuStats));
+#endif
+        if (result->cached)
+        {
+            result->solved = true;
+            ++worker->cache_hit_count;
+        }
+        else
+        {
+            // leader come first, its board is already solved when it could be
+            BatchResult *leader = batch->results + result->leader;
+            result->solved = leader->solved;
+            result->gave_up = leader->gave_up;
+            if (leader->solved)
+            {
+                u8 canonical[max_size];
+                sudoku_transform_apply(&leader->transform, leader->sudoku, canonical);
+                sudoku_transform_invert(&result->transform, canonical, result->sudoku);
+                ++worker->cache_hit_count;
+            }
+        }
+        
+        if (result->solved)
+            ++worker->solved_count;
+        else if (result->gave_up)
+            ++worker->gave_up_count;
+        else
+            ++worker->failed_count;
+    }
+}
+
+void batch_worker_proc(void *param)
+{
+    BatchWorker *worker = (BatchWorker*)param;
+    BatchContext *batch = worker->batch;
+    
+    // per worker trail and exact cover matrix, allocate once for the whole batch
+    SudokuTrail *trail = (SudokuTrail*)malloc(sizeof(SudokuTrail));
+    bool use_dlx = batch->engine == BATCH_ENGINE_DLX || batch->engine == BATCH_ENGINE_COUNT;
+    SudokuDlx *dlx = use_dlx ? (SudokuDlx*)malloc(sizeof(SudokuDlx)) : 0;
+    
+    double time_start = platform_time();
+    for (;;)
+    {
+        u32 begin, end;
+        if (!batch_take(worker, &begin, &end))
+        {
+            if (batch_steal(worker))
+                continue;
+            break;
+        }
+        
+        if (batch->engine == BATCH_ENGINE_SIMD)
+        {
+            // chunk is one simd batch, rejected puzzles get no lane and lanes past the last stay unused
+            u8 *sudokus[SIMD_LANES];
+            bool solved[SIMD_LANES];
+            u32 num_guess[SIMD_LANES];
+            SudokuBudget budgets[SIMD_LANES];
+            BatchResult *lanes[SIMD_LANES];
+            u32 lane_count = 0;
+            bool limited = false;
+            for (u32 i = begin; i < end; ++i)
+            {
+                if (batch->results[i].rejected)
+                    continue;
+                lanes[lane_count] = batch->results + i;
+                sudokus[lane_count] = batch->results[i].sudoku;
+                limited = batch_budget(batch, budgets + lane_count) != 0;
+                ++lane_count;
+            }
+            if (!lane_count)
+                continue;
+            
+#if SUDOKU_STATS
+            SudokuStats *lane_stats[SIMD_LANES];
+            for (u32 l = 0; l < lane_count; ++l)
+                lane_stats[l] = &lanes[l]->stats;
+            double time_lanes = platform_time();
+            sudoku_solve_simd(sudokus, lane_count, solved, num_guess, trail, limited ? budgets : 0, lane_stats);
+            
+            // lanes share the propagation, every lane get an even part of the chunk time
+            time_lanes = (platform_time() - time_lanes) / lane_count;
+            for (u32 l = 0; l < lane_count; ++l)
+                lanes[l]->stats.time_search = time_lanes - lanes[l]->stats.time_fill;
+#else
+            sudoku_solve_simd(sudokus, lane_count, solved, num_guess, trail, limited ? budgets : 0);
+#endif
+            
+            for (u32 l = 0; l < lane_count; ++l)
+            {
+                lanes[l]->solved = solved[l];
+                lanes[l]->num_guess = num_guess[l];
+                lanes[l]->gave_up = limited && budgets[l].gave_up;
+            }
+        }
+        else
+        {
+            SudokuBoard<3> board; // 9x9 specialization of the board engine, small enough for the stack
+            SudokuBoardTrail<3> board_trail;
+            
+            u32 propagate = SUDOKU_PROPAGATE_NONE;
+            if (batch->engine == BATCH_ENGINE_SINGLES)
+                propagate = SUDOKU_PROPAGATE_SINGLES;
+            else if (batch->engine == BATCH_ENGINE_SUBSETS)
+                propagate = SUDOKU_PROPAGATE_SINGLES | SUDOKU_PROPAGATE_SUBSETS;
+            
+            for (u32 i = begin; i < end; ++i)
+            {
+                BatchResult *result = batch->results + i;
+                if (result->cached || result->leader != i || result->rejected)
+                    continue;
+                
+                SudokuBudget budget_storage;
+                SudokuBudget *budget = batch_budget(batch, &budget_storage);
+                result->num_guess = 0;
+#if SUDOKU_STATS
+                sudoku_stats_begin(&result->stats);
+                double time_puzzle = platform_time();
+#endif
+                
+                if (batch->engine == BATCH_ENGINE_DLX)
+                {
+                    result->solved = sudoku_dlx_init(dlx, result->sudoku, 9, 9, 3);
+                    dlx->budget = budget;
+                    result->solved = result->solved && sudoku_dlx_solve(dlx, &result->num_guess);
+                }
+                else if (batch->engine == BATCH_ENGINE_COUNT)
+                {
+                    // a puzzle count as solved when it has exactly one solution, board keep the givens.
+                    // a count cut by the budget is only a lower bound, the puzzle gave up
+                    result->num_solutions = 0;
+                    if (sudoku_dlx_init(dlx, result->sudoku, 9, 9, 3))
+                    {
+                        dlx->budget = budget;
+                        result->num_solutions = sudoku_dlx_count(dlx, batch->count_limit, 0, &result->num_guess);
+                    }
+                    result->solved = result->num_solutions == 1 && !sudoku_budget_gave_up(budget);
+                }
+                else if (batch->engine == BATCH_ENGINE_BOARD)
+                {
+                    result->solved = sudoku_board_solve<3>(&board, &board_trail, result->sudoku, &result->num_guess, budget);
+                }
+                else if (batch->engine == BATCH_ENGINE_GRADE)
+                {
+                    // no budget, a grade is a handful of passes over the board per step
+                    SudokuGrade grade;
+                    result->solved = sudoku_grade(result->sudoku, 9, 9, 3, &grade, trail);
+                    result->num_guess = grade.counts[SUDOKU_TECH_GUESS];
+                    result->grade_score = grade.score;
+                    result->grade_hardest = (u8)grade.hardest;
+                }
+                else
+                {
+                    batch_solve_puzzle(result, trail, propagate, budget);
+                }
+                
+                result->gave_up = sudoku_budget_gave_up(budget);
+#if SUDOKU_STATS
+                // search is the rest of the solve once the setup is taken out
+                result->stats.time_search = platform_time() - time_puzzle - result->stats.time_fill;
+                sudoku_stats_end();
+#endif
+            }
+        }
+        
+        for (u32 i = begin; i < end; ++i)
+        {
+            BatchResult *result = batch->results + i;
+            if (result->cached || result->leader != i || result->rejected)
+                continue;
+            
+            worker->total_guess += result->num_guess;
+            if (result->solved)
+                ++worker->solved_count;
+            else if (result->gave_up)
+                ++worker->gave_up_count;
+            else
+                ++worker->failed_count;
+            
+#if SUDOKU_STATS
+            SudokuStats *stats = &result->stats;
+            sudoku_stats_add(&worker->stats, stats);
+            batch_histogram_add(&worker->solve_latency, stats->time_fill + stats->time_search);
+            batch_histogram_add(&worker->search_latency, stats->time_search);
+#endif
+        }
+    }
+    worker->time_solve = platform_time() - time_start;
+    
+    free(trail);
+    if (dlx) free(dlx);
+}
+
+// output stage: the main thread format every solved block into big preallocated
+// buffers and a writer thread write the full ones out, so the file write overlap
+// the solve of the next block. buffers go round a ring and one is only filled
+// again once the writer thread is done with it
+#define BATCH_WRITER_BUFFERS 4
+#define BATCH_WRITER_BUFFER_SIZE MB(4)
+
+enum BatchOutput {
+    BATCH_OUTPUT_TEXT,   // 81 char lines like the input, '.' for unsolved cells
+    BATCH_OUTPUT_BINARY, // corpus with solutions and stats, needs a seekable file for the count
+};
+
+struct BatchWriter {
+    FILE *file;
+    BatchOutput format;
+    Thread thread;
+    
+    u8 *buffers[BATCH_WRITER_BUFFERS];
+    u32 sizes[BATCH_WRITER_BUFFERS];
+    u32 used;             // bytes in the buffer being filled
+    
+    volatile u32 filled;  // buffers handed to the writer thread
+    volatile u32 written; // buffers the writer thread is done with
+    volatile u32 done;
+    
+    CorpusHeader header;  // binary output
+};
+
+void batch_writer_proc(void *param)
+{
+    BatchWriter *writer = (BatchWriter*)param;
+    for (;;)
+    {
+        u32 written = writer->written;
+        if (written == atomic_load_u32(&writer->filled))
+        {
+            // done is set after the last buffer, filled has to be read again after it
+            if (atomic_load_u32(&writer->done) && written == atomic_load_u32(&writer->filled))
+                break;
+            thread_sleep_ms(1);
+            continue;
+        }
+        
+        u32 k = written % BATCH_WRITER_BUFFERS;
+        fwrite(writer->buffers[k], writer->sizes[k], 1, writer->file);
+        atomic_store_u32(&writer->written, written + 1);
+    }
+}
+
+// hand the current buffer to the writer thread, wait until the next one is free
+void batch_writer_submit(BatchWriter *writer)
+{
+    if (!writer->used)
+        return;
+    
+    u32 filled = writer->filled;
+    writer->sizes[filled % BATCH_WRITER_BUFFERS] = writer->used;
+    writer->used = 0;
+    atomic_store_u32(&writer->filled, filled + 1);
+    
+    while (filled + 1 - atomic_load_u32(&writer->written) >= BATCH_WRITER_BUFFERS)
+        thread_yield();
+}
+
+inline u8 *batch_writer_reserve(BatchWriter *writer, u32 size)
+{
+    if (writer->used + size > BATCH_WRITER_BUFFER_SIZE)
+        batch_writer_submit(writer);
+    
+    u8 *at = writer->buffers[writer->filled % BATCH_WRITER_BUFFERS] + writer->used;
+    writer->used += size;
+    return at;
+}
+
+// the writer own file until batch_writer_close, stdio buffering is turned off since
+// every write is already a whole buffer
+void batch_writer_open(BatchWriter *writer, FILE *file, BatchOutput format)
+{
+    memset(writer, 0, sizeof(BatchWriter));
+    writer->file = file;
+    writer->format = format;
+    setvbuf(file, 0, _IONBF, 0);
+    
+    for (u32 k = 0; k < BATCH_WRITER_BUFFERS; ++k)
+        writer->buffers[k] = (u8*)malloc(BATCH_WRITER_BUFFER_SIZE);
+    
+    if (format == BATCH_OUTPUT_BINARY)
+    {
+        u32 flags = CORPUS_HAS_SOLUTION | CORPUS_HAS_STATS;
+        writer->header.magic = CORPUS_MAGIC;
+        writer->header.version = CORPUS_VERSION;
+        writer->header.flags = (u16)flags;
+        writer->header.max_row = 9;
+        writer->header.block_size = 3;
+        writer->header.record_size = (u16)corpus_record_size(flags);
+        memcpy(batch_writer_reserve(writer, sizeof(CorpusHeader)), &writer->header, sizeof(CorpusHeader));
+    }
+    
+    thread_create(&writer->thread, batch_writer_proc, writer);
+}
+
+// write what's left, wait for the writer thread and patch the record count of binary output
+void batch_writer_close(BatchWriter *writer)
+{
+    batch_writer_submit(writer);
+    atomic_store_u32(&writer->done, 1);
+    thread_join(&writer->thread);
+    
+    if (writer->format == BATCH_OUTPUT_BINARY && fseek(writer->file, 0, SEEK_SET) == 0)
+        fwrite(&writer->header, sizeof(CorpusHeader), 1, writer->file);
+    
+    for (u32 k = 0; k < BATCH_WRITER_BUFFERS; ++k)
+        free(writer->buffers[k]);
+}
+
+// 81 cells to chars 16 at a time, '.' for blank, then the line break
+inline void batch_format_line(u8 *sudoku, u8 *line)
+{
+    const u32 max_size = 9 * 9;
+    __m128i zero = _mm_setzero_si128();
+    __m128i digit = _mm_set1_epi8('0');
+    __m128i dot = _mm_set1_epi8('.');
+    u32 i = 0;
+    for (; i + 16 <= max_size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((__m128i*)(sudoku + i));
+        __m128i blank = _mm_cmpeq_epi8(v, zero);
+        __m128i chars = _mm_or_si128(_mm_andnot_si128(blank, _mm_add_epi8(v, digit)), _mm_and_si128(blank, dot));
+        _mm_storeu_si128((__m128i*)(line + i), chars);
+    }
+    for (; i < max_size; ++i)
+        line[i] = sudoku[i] ? '0' + sudoku[i] : '.';
+    line[max_size] = '\n';
+}
+
+void batch_write_results(BatchWriter *writer, BatchResult *results, u32 count)
+{
+    const u32 max_size = 9 * 9;
+    if (writer->format == BATCH_OUTPUT_TEXT)
+    {
+        for (u32 i = 0; i < count; ++i)
+            batch_format_line(results[i].sudoku, batch_writer_reserve(writer, max_size + 1));
+        return;
+    }
+    
+    // given mask, 4 bit solution (blank where unsolved) and stats, see corpus_encode
+    u32 record_size = writer->header.record_size;
+    for (u32 i = 0; i < count; ++i)
+    {
+        BatchResult *result = results + i;
+        u8 *record = batch_writer_reserve(writer, record_size);
+        
+        u8 solution[9 * 9];
+        for (u32 j = 0; j < max_size; ++j)
+        {
+            bool given = (result->givens[j / 8] >> (j & 7)) & 1;
+            solution[j] = result->solved || given ? result->sudoku[j] : 0;
+        }
+        
+        CorpusStats stats = {};
+        stats.num_guess = result->num_guess;
+#if SUDOKU_STATS
+        stats.time_us = (u32)((result->stats.time_fill + result->stats.time_search) * 1e6);
+#endif
+        memcpy(record, result->givens, CORPUS_MASK_SIZE);
+        corpus_pack_cells(solution, record + CORPUS_MASK_SIZE);
+        memcpy(record + CORPUS_MASK_SIZE + CORPUS_NIBBLE_SIZE, &stats, CORPUS_STATS_SIZE);
+    }
+    writer->header.count += count;
+}
+
+// one solution count per line, same order as the input, "gave_up" when the budget cut the count
+void batch_write_counts(BatchWriter *writer, BatchResult *results, u32 count)
+{
+    for (u32 i = 0; i < count; ++i)
+    {
+        char *line = (char*)batch_writer_reserve(writer, 16);
+        if (results[i].gave_up)
+            writer->used -= 16 - sprintf(line, "gave_up\n");
+        else
+            writer->used -= 16 - sprintf(line, "%u\n", results[i].num_solutions);
+    }
+}
+
+// score and hardest technique per line, same order as the input
+void batch_write_grades(BatchWriter *writer, BatchResult *results, u32 count)
+{
+    for (u32 i = 0; i < count; ++i)
+    {
+        char *line = (char*)batch_writer_reserve(writer, 32);
+        if (results[i].solved)
+            writer->used -= 32 - sprintf(line, "%u %s\n", results[i].grade_score, sudoku_technique_names[results[i].grade_hardest]);
+        else if (results[i].rejected)
+            writer->used -= 32 - sprintf(line, "0 rejected\n");
+        else
+            writer->used -= 32 - sprintf(line, "0 unsolvable\n");
+    }
+}
+
+#if SUDOKU_STATS
+inline const char *batch_status_name(BatchResult *result)
+{
+    if (result->rejected) return "rejected";
+    if (result->solved) return "solved";
+    if (result->gave_up) return "gave_up";
+    return "failed";
+}
+
+// one csv row per puzzle, first_index is the index of results[0] in the data file
+void batch_write_stats_csv(FILE *out, BatchResult *results, u32 count, u64 first_index)
+{
+    char *buffer = (char*)malloc(BATCH_OUTPUT_BUFFER_SIZE);
+    u32 used = 0;
+    
+    if (first_index == 0)
+        used += sprintf(buffer, "puzzle,status,guesses,nodes,backtracks,propagations,eliminations,max_depth,fill_ns,search_ns,solve_ns\n");
+    
+    for (u32 i = 0; i < count; ++i)
+    {
+        if (used + 256 > BATCH_OUTPUT_BUFFER_SIZE)
+        {
+            fwrite(buffer, used, 1, out);
+            used = 0;
+        }
+        
+        SudokuStats *stats = &results[i].stats;
+        used += sprintf(buffer + used, "%llu,%s,%llu,%llu,%llu,%llu,%llu,%u,%llu,%llu,%llu\n",
+                        first_index + i, batch_status_name(results + i), stats->guesses, stats->nodes,
+                        stats->backtracks, stats->propagations, stats->eliminations, stats->max_depth,
+                        (u64)(stats->time_fill * 1e9), (u64)(stats->time_search * 1e9),
+                        (u64)((stats->time_fill + stats->time_search) * 1e9));
+    }
+    
+    if (used)
+        fwrite(buffer, used, 1, out);
+    
+    free(buffer);
+}
+
+void batch_write_histogram(FILE *out, const char *name, const char *help, const char *engine, BatchHistogram *histogram)
+{
+    fprintf(out, "# HELP %s %s\n", name, help);
+    fprintf(out, "# TYPE %s histogram\n", name);
+    
+    u64 cumulative = 0;
+    double bound = 1e-6;
+    for (u32 k = 0; k < BATCH_HISTOGRAM_BUCKETS; ++k, bound *= 2)
+    {
+        cumulative += histogram->buckets[k];
+        fprintf(out, "%s_bucket{engine=\"%s\",le=\"%g\"} %llu\n", name, engine, bound, cumulative);
+    }
+    fprintf(out, "%s_bucket{engine=\"%s\",le=\"+Inf\"} %llu\n", name, engine, histogram->count);
+    fprintf(out, "%s_sum{engine=\"%s\"} %.9f\n", name, engine, histogram->sum);
+    fprintf(out, "%s_count{engine=\"%s\"} %llu\n", name, engine, histogram->count);
+}
+
+void batch_write_counter(FILE *out, const char *name, const char *help, const char *engine, u64 value)
+{
+    fprintf(out, "# HELP %s %s\n", name, help);
+    fprintf(out, "# TYPE %s counter\n", name);
+    fprintf(out, "%s{engine=\"%s\"} %llu\n", name, engine, value);
+}
+
+// prometheus text format, one file for the whole run
+void batch_write_stats_summary(FILE *out, const char *engine, SudokuStats *total, BatchHistogram *solve_latency, BatchHistogram *search_latency,
+                               u64 solved_count, u64 failed_count, u64 gave_up_count)
+{
+    fprintf(out, "# HELP sudoku_puzzles_total Puzzles by result.\n");
+    fprintf(out, "# TYPE sudoku_puzzles_total counter\n");
+    fprintf(out, "sudoku_puzzles_total{engine=\"%s\",result=\"solved\"} %llu\n", engine, solved_count);
+    fprintf(out, "sudoku_puzzles_total{engine=\"%s\",result=\"failed\"} %llu\n", engine, failed_count);
+    fprintf(out, "sudoku_puzzles_total{engine=\"%s\",result=\"gave_up\"} %llu\n", engine, gave_up_count);
+    
+    batch_write_counter(out, "sudoku_nodes_total", "Search calls.", engine, total->nodes);
+    batch_write_counter(out, "sudoku_guesses_total", "Tried placements.", engine, total->guesses);
+    batch_write_counter(out, "sudoku_backtracks_total", "Tried placements taken back.", engine, total->backtracks);
+    batch_write_counter(out, "sudoku_propagations_total", "Cells placed by propagation.", engine, total->propagations);
+    batch_write_counter(out, "sudoku_eliminations_total", "Candidates removed.", engine, total->eliminations);
+    
+    fprintf(out, "# HELP sudoku_max_depth Deepest guess path of any puzzle.\n");
+    fprintf(out, "# TYPE sudoku_max_depth gauge\n");
+    fprintf(out, "sudoku_max_depth{engine=\"%s\"} %u\n", engine, total->max_depth);
+    
+    fprintf(out, "# HELP sudoku_phase_seconds_total Time by phase, fill and search summed over threads.\n");
+    fprintf(out, "# TYPE sudoku_phase_seconds_total counter\n");
+    fprintf(out, "sudoku_phase_seconds_total{engine=\"%s\",phase=\"parse\"} %.9f\n", engine, total->time_parse);
+    fprintf(out, "sudoku_phase_seconds_total{engine=\"%s\",phase=\"fill\"} %.9f\n", engine, total->time_fill);
+    fprintf(out, "sudoku_phase_seconds_total{engine=\"%s\",phase=\"search\"} %.9f\n", engine, total->time_search);
+    fprintf(out, "sudoku_phase_seconds_total{engine=\"%s\",phase=\"output\"} %.9f\n", engine, total->time_output);
+    
+    batch_write_histogram(out, "sudoku_solve_seconds", "Setup plus search time per puzzle.", engine, solve_latency);
+    batch_write_histogram(out, "sudoku_search_seconds", "Search time per puzzle.", engine, search_latency);
+}
+#endif
+
+// run proc over one block of puzzles already in batch->results with every worker
+void batch_solve_block(BatchContext *batch, thread_proc proc = batch_worker_proc)
+{
+    u32 num_threads = batch->num_workers;
+    
+    // even split to start with, stealing take care of the rest
+    for (u32 w = 0; w < num_threads; ++w)
+    {
+        BatchWorker *worker = batch->workers + w;
+        u32 begin = (u32)((u64)batch->puzzle_count * w / num_threads);
+        u32 end = (u32)((u64)batch->puzzle_count * (w + 1) / num_threads);
+        worker->range = batch_range(begin, end);
+    }
+    
+    // main thread is worker 0
+    for (u32 w = 1; w < num_threads; ++w)
+        thread_create(&batch->workers[w].thread, proc, batch->workers + w);
+    proc(batch->workers);
+    for (u32 w = 1; w < num_threads; ++w)
+        thread_join(&batch->workers[w].thread);
+}
+
+// solve every puzzle of a data file with num_threads workers (0 = one per core)
+// solutions are written to out_fname (stdout when 0) in input order.
+// the count engine write the number of solutions instead, stopping at count_limit (0 = all),
+// the grade engine a score and the hardest technique used
+// the file is streamed BATCH_BLOCK_SIZE puzzles at a time so memory stay bounded
+// max_nodes / timeout (secs) bound every puzzle, puzzles that run out are reported as gave up
+// SUDOKU_STATS builds can also write per puzzle counters to stats_csv and a prometheus summary to stats_summary
+// binary output write a corpus (given mask, solution, guesses and solve time) and need out_fname
+// use_cache solve every puzzle once up to symmetry and answer later copies from the cache,
+// only for the one puzzle at a time engines that write solutions (not simd, count or grade)
+bool solve_data_file_mt(char *fname, char *out_fname = 0, u32 num_threads = 0, BatchEngine engine = BATCH_ENGINE_HEURISTIC, u32 count_limit = 2, u64 max_nodes = 0, double timeout = 0,
+                        char *stats_csv = 0, char *stats_summary = 0, BatchOutput output = BATCH_OUTPUT_TEXT, bool use_cache = false)
+{
+    if (output == BATCH_OUTPUT_BINARY && (!out_fname || engine == BATCH_ENGINE_COUNT || engine == BATCH_ENGINE_GRADE))
+        return false;
+    
+    DataReader reader;
+    if (!data_reader_open(&reader, fname))
+        return false;
+    
+    FILE *out = out_fname ? fopen(out_fname, "wb") : stdout;
+    if (!out)
+    {
+        data_reader_close(&reader);
+        return false;
+    }
+    
+    BatchWriter writer;
+    batch_writer_open(&writer, out, output);
+    
+#if SUDOKU_STATS
+    FILE *csv = stats_csv ? fopen(stats_csv, "wb") : 0;
+#else
+    (void)stats_csv;
+    (void)stats_summary;
+#endif
+    
+    const u32 max_row = 9;
+    const u32 max_size = 9 * 9;
+    
+    if (!num_threads)
+        num_threads = platform_core_count();
+    
+    BatchContext batch = {};
+    batch.engine = engine;
+    batch.chunk_size = BATCH_CHUNK_SIZE;
+    batch.count_limit = count_limit;
+    batch.max_nodes = max_nodes;
+    batch.timeout = timeout;
+    if (engine == BATCH_ENGINE_SIMD)
+    {
+        simd_init_tables();
+        batch.chunk_size = SIMD_LANES;
+    }
+    else if (engine == BATCH_ENGINE_SUBSETS || engine == BATCH_ENGINE_GRADE)
+    {
+        sudoku_subset_table_init();
+    }
+    else if (engine == BATCH_ENGINE_BOARD)
+    {
+        sudoku_board_init_tables();
+    }
+    batch.results = (BatchResult*)malloc(BATCH_BLOCK_SIZE * sizeof(BatchResult));
+    batch.num_workers = num_threads;
+    batch.workers = (BatchWorker*)calloc(num_threads, sizeof(BatchWorker));
+    for (u32 w = 0; w < num_threads; ++w)
+    {
+        batch.workers[w].batch = &batch;
+        batch.workers[w].worker_index = w;
+    }
+    
+    SudokuCache cache;
+    if (use_cache && engine != BATCH_ENGINE_SIMD && engine != BATCH_ENGINE_COUNT && engine != BATCH_ENGINE_GRADE)
+    {
+        sudoku_cache_init(&cache, BATCH_CACHE_SIZE);
+        batch.cache = &cache;
+        batch.leaders = (u32*)malloc(BATCH_BLOCK_SIZE * 2 * sizeof(u32));
+    }
+    
+    u64 puzzle_count = 0;
+    u64 none_count = 0;
+    u64 multiple_count = 0;
+    u64 grade_counts[SUDOKU_TECH_COUNT] = {}; // puzzles by hardest technique
+    u64 grade_score = 0;
+    double time_parse = 0;
+    double time_solve = 0;
+    double time_output = 0;
+    
+    for (;;)
+    {
+        double time_start = platform_time();
+        batch.puzzle_count = 0;
+        while (batch.puzzle_count < BATCH_BLOCK_SIZE)
+        {
+            BatchResult *result = batch.results + batch.puzzle_count;
+            if (!data_reader_next(&reader, result->sudoku, max_row, max_size, &result->rejected))
+                break;
+            if (result->rejected)
+            {
+                // empty board, the text output get an all '.' line, count 0 and grade "0 rejected"
+                result->solved = false;
+                result->gave_up = false;
+                result->num_guess = 0;
+                result->num_solutions = 0;
+#if SUDOKU_STATS
+                memset(&result->stats, 0, sizeof(SudokuStats));
+#endif
+            }
+            if (output == BATCH_OUTPUT_BINARY)
+                corpus_pack_mask(result->sudoku, result->givens);
+            result->cached = false;
+            result->leader = batch.puzzle_count;
+            ++batch.puzzle_count;
+        }
+        
+        if (!batch.puzzle_count)
+            break;
+        
+        double time_solve_start = platform_time();
+        time_parse += time_solve_start - time_start;
+        
+        if (batch.cache)
+        {
+            batch_solve_block(&batch, batch_key_proc);
+            batch_cache_leaders(&batch);
+        }
+        batch_solve_block(&batch);
+        if (batch.cache)
+            batch_cache_finish(&batch);
+        
+        double time_output_start = platform_time();
+        time_solve += time_output_start - time_solve_start;
+        
+        if (engine == BATCH_ENGINE_COUNT)
+        {
+            batch_write_counts(&writer, batch.results, batch.puzzle_count);
+            for (u32 i = 0; i < batch.puzzle_count; ++i)
+            {
+                u32 solutions = batch.results[i].num_solutions;
+                if (batch.results[i].rejected || batch.results[i].gave_up) continue;
+                if (solutions == 0) ++none_count;
+                else if (solutions > 1) ++multiple_count;
+            }
+        }
+        else if (engine == BATCH_ENGINE_GRADE)
+        {
+            batch_write_grades(&writer, batch.results, batch.puzzle_count);
+            for (u32 i = 0; i < batch.puzzle_count; ++i)
+            {
+                if (!batch.results[i].solved) continue;
+                ++grade_counts[batch.results[i].grade_hardest];
+                grade_score += batch.results[i].grade_score;
+            }
+        }
+        else
+        {
+            batch_write_results(&writer, batch.results, batch.puzzle_count);
+        }
+#if SUDOKU_STATS
+        if (csv)
+            batch_write_stats_csv(csv, batch.results, batch.puzzle_count, puzzle_count);
+#endif
+        time_output += platform_time() - time_output_start;
+        
+        puzzle_count += batch.puzzle_count;
+    }
+    
+    batch_writer_close(&writer);
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(stdout);
+    data_reader_close(&reader);
+    
+    u64 total_guess = 0;
+    u64 solved_count = 0;
+    u64 failed_count = 0;
+    u64 gave_up_count = 0;
+    u64 cache_hit_count = 0;
+    u32 steal_count = 0;
+    for (u32 w = 0; w < num_threads; ++w)
+    {
+        total_guess += batch.workers[w].total_guess;
+        cache_hit_count += batch.workers[w].cache_hit_count;
+        solved_count += batch.workers[w].solved_count;
+        failed_count += batch.workers[w].failed_count;
+        gave_up_count += batch.workers[w].gave_up_count;
+        steal_count += batch.workers[w].steal_count;
+    }
+    
+    // summary go to stderr so stdout stay a clean solution stream
+    u64 count = puzzle_count ? puzzle_count : 1;
+    fprintf(stderr, "Total guess/problem %lld/%lld=%lld\n", total_guess, puzzle_count, total_guess/count);
+    fprintf(stderr, "Solved: %lld, Failed: %lld, Gave up: %lld, Threads: %d, Steals: %d, Engine: %s\n", solved_count, failed_count, gave_up_count, num_threads, steal_count, batch_engine_names[engine]);
+    if (reader.rejected_count)
+        fprintf(stderr, "Rejected lines: %lld\n", reader.rejected_count);
+    if (engine == BATCH_ENGINE_COUNT)
+        fprintf(stderr, "Unique: %lld, Multiple: %lld, None: %lld, Limit: %d\n", solved_count, multiple_count, none_count, count_limit);
+    if (engine == BATCH_ENGINE_GRADE)
+    {
+        fprintf(stderr, "Average score: %f, Hardest:", solved_count ? (double)grade_score / solved_count : 0.0);
+        for (u32 t = SUDOKU_TECH_HIDDEN_SINGLE; t < SUDOKU_TECH_COUNT; ++t)
+            fprintf(stderr, " %s %lld", sudoku_technique_names[t], grade_counts[t]);
+        fprintf(stderr, "\n");
+    }
+    if (batch.cache)
+        fprintf(stderr, "Cache hits: %lld, Forms: %d\n", cache_hit_count, batch.cache->count);
+    fprintf(stderr, "Time parse: %f secs, solve: %f secs, output: %f secs\n", time_parse, time_solve, time_output);
+    fprintf(stderr, "Puzzles/sec: %f, us/puzzle: %f\n", puzzle_count / (time_solve > 0 ? time_solve : 1e-9), time_solve * 1e6 / count);
+    
+#if SUDOKU_STATS
+    if (csv)
+        fclose(csv);
+    
+    SudokuStats total = {};
+    BatchHistogram solve_latency = {};
+    BatchHistogram search_latency = {};
+    for (u32 w = 0; w < num_threads; ++w)
+    {
+        sudoku_stats_add(&total, &batch.workers[w].stats);
+        batch_histogram_merge(&solve_latency, &batch.workers[w].solve_latency);
+        batch_histogram_merge(&search_latency, &batch.workers[w].search_latency);
+    }
+    total.time_parse = time_parse;
+    total.time_output = time_output;
+    
+    fprintf(stderr, "Nodes: %lld, Backtracks: %lld, Propagations: %lld, Eliminations: %lld, Max depth: %d\n",
+            total.nodes, total.backtracks, total.propagations, total.eliminations, total.max_depth);
+    
+    FILE *summary = stats_summary ? fopen(stats_summary, "wb") : 0;
+    if (summary)
+    {
+        batch_write_stats_summary(summary, batch_engine_names[engine], &total, &solve_latency, &search_latency,
+                                  solved_count, failed_count, gave_up_count);
+        fclose(summary);
+    }
+#endif
+    
+    if (batch.cache)
+    {
+        sudoku_cache_free(batch.cache);
+        free(batch.leaders);
+    }
+    free(batch.workers);
+    free(batch.results);
+    
+    return failed_count == 0 && gave_up_count == 0 && reader.rejected_count == 0;
+}
+
+// parallel generator, puzzle k always come from rng seeded with seed + k so the
+// output only depend on seed, count and clues, not on the thread count
+struct GenerateContext {
+    BatchResult *results;
+    u32 puzzle_count;
+    u64 first_index;
+    u64 seed;
+    u32 target_clues;
+    volatile u32 next;
+};
+
+struct GenerateWorker {
+    Thread thread;
+    GenerateContext *gen;
+    u64 clue_total;
+    u64 missed_count; // puzzles that could not reach target_clues
+};
+
+void generate_worker_proc(void *param)
+{
+    GenerateWorker *worker = (GenerateWorker*)param;
+    GenerateContext *gen = worker->gen;
+    
+    SudokuDlx *dlx = (SudokuDlx*)malloc(sizeof(SudokuDlx));
+    SudokuTrail *trail = (SudokuTrail*)malloc(sizeof(SudokuTrail));
+    
+    for (;;)
+    {
+        u32 k = atomic_add_u32(&gen->next, 1) - 1;
+        if (k >= gen->puzzle_count)
+            break;
+        
+        SudokuRng rng;
+        sudoku_rng_seed(&rng, gen->seed + gen->first_index + k);
+        
+        BatchResult *result = gen->results + k;
+        u32 clues = sudoku_generate(result->sudoku, 9, 9, 3, gen->target_clues, &rng, dlx, trail);
+        worker->clue_total += clues;
+        if (clues > gen->target_clues)
+            ++worker->missed_count;
+    }
+    
+    free(trail);
+    free(dlx);
+}
+
+// generate count unique puzzles with target_clues clues into out_fname (stdout when 0),
+// one 81 char line per puzzle with '.' for blanks
+bool generate_data_file_mt(u64 count, u32 target_clues, u64 seed = 0, u32 num_threads = 0, char *out_fname = 0)
+{
+    FILE *out = out_fname ? fopen(out_fname, "wb") : stdout;
+    if (!out)
+        return false;
+    
+    BatchWriter writer;
+    batch_writer_open(&writer, out, BATCH_OUTPUT_TEXT);
+    
+    if (!num_threads)
+        num_threads = platform_core_count();
+    if (!seed)
+        seed = (u64)time(NULL);
+    
+    GenerateContext gen = {};
+    gen.seed = seed;
+    gen.target_clues = target_clues;
+    gen.results = (BatchResult*)malloc(BATCH_BLOCK_SIZE * sizeof(BatchResult));
+    GenerateWorker *workers = (GenerateWorker*)calloc(num_threads, sizeof(GenerateWorker));
+    for (u32 w = 0; w < num_threads; ++w)
+        workers[w].gen = &gen;
+    
+    double time_start = platform_time();
+    double time_output = 0;
+    for (u64 done = 0; done < count; done += gen.puzzle_count)
+    {
+        gen.first_index = done;
+        gen.puzzle_count = (u32)(count - done < BATCH_BLOCK_SIZE ? count - done : BATCH_BLOCK_SIZE);
+        gen.next = 0;
+        
+        for (u32 w = 1; w < num_threads; ++w)
+            thread_create(&workers[w].thread, generate_worker_proc, workers + w);
+        generate_worker_proc(workers);
+        for (u32 w = 1; w < num_threads; ++w)
+            thread_join(&workers[w].thread);
+        
+        double time_output_start = platform_time();
+        batch_write_results(&writer, gen.results, gen.puzzle_count);
+        time_output += platform_time() - time_output_start;
+    }
+    batch_writer_close(&writer);
+    double time_total = platform_time() - time_start;
+    
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(stdout);
+    
+    u64 clue_total = 0;
+    u64 missed_count = 0;
+    for (u32 w = 0; w < num_threads; ++w)
+    {
+        clue_total += workers[w].clue_total;
+        missed_count += workers[w].missed_count;
+    }
+    
+    double time_generate = time_total - time_output;
+    fprintf(stderr, "Generated: %lld, Target clues: %d, Average clues: %f, Missed target: %lld\n", count, target_clues, count ? (double)clue_total / count : 0.0, missed_count);
+    fprintf(stderr, "Seed: %llu, Threads: %d\n", seed, num_threads);
+    fprintf(stderr, "Time generate: %f secs, output: %f secs, Puzzles/sec: %f\n", time_generate, time_output, count / (time_generate > 0 ? time_generate : 1e-9));
+    
+    free(workers);
+    free(gen.results);
+    
+    return true;
+}
+
+// corpus dedupe: workers canonicalize a block, the main thread then keep the
+// first puzzle of every form in input order
+struct DedupeContext {
+    BatchResult *results;
+    u32 puzzle_count;
+    volatile u32 next;
+};
+
+struct DedupeWorker {
+    Thread thread;
+    DedupeContext *dedupe;
+};
+
+void dedupe_worker_proc(void *param)
+{
+    DedupeWorker *worker = (DedupeWorker*)param;
+    DedupeContext *dedupe = worker->dedupe;
+    for (;;)
+    {
+        u32 k = atomic_add_u32(&dedupe->next, 1) - 1;
+        if (k >= dedupe->puzzle_count)
+            break;
+        
+        BatchResult *result = dedupe->results + k;
+        result->canon_hash = sudoku_canon_key(result->sudoku, result->canon, &result->transform);
+    }
+}
+
+// write every puzzle of fname whose canonical form wasn't seen before to out_fname (stdout when 0).
+// the set hold max_forms forms, past that new forms are written unchecked
+bool dedupe_data_file(char *fname, char *out_fname = 0, u32 num_threads = 0, u32 max_forms = 1024 * 1024)
+{
+    const u32 max_row = 9;
+    const u32 max_size = 9 * 9;
+    
+    DataReader reader;
+    if (!data_reader_open(&reader, fname))
+        return false;
+    
+    FILE *out = out_fname ? fopen(out_fname, "wb") : stdout;
+    if (!out)
+    {
+        data_reader_close(&reader);
+        return false;
+    }
+    
+    BatchWriter writer;
+    batch_writer_open(&writer, out, BATCH_OUTPUT_TEXT);
+    
+    if (!num_threads)
+        num_threads = platform_core_count();
+    
+    SudokuCache forms;
+    sudoku_cache_init(&forms, max_forms / 3 * 4);
+    
+    DedupeContext dedupe = {};
+    dedupe.results = (BatchResult*)malloc(BATCH_BLOCK_SIZE * sizeof(BatchResult));
+    DedupeWorker *workers = (DedupeWorker*)calloc(num_threads, sizeof(DedupeWorker));
+    for (u32 w = 0; w < num_threads; ++w)
+        workers[w].dedupe = &dedupe;
+    
+    u64 puzzle_count = 0;
+    u64 kept_count = 0;
+    u64 unchecked_count = 0;
+    double time_start = platform_time();
+    for (;;)
+    {
+        dedupe.puzzle_count = 0;
+        while (dedupe.puzzle_count < BATCH_BLOCK_SIZE &&
+               data_reader_next(&reader, dedupe.results[dedupe.puzzle_count].sudoku, max_row, max_size))
+            ++dedupe.puzzle_count;
+        
+        if (!dedupe.puzzle_count)
+            break;
+        
+        dedupe.next = 0;
+        for (u32 w = 1; w < num_threads; ++w)
+            thread_create(&workers[w].thread, dedupe_worker_proc, workers + w);
+        dedupe_worker_proc(workers);
+        for (u32 w = 1; w < num_threads; ++w)
+            thread_join(&workers[w].thread);
+        
+        for (u32 i = 0; i < dedupe.puzzle_count; ++i)
+        {
+            BatchResult *result = dedupe.results + i;
+            if (sudoku_cache_find(&forms, result->canon, result->canon_hash, 0))
+                continue;
+            
+            if (!sudoku_cache_insert(&forms, result->canon, result->canon_hash, 0))
+                ++unchecked_count;
+            batch_format_line(result->sudoku, batch_writer_reserve(&writer, max_size + 1));
+            ++kept_count;
+        }
+        puzzle_count += dedupe.puzzle_count;
+    }
+    batch_writer_close(&writer);
+    double time_total = platform_time() - time_start;
+    
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(stdout);
+    data_reader_close(&reader);
+    
+    fprintf(stderr, "Puzzles: %lld, Kept: %lld, Duplicates: %lld, Unchecked: %lld, Threads: %d\n",
+            puzzle_count, kept_count, puzzle_count - kept_count, unchecked_count, num_threads);
+    if (reader.rejected_count)
+        fprintf(stderr, "Rejected lines: %lld\n", reader.rejected_count);
+    fprintf(stderr, "Time: %f secs, us/puzzle: %f\n", time_total, time_total * 1e6 / (puzzle_count ? puzzle_count : 1));
+    
+    sudoku_cache_free(&forms);
+    free(workers);
+    free(dedupe.results);
+    
+    return true;
+}
@@ -0,0 +1,603 @@
+#include "immintrin.h"
+#include "platform.h"
+
+// board engine specialized at compile time on block size, include after sudoku.cpp
+//
+// side n = B * B, B = 2..5 gives 4x4 up to 25x25. with B known at compile time
+// every row / col / block stride is a constant so the divides and modulos of
+// valid() go away, and the candidate mask is u16 up to 9x9 and u32 above
+// (bit 0 unused, 25 digits need 26 bits). same algorithm as the trail heuristic
+// search with singles: min candidate cell, undo trail, no allocation per guess.
+//
+// board buffers must have SUDOKU_BOARD_PADDING bytes after the last cell,
+// the row checks load a whole vector past the end of the last row.
+// digits above 9 are written 'A' = 10, 'B' = 11, ... 'P' = 25
+
+#define SUDOKU_BOARD_MIN_BLOCK 2
+#define SUDOKU_BOARD_MAX_BLOCK 5
+#define SUDOKU_BOARD_MAX_SIDE (SUDOKU_BOARD_MAX_BLOCK * SUDOKU_BOARD_MAX_BLOCK)
+#define SUDOKU_BOARD_MAX_CELLS (SUDOKU_BOARD_MAX_SIDE * SUDOKU_BOARD_MAX_SIDE)
+#define SUDOKU_BOARD_PADDING 32
+
+template <u32 B> struct SudokuBoardMask { typedef u32 Type; };
+template <> struct SudokuBoardMask<2> { typedef u16 Type; };
+template <> struct SudokuBoardMask<3> { typedef u16 Type; };
+
+// cell to house lookups and the cells of every house, rows then cols then blocks
+template <u32 B>
+struct SudokuBoardTables {
+    enum { N = B * B, SIZE = N * N };
+    
+    bool ready;
+    u8 cell_row[SIZE];
+    u8 cell_col[SIZE];
+    u8 cell_box[SIZE];
+    u16 houses[3 * N][N];
+};
+
+// built on first use like simd_tables, call sudoku_board_init_tables before threads use the engine
+template <u32 B>
+SudokuBoardTables<B> *sudoku_board_tables()
+{
+    static SudokuBoardTables<B> tables;
+    if (tables.ready)
+        return &tables;
+    
+    const u32 N = B * B;
+    for (u32 i = 0; i < N * N; ++i)
+    {
+        tables.cell_row[i] = (u8)(i / N);
+        tables.cell_col[i] = (u8)(i % N);
+        tables.cell_box[i] = (u8)(i / N / B * B + i % N / B);
+    }
+    
+    for (u32 h = 0; h < N; ++h)
+    {
+        u32 start_block_index = h / B * B * N + h % B * B;
+        for (u32 k = 0; k < N; ++k)
+        {
+            tables.houses[h][k] = (u16)(h * N + k);
+            tables.houses[N + h][k] = (u16)(k * N + h);
+            tables.houses[2 * N + h][k] = (u16)(start_block_index + k / B * N + k % B);
+        }
+    }
+    
+    tables.ready = true;
+    return &tables;
+}
+
+void sudoku_board_init_tables()
+{
+    sudoku_board_tables<2>();
+    sudoku_board_tables<3>();
+    sudoku_board_tables<4>();
+    sudoku_board_tables<5>();
+}
+
+template <u32 B>
+struct SudokuBoard {
+    enum { N = B * B, SIZE = N * N, HOUSES = 3 * N };
+    typedef typename SudokuBoardMask<B>::Type Mask;
+    
+    u8 *sudoku;
+    SudokuBoardTables<B> *tables;
+    SudokuBudget *budget;
+    Mask all_mask;
+    
+    Mask used[HOUSES]; // same order as tables->houses
+    Mask possible[SIZE];
+};
+
+template <u32 B>
+struct SudokuBoardTrailEntry {
+    u16 index;
+    typename SudokuBoardMask<B>::Type bits; // 0 mean a digit was placed at index
+};
+
+// a search path place every cell at most once and remove every candidate at most once
+template <u32 B>
+struct SudokuBoardTrail {
+    enum { SIZE = B * B * B * B * (B * B + 1) };
+    
+    u32 count;
+    SudokuBoardTrailEntry<B> entries[SIZE];
+};
+
+inline u32 count_set_bits_u32(u32 n)
+{
+#ifdef _MSC_VER
+    return __popcnt(n);
+#else
+    return (u32)__builtin_popcount(n);
+#endif
+}
+
+// true when val is not in the row, one vector compare per row.
+// 9 wide rows reuse sse_is_valid_9, 25 wide rows take an avx2 compare when there is one
+template <u32 B> inline bool sudoku_board_row_free(u8 *row, u8 val)
+{
+    for (u32 k = 0; k < B * B; ++k)
+    {
+        if (row[k] == val)
+            return false;
+    }
+    return true;
+}
+
+template <> inline bool sudoku_board_row_free<3>(u8 *row, u8 val)
+{
+    return sse_is_valid_9(row, val);
+}
+
+template <> inline bool sudoku_board_row_free<4>(u8 *row, u8 val)
+{
+    __m128i row_bits = _mm_loadu_si128((__m128i*)row);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(row_bits, _mm_set1_epi8(val))) == 0;
+}
+
+template <> inline bool sudoku_board_row_free<5>(u8 *row, u8 val)
+{
+#ifdef __AVX2__
+    __m256i row_bits = _mm256_loadu_si256((__m256i*)row);
+    u32 hits = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(row_bits, _mm256_set1_epi8(val)));
+#else
+    __m128i mask = _mm_set1_epi8(val);
+    u32 lo = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)row), mask));
+    u32 hi = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)(row + 16)), mask));
+    u32 hits = lo | (hi << 16);
+#endif
+    return (hits & 0x1FFFFFF) == 0; // only 25 bytes belong to the row
+}
+
+// valid() with constant strides, row through the vector check
+template <u32 B>
+bool sudoku_board_valid(u8 *sudoku, u8 val, u32 index)
+{
+    const u32 N = B * B;
+    u32 row = index / N;
+    u32 col = index % N;
+    
+    if (!sudoku_board_row_free<B>(sudoku + row * N, val))
+        return false;
+    
+    for (u32 i = col; i < N * N; i += N)
+    {
+        if (sudoku[i] == val)
+            return false;
+    }
+    
+    u32 start_block_index = row / B * B * N + col / B * B;
+    for (u32 i = 0; i < B; ++i)
+    {
+        for (u32 j = 0; j < B; ++j)
+        {
+            if (sudoku[start_block_index + i * N + j] == val)
+                return false;
+        }
+    }
+    
+    return true;
+}
+
+// every cell filled and no digit twice in a house
+template <u32 B>
+bool sudoku_board_check(u8 *sudoku)
+{
+    for (u32 i = 0; i < B * B * B * B; ++i)
+    {
+        u8 val = sudoku[i];
+        if (!val || val > B * B)
+            return false;
+        
+        sudoku[i] = 0;
+        bool ok = sudoku_board_valid<B>(sudoku, val, i);
+        sudoku[i] = val;
+        if (!ok)
+            return false;
+    }
+    
+    return true;
+}
+
+template <u32 B>
+inline typename SudokuBoardMask<B>::Type sudoku_board_candidates(SudokuBoard<B> *board, u32 index)
+{
+    const u32 N = B * B;
+    SudokuBoardTables<B> *tables = board->tables;
+    return ~(board->used[tables->cell_row[index]] | board->used[N + tables->cell_col[index]] | board->used[2 * N + tables->cell_box[index]]) & board->all_mask;
+}
+
+// return false when the givens already conflict with each other
+template <u32 B>
+bool sudoku_board_init(SudokuBoard<B> *board, u8 *sudoku)
+{
+    typedef typename SudokuBoardMask<B>::Type Mask;
+    const u32 N = B * B;
+    
+    board->sudoku = sudoku;
+    board->tables = sudoku_board_tables<B>();
+    board->all_mask = (Mask)(((1ull << (N + 1)) - 1) & ~1ull);
+    memset(board->used, 0, sizeof(board->used));
+    
+    SudokuBoardTables<B> *tables = board->tables;
+    bool consistent = true;
+    for (u32 i = 0; i < N * N; ++i)
+    {
+        u8 val = sudoku[i];
+        if (!val) continue;
+        if (val > N) return false;
+        
+        Mask bit = (Mask)(1u << val);
+        Mask *row = board->used + tables->cell_row[i];
+        Mask *col = board->used + N + tables->cell_col[i];
+        Mask *box = board->used + 2 * N + tables->cell_box[i];
+        if ((*row | *col | *box) & bit)
+            consistent = false;
+        
+        *row |= bit;
+        *col |= bit;
+        *box |= bit;
+    }
+    
+    for (u32 i = 0; i < N * N; ++i)
+        board->possible[i] = sudoku[i] ? 0 : sudoku_board_candidates(board, i);
+    
+    return consistent;
+}
+
+template <u32 B>
+inline void sudoku_board_trail_remove(SudokuBoard<B> *board, SudokuBoardTrail<B> *trail, u32 index, typename SudokuBoardMask<B>::Type bits)
+{
+    assert(trail->count < SudokuBoardTrail<B>::SIZE);
+    SudokuBoardTrailEntry<B> *entry = trail->entries + trail->count++;
+    entry->index = (u16)index;
+    entry->bits = bits;
+    board->possible[index] &= ~bits;
+    SUDOKU_STAT_ADD(eliminations, count_set_bits_u32(bits));
+}
+
+template <u32 B>
+void sudoku_board_trail_undo(SudokuBoard<B> *board, SudokuBoardTrail<B> *trail, u32 mark)
+{
+    typedef typename SudokuBoardMask<B>::Type Mask;
+    const u32 N = B * B;
+    SudokuBoardTables<B> *tables = board->tables;
+    
+    while (trail->count > mark)
+    {
+        SudokuBoardTrailEntry<B> *entry = trail->entries + --trail->count;
+        u32 index = entry->index;
+        if (entry->bits) {
+            board->possible[index] |= entry->bits;
+        }
+        else {
+            Mask bit = (Mask)~(1u << board->sudoku[index]);
+            board->sudoku[index] = 0;
+            board->used[tables->cell_row[index]] &= bit;
+            board->used[N + tables->cell_col[index]] &= bit;
+            board->used[2 * N + tables->cell_box[index]] &= bit;
+        }
+    }
+}
+
+// place val at index and drop it from every peer, false when a peer run out of candidates
+template <u32 B>
+bool sudoku_board_place(SudokuBoard<B> *board, SudokuBoardTrail<B> *trail, u32 index, u8 val)
+{
+    typedef typename SudokuBoardMask<B>::Type Mask;
+    const u32 N = B * B;
+    SudokuBoardTables<B> *tables = board->tables;
+    
+    assert(trail->count < SudokuBoardTrail<B>::SIZE);
+    SudokuBoardTrailEntry<B> *entry = trail->entries + trail->count++;
+    entry->index = (u16)index;
+    entry->bits = 0;
+    
+    Mask bit = (Mask)(1u << val);
+    u32 houses[3] = { tables->cell_row[index], N + tables->cell_col[index], 2 * N + tables->cell_box[index] };
+    board->sudoku[index] = val;
+    
+    if (board->possible[index])
+        sudoku_board_trail_remove(board, trail, index, board->possible[index]);
+    
+    for (u32 h = 0; h < 3; ++h)
+    {
+        board->used[houses[h]] |= bit;
+        u16 *house = tables->houses[houses[h]];
+        for (u32 k = 0; k < N; ++k)
+        {
+            u32 i = house[k];
+            if (!(board->possible[i] & bit)) continue;
+            
+            sudoku_board_trail_remove(board, trail, i, bit);
+            if (!board->possible[i])
+                return false;
+        }
+    }
+    
+    return true;
+}
+
+// naked + hidden singles to fixpoint, same as sudoku_propagate_singles
+template <u32 B>
+bool sudoku_board_propagate(SudokuBoard<B> *board, SudokuBoardTrail<B> *trail)
+{
+    typedef typename SudokuBoardMask<B>::Type Mask;
+    const u32 N = B * B;
+    
+    for (;;)
+    {
+        bool changed = false;
+        
+        for (u32 i = 0; i < N * N; ++i)
+        {
+            Mask m = board->possible[i];
+            if (board->sudoku[i] || (m & (m - 1))) continue;
+            if (!m) return false;
+            
+            u8 val = (u8)lowest_bit_index(m);
+            if (!(sudoku_board_candidates(board, i) & m)) return false;
+            SUDOKU_STAT_ADD(propagations, 1);
+            if (!sudoku_board_place(board, trail, i, val)) return false;
+            changed = true;
+        }
+        
+        for (u32 h = 0; h < 3 * N; ++h)
+        {
+            u16 *house = board->tables->houses[h];
+            Mask once = 0;
+            Mask twice = 0;
+            for (u32 k = 0; k < N; ++k)
+            {
+                Mask m = board->possible[house[k]];
+                twice |= once & m;
+                once |= m;
+            }
+            
+            if ((once | board->used[h]) != board->all_mask)
+                return false;
+            
+            Mask unique = once & ~twice;
+            if (!unique) continue;
+            
+            for (u32 k = 0; k < N; ++k)
+            {
+                u32 index = house[k];
+                Mask hidden = board->possible[index] & unique;
+                if (!hidden) continue;
+                if (hidden & (hidden - 1)) return false;
+                
+                if (board->possible[index] != hidden) {
+                    sudoku_board_trail_remove(board, trail, index, (Mask)(board->possible[index] & ~hidden));
+                    changed = true;
+                }
+            }
+        }
+        
+        if (!changed)
+            return true;
+    }
+}
+
+template <u32 B>
+bool sudoku_board_search(SudokuBoard<B> *board, SudokuBoardTrail<B> *trail, u32 *num_guess)
+{
+    if (sudoku_budget_spend(board->budget))
+        return false;
+    
+    typedef typename SudokuBoardMask<B>::Type Mask;
+    const u32 SIZE = B * B * B * B;
+    
+    u32 min_index = SIZE;
+    u32 min_count = B * B + 1;
+    for (u32 i = 0; i < SIZE; ++i)
+    {
+        if (board->sudoku[i]) continue;
+        
+        u32 count = count_set_bits_u32(board->possible[i]);
+        if (count < min_count) {
+            min_index = i;
+            min_count = count;
+            if (count <= 1) break;
+        }
+    }
+    
+    if (min_index == SIZE)
+        return true;
+    
+    for (Mask bits = board->possible[min_index]; bits; bits &= bits - 1)
+    {
+        u8 val = (u8)lowest_bit_index(bits);
+        if (num_guess) ++*num_guess;
+        SUDOKU_STAT_GUESS();
+        
+        u32 mark = trail->count;
+        if (sudoku_board_place(board, trail, min_index, val) &&
+            sudoku_board_propagate(board, trail) &&
+            sudoku_board_search(board, trail, num_guess))
+        {
+            return true;
+        }
+        
+        sudoku_board_trail_undo(board, trail, mark);
+        SUDOKU_STAT_BACKTRACK();
+        if (sudoku_budget_gave_up(board->budget)) return false;
+    }
+    
+    return false;
+}
+
+// solve in place with caller owned board and trail, board is untouched on failure
+template <u32 B>
+bool sudoku_board_solve(SudokuBoard<B> *board, SudokuBoardTrail<B> *trail, u8 *sudoku, u32 *num_guess, SudokuBudget *budget = 0)
+{
+    trail->count = 0;
+    SUDOKU_STAT_TIMER_BEGIN(time_fill_start);
+    if (!sudoku_board_init(board, sudoku))
+        return false;
+    SUDOKU_STAT_TIMER_END(time_fill_start, time_fill);
+    board->budget = budget;
+    
+    if (sudoku_board_propagate(board, trail) && sudoku_board_search(board, trail, num_guess))
+        return true;
+    
+    sudoku_board_trail_undo(board, trail, 0);
+    return false;
+}
+
+// runtime block size to the specialized engine, board and trail are big for 25x25 so they live on the heap
+bool sudoku_solve_board(u8 *sudoku, u32 block_size, u32 *num_guess, SudokuBudget *budget = 0)
+{
+    switch (block_size)
+    {
+#define SUDOKU_BOARD_CASE(B) \
+        case B: { \
+            SudokuBoard<B> *board = (SudokuBoard<B>*)malloc(sizeof(SudokuBoard<B>)); \
+            SudokuBoardTrail<B> *trail = (SudokuBoardTrail<B>*)malloc(sizeof(SudokuBoardTrail<B>)); \
+            bool ret = sudoku_board_solve<B>(board, trail, sudoku, num_guess, budget); \
+            free(trail); \
+            free(board); \
+            return ret; \
+        }
+        SUDOKU_BOARD_CASE(2)
+        SUDOKU_BOARD_CASE(3)
+        SUDOKU_BOARD_CASE(4)
+        SUDOKU_BOARD_CASE(5)
+#undef SUDOKU_BOARD_CASE
+    }
+    
+    return false;
+}
+
+bool sudoku_check_board(u8 *sudoku, u32 block_size)
+{
+    switch (block_size)
+    {
+        case 2: return sudoku_board_check<2>(sudoku);
+        case 3: return sudoku_board_check<3>(sudoku);
+        case 4: return sudoku_board_check<4>(sudoku);
+        case 5: return sudoku_board_check<5>(sudoku);
+    }
+    
+    return false;
+}
+
+// '.' or '0' is blank, '1'..'9' then 'A' = 10 up to 'P' = 25
+inline char sudoku_board_digit_char(u8 val)
+{
+    if (!val) return '.';
+    return val <= 9 ? (char)('0' + val) : (char)('A' + val - 10);
+}
+
+// one n * n char puzzle per line, any side from 4x4 to 25x25. solutions go to out_fname
+// (stdout when 0) one line per puzzle, '.' for unsolved cells, summary to stderr
+bool solve_data_file_board(char *fname, u32 block_size, char *out_fname = 0)
+{
+    if (block_size < SUDOKU_BOARD_MIN_BLOCK || block_size > SUDOKU_BOARD_MAX_BLOCK)
+        return false;
+    
+    DataReader reader;
+    if (!data_reader_open(&reader, fname))
+        return false;
+    
+    FILE *out = out_fname ? fopen(out_fname, "wb") : stdout;
+    if (!out)
+    {
+        data_reader_close(&reader);
+        return false;
+    }
+    
+    const u32 n = block_size * block_size;
+    const u32 max_size = n * n;
+    u8 sudoku[SUDOKU_BOARD_MAX_CELLS + SUDOKU_BOARD_PADDING] = {};
+    char text[SUDOKU_BOARD_MAX_CELLS + 1];
+    
+    u64 puzzle_count = 0;
+    u64 solved_count = 0;
+    u64 total_guess = 0;
+    double time_solve = 0;
+    
+    // rejected lines keep their output line, all '.'
+    bool rejected = false;
+    while (data_reader_next(&reader, sudoku, n, max_size, &rejected))
+    {
+        u32 num_guess = 0;
+        double time_start = platform_time();
+        bool ret = !rejected && sudoku_solve_board(sudoku, block_size, &num_guess) && sudoku_check_board(sudoku, block_size);
+        time_solve += platform_time() - time_start;
+        
+        ++puzzle_count;
+        if (ret) ++solved_count;
+        total_guess += num_guess;
+        
+        for (u32 i = 0; i < max_size; ++i)
+            text[i] = sudoku_board_digit_char(sudoku[i]);
+        text[max_size] = '\n';
+        fwrite(text, max_size + 1, 1, out);
+    }
+    
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(stdout);
+    data_reader_close(&reader);
+    
+    u64 count = puzzle_count ? puzzle_count : 1;
+    fprintf(stderr, "Board %dx%d, Solved: %lld, Failed: %lld\n", n, n, solved_count, puzzle_count - solved_count);
+    if (reader.rejected_count)
+        fprintf(stderr, "Rejected lines: %lld\n", reader.rejected_count);
+    fprintf(stderr, "Total guess/problem %lld/%lld=%lld\n", total_guess, puzzle_count, total_guess/count);
+    fprintf(stderr, "Time solve: %f secs, us/puzzle: %f\n", time_solve, time_solve * 1e6 / count);
+    
+    return solved_count == puzzle_count;
+}
+
+// the run_tests puzzles on the 9x9 engine, then a pattern grid per block size with most cells blanked
+void run_board_tests(bool print_result)
+{
+    sudoku_board_init_tables();
+    u8 sudoku[SUDOKU_BOARD_MAX_CELLS + SUDOKU_BOARD_PADDING] = {};
+    u8 solution[SUDOKU_BOARD_MAX_CELLS + SUDOKU_BOARD_PADDING] = {};
+    u32 num_guess = 0;
+    
+    for (u32 k = 0; k < SUDOKU_TEST_FILES; ++k)
+    {
+        bool read = sudoku_load_test(k, sudoku, solution);
+        assert(read);
+        
+        bool solved = sudoku_solve_board(sudoku, 3, &num_guess);
+        assert(solved);
+        assert(memcmp(sudoku, solution, 81) == 0);
+    }
+    
+    for (u32 b = SUDOKU_BOARD_MIN_BLOCK; b <= SUDOKU_BOARD_MAX_BLOCK; ++b)
+    {
+        const u32 n = b * b;
+        memset(sudoku, 0, sizeof(sudoku));
+        for (u32 r = 0; r < n; ++r)
+        {
+            for (u32 c = 0; c < n; ++c)
+                solution[r * n + c] = (u8)((b * (r % b) + r / b + c) % n + 1);
+        }
+        assert(sudoku_check_board(solution, b));
+        
+        // keep about a third of the cells, hashed so the blanks spread over every house
+        u8 givens[SUDOKU_BOARD_MAX_CELLS];
+        for (u32 i = 0; i < n * n; ++i)
+            givens[i] = ((i * 2654435761u) >> 24) % 3 == 0 ? solution[i] : 0;
+        
+        memcpy(sudoku, givens, n * n);
+        bool solved = sudoku_solve_board(sudoku, b, &num_guess);
+        assert(solved);
+        assert(sudoku_check_board(sudoku, b));
+        for (u32 i = 0; i < n * n; ++i)
+            assert(!givens[i] || sudoku[i] == givens[i]);
+        
+        // the same digit twice in the first row, no solution
+        memcpy(sudoku, givens, n * n);
+        sudoku[0] = sudoku[1] = 1;
+        assert(!sudoku_solve_board(sudoku, b, &num_guess));
+        
+        if (print_result) printf("board %ux%u: %u guesses\n", n, n, num_guess);
+    }
+}
@@ -0,0 +1,482 @@
+// symmetry canonical form of 9x9 puzzles and a solution cache keyed by it, include after sudoku.cpp
+//
+// a puzzle stay the same puzzle under digit relabeling, band and stack swaps, row and
+// col swaps inside a band or stack and transposition. the canonical form is the
+// smallest grid (row major, blank lowest) over the transforms that keep bands, rows,
+// stacks and cols sorted by invariants of the given pattern, digits relabeled in order
+// of first appearance. the invariants only depend on where the givens are, so every
+// copy of a puzzle sort the same way and end on the same grid, and only the
+// transforms between equal invariants have to be tried (usually one or two).
+// a canonical form is always a transform of the puzzle, so two puzzles with the same
+// form are copies of each other and a solution move from one to the other.
+// patterns with a lot of symmetry (full grids) tie everywhere, the search stop after
+// CANON_MAX_TRIES transforms and keep the best so far: still a transform of the
+// puzzle, only copies of it may land on another form
+
+#define CANON_CELLS (9 * 9)
+#define CANON_MAX_TRIES 1024
+
+struct SudokuTransform {
+    bool transpose;
+    u8 rows[9];     // canonical row i is row rows[i] (after the transpose)
+    u8 cols[9];
+    u8 relabel[10]; // digit to canonical digit, 0 stay 0
+};
+
+// every permutation of 3 items, perms that keep a sorted order are picked from here
+static u8 canon_perms[6][3] = {
+    {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0},
+};
+
+// row and col invariants: the given count, then a sum over the givens of the count of
+// their col (row) and box, so it doesn't change with the order of anything. the
+// definition is the same for rows and cols, transposing the puzzle swap the two arrays
+void sudoku_canon_invariants(u8 *sudoku, u32 *row_inv, u32 *col_inv)
+{
+    u32 row_count[9] = {};
+    u32 col_count[9] = {};
+    u32 box_count[9] = {};
+    for (u32 r = 0; r < 9; ++r)
+    {
+        for (u32 c = 0; c < 9; ++c)
+        {
+            if (!sudoku[r * 9 + c])
+                continue;
+            ++row_count[r];
+            ++col_count[c];
+            ++box_count[r / 3 * 3 + c / 3];
+        }
+    }
+    
+    for (u32 i = 0; i < 9; ++i)
+    {
+        row_inv[i] = row_count[i] << 24;
+        col_inv[i] = col_count[i] << 24;
+    }
+    
+    for (u32 r = 0; r < 9; ++r)
+    {
+        for (u32 c = 0; c < 9; ++c)
+        {
+            if (!sudoku[r * 9 + c])
+                continue;
+            u32 box = box_count[r / 3 * 3 + c / 3];
+            u32 row_weight = col_count[c] * 10 + box;
+            u32 col_weight = row_count[r] * 10 + box;
+            row_inv[r] += row_weight * row_weight;
+            col_inv[c] += col_weight * col_weight;
+        }
+    }
+}
+
+inline void sudoku_canon_sort3(u64 *v)
+{
+    u64 t;
+    if (v[0] > v[1]) { t = v[0]; v[0] = v[1]; v[1] = t; }
+    if (v[1] > v[2]) { t = v[1]; v[1] = v[2]; v[2] = t; }
+    if (v[0] > v[1]) { t = v[0]; v[0] = v[1]; v[1] = t; }
+}
+
+// perms of the 3 items that list them in non decreasing order of keys, return the count
+u32 sudoku_canon_sorted_perms(u64 *keys, u8 *perms)
+{
+    u32 count = 0;
+    for (u32 p = 0; p < 6; ++p)
+    {
+        u8 *perm = canon_perms[p];
+        if (keys[perm[0]] <= keys[perm[1]] && keys[perm[1]] <= keys[perm[2]])
+            perms[count++] = (u8)p;
+    }
+    return count;
+}
+
+// group (band or stack) keys, a hash of the sorted invariants of its lines so the
+// order of the lines inside don't matter
+void sudoku_canon_group_keys(u32 *line_inv, u64 *keys)
+{
+    for (u32 g = 0; g < 3; ++g)
+    {
+        u64 lines[3] = {line_inv[3 * g], line_inv[3 * g + 1], line_inv[3 * g + 2]};
+        sudoku_canon_sort3(lines);
+        keys[g] = (lines[0] * 0x100000001B3ull + lines[1]) * 0x100000001B3ull + lines[2];
+    }
+}
+
+// the sorted group keys of one side, the side with the smaller key become the rows
+int sudoku_canon_compare_sides(u32 *row_inv, u32 *col_inv)
+{
+    u64 row_key[3];
+    u64 col_key[3];
+    sudoku_canon_group_keys(row_inv, row_key);
+    sudoku_canon_group_keys(col_inv, col_key);
+    sudoku_canon_sort3(row_key);
+    sudoku_canon_sort3(col_key);
+    
+    for (u32 k = 0; k < 3; ++k)
+    {
+        if (row_key[k] != col_key[k])
+            return row_key[k] < col_key[k] ? -1 : 1;
+    }
+    return 0;
+}
+
+// the sorted orders of one side: group perms, and line perms inside each group
+struct SudokuCanonSide {
+    u8 group_perms[6];
+    u32 group_count;
+    u8 line_perms[3][6];
+    u32 line_count[3];
+};
+
+void sudoku_canon_side(u32 *line_inv, SudokuCanonSide *side)
+{
+    u64 keys[3];
+    sudoku_canon_group_keys(line_inv, keys);
+    side->group_count = sudoku_canon_sorted_perms(keys, side->group_perms);
+    
+    for (u32 g = 0; g < 3; ++g)
+    {
+        u64 line_keys[3] = {line_inv[3 * g], line_inv[3 * g + 1], line_inv[3 * g + 2]};
+        side->line_count[g] = sudoku_canon_sorted_perms(line_keys, side->line_perms[g]);
+    }
+}
+
+// odometer index to the 9 lines of one side
+inline void sudoku_canon_lines(SudokuCanonSide *side, u32 *index, u8 *lines)
+{
+    u8 *group_perm = canon_perms[side->group_perms[index[0]]];
+    for (u32 i = 0; i < 3; ++i)
+    {
+        u32 g = group_perm[i];
+        u8 *line_perm = canon_perms[side->line_perms[g][index[1 + g]]];
+        for (u32 k = 0; k < 3; ++k)
+            lines[3 * i + k] = (u8)(3 * g + line_perm[k]);
+    }
+}
+
+// write the grid of one transform into out with digits relabeled in order of first
+// appearance, stop as soon as it can't beat best. true when out is smaller than best
+bool sudoku_canon_try(u8 *grid, u8 *rows, u8 *cols, u8 *best, bool have_best, u8 *out, u8 *relabel)
+{
+    u8 map[10] = {};
+    u8 next = 1;
+    bool less = !have_best;
+    
+    for (u32 i = 0; i < 9; ++i)
+    {
+        u8 *row = grid + rows[i] * 9;
+        for (u32 j = 0; j < 9; ++j)
+        {
+            u8 val = row[cols[j]];
+            if (val)
+            {
+                if (!map[val])
+                    map[val] = next++;
+                val = map[val];
+            }
+            
+            u32 k = i * 9 + j;
+            if (!less)
+            {
+                if (val > best[k])
+                    return false;
+                if (val < best[k])
+                    less = true;
+            }
+            out[k] = val;
+        }
+    }
+    
+    if (!less)
+        return false;
+    
+    // digits not in the puzzle take the labels left, so relabel stay a bijection
+    for (u32 d = 1; d <= 9; ++d)
+    {
+        if (!map[d])
+            map[d] = next++;
+    }
+    memcpy(relabel, map, sizeof(map));
+    return true;
+}
+
+// canonical form of sudoku and the transform that map sudoku to it
+void sudoku_canonicalize(u8 *sudoku, u8 *canonical, SudokuTransform *transform)
+{
+    u32 row_inv[9];
+    u32 col_inv[9];
+    sudoku_canon_invariants(sudoku, row_inv, col_inv);
+    
+    // transposed only when the cols sort first, both when they tie
+    int order = sudoku_canon_compare_sides(row_inv, col_inv);
+    
+    u8 grids[2][CANON_CELLS];
+    memcpy(grids[0], sudoku, CANON_CELLS);
+    for (u32 r = 0; r < 9; ++r)
+    {
+        for (u32 c = 0; c < 9; ++c)
+            grids[1][c * 9 + r] = sudoku[r * 9 + c];
+    }
+    
+    u8 candidate[CANON_CELLS];
+    bool have_best = false;
+    for (u32 t = 0; t < 2; ++t)
+    {
+        if ((t == 0 && order > 0) || (t == 1 && order < 0))
+            continue;
+        
+        SudokuCanonSide row_side;
+        SudokuCanonSide col_side;
+        sudoku_canon_side(t ? col_inv : row_inv, &row_side);
+        sudoku_canon_side(t ? row_inv : col_inv, &col_side);
+        
+        // odometer over the 4 choices of each side: group perm, line perm of each group
+        u32 row_index[4] = {};
+        u32 col_index[4] = {};
+        u32 row_limit[4] = {row_side.group_count, row_side.line_count[0], row_side.line_count[1], row_side.line_count[2]};
+        u32 col_limit[4] = {col_side.group_count, col_side.line_count[0], col_side.line_count[1], col_side.line_count[2]};
+        
+        for (u32 tries = 0; tries < CANON_MAX_TRIES; ++tries)
+        {
+            u8 rows[9];
+            u8 cols[9];
+            sudoku_canon_lines(&row_side, row_index, rows);
+            sudoku_canon_lines(&col_side, col_index, cols);
+            
+            u8 relabel[10];
+            if (sudoku_canon_try(grids[t], rows, cols, canonical, have_best, candidate, relabel))
+            {
+                memcpy(canonical, candidate, CANON_CELLS);
+                have_best = true;
+                transform->transpose = t != 0;
+                memcpy(transform->rows, rows, 9);
+                memcpy(transform->cols, cols, 9);
+                memcpy(transform->relabel, relabel, 10);
+            }
+            
+            u32 k = 0;
+            for (; k < 8; ++k)
+            {
+                u32 *index = k < 4 ? row_index + k : col_index + k - 4;
+                u32 limit = k < 4 ? row_limit[k] : col_limit[k - 4];
+                if (++*index < limit)
+                    break;
+                *index = 0;
+            }
+            if (k == 8)
+                break;
+        }
+    }
+}
+
+// puzzle or solution into the canonical space of transform
+void sudoku_transform_apply(SudokuTransform *transform, u8 *sudoku, u8 *out)
+{
+    for (u32 i = 0; i < 9; ++i)
+    {
+        for (u32 j = 0; j < 9; ++j)
+        {
+            u32 r = transform->rows[i];
+            u32 c = transform->cols[j];
+            u8 val = transform->transpose ? sudoku[c * 9 + r] : sudoku[r * 9 + c];
+            out[i * 9 + j] = transform->relabel[val];
+        }
+    }
+}
+
+// back from the canonical space, out get the grid of the original puzzle
+void sudoku_transform_invert(SudokuTransform *transform, u8 *canonical, u8 *out)
+{
+    u8 inverse[10];
+    for (u32 d = 0; d < 10; ++d)
+        inverse[transform->relabel[d]] = (u8)d;
+    
+    for (u32 i = 0; i < 9; ++i)
+    {
+        for (u32 j = 0; j < 9; ++j)
+        {
+            u32 r = transform->rows[i];
+            u32 c = transform->cols[j];
+            u8 val = inverse[canonical[i * 9 + j]];
+            if (transform->transpose)
+                out[c * 9 + r] = val;
+            else
+                out[r * 9 + c] = val;
+        }
+    }
+}
+
+// random symmetry: band and stack order, row and col order inside them, transpose and relabel
+void sudoku_transform_random(SudokuTransform *transform, SudokuRng *rng)
+{
+    transform->transpose = sudoku_rng_range(rng, 2) != 0;
+    for (u32 side = 0; side < 2; ++side)
+    {
+        u8 *lines = side ? transform->cols : transform->rows;
+        u8 *groups = canon_perms[sudoku_rng_range(rng, 6)];
+        for (u32 g = 0; g < 3; ++g)
+        {
+            u8 *perm = canon_perms[sudoku_rng_range(rng, 6)];
+            for (u32 l = 0; l < 3; ++l)
+                lines[g * 3 + l] = groups[g] * 3 + perm[l];
+        }
+    }
+    
+    u8 digits[9] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+    sudoku_rng_shuffle(rng, digits, 9);
+    transform->relabel[0] = 0;
+    for (u32 d = 0; d < 9; ++d)
+        transform->relabel[d + 1] = digits[d];
+}
+
+// fnv-1a of the packed canonical form, 0 is kept for empty slots
+inline u64 sudoku_canon_hash(u8 *packed)
+{
+    u64 hash = 0xCBF29CE484222325ull;
+    for (u32 i = 0; i < CORPUS_NIBBLE_SIZE; ++i)
+    {
+        hash ^= packed[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash ? hash : 1;
+}
+
+// solutions by canonical form, open addressing with linear probing. fixed capacity,
+// once 3/4 full new forms are dropped so memory stay bounded on any corpus. the
+// table is read by many threads at once, writes must not overlap with reads
+struct SudokuCacheEntry {
+    u64 hash;
+    u8 puzzle[CORPUS_NIBBLE_SIZE];   // canonical form
+    u8 solution[CORPUS_NIBBLE_SIZE]; // in the canonical space
+};
+
+struct SudokuCache {
+    SudokuCacheEntry *entries;
+    u32 capacity; // power of 2
+    u32 count;
+};
+
+void sudoku_cache_init(SudokuCache *cache, u32 capacity)
+{
+    u32 size = 1024;
+    while (size < capacity)
+        size *= 2;
+    
+    cache->entries = (SudokuCacheEntry*)calloc(size, sizeof(SudokuCacheEntry));
+    cache->capacity = size;
+    cache->count = 0;
+}
+
+void sudoku_cache_free(SudokuCache *cache)
+{
+    free(cache->entries);
+    cache->entries = 0;
+}
+
+// slot of the form, or the empty slot where it would go
+inline SudokuCacheEntry *sudoku_cache_slot(SudokuCache *cache, u8 *packed, u64 hash)
+{
+    u32 mask = cache->capacity - 1;
+    for (u32 i = (u32)hash & mask;; i = (i + 1) & mask)
+    {
+        SudokuCacheEntry *entry = cache->entries + i;
+        if (!entry->hash || (entry->hash == hash && memcmp(entry->puzzle, packed, CORPUS_NIBBLE_SIZE) == 0))
+            return entry;
+    }
+}
+
+// packed is the canonical form packed with corpus_pack_cells, solution get the canonical solution
+bool sudoku_cache_find(SudokuCache *cache, u8 *packed, u64 hash, u8 *solution)
+{
+    SudokuCacheEntry *entry = sudoku_cache_slot(cache, packed, hash);
+    if (!entry->hash)
+        return false;
+    
+    if (solution)
+    {
+        u8 cells[CANON_CELLS];
+        corpus_unpack_cells(entry->solution, cells);
+        memcpy(solution, cells, CANON_CELLS);
+    }
+    return true;
+}
+
+// false when the form was already there or the table is full, solution can be 0 (set of forms)
+bool sudoku_cache_insert(SudokuCache *cache, u8 *packed, u64 hash, u8 *solution)
+{
+    if (cache->count >= cache->capacity / 4 * 3)
+        return false;
+    
+    SudokuCacheEntry *entry = sudoku_cache_slot(cache, packed, hash);
+    if (entry->hash)
+        return false;
+    
+    entry->hash = hash;
+    memcpy(entry->puzzle, packed, CORPUS_NIBBLE_SIZE);
+    if (solution)
+        corpus_pack_cells(solution, entry->solution);
+    ++cache->count;
+    return true;
+}
+
+// canonical form of a puzzle packed and hashed for the cache
+inline u64 sudoku_canon_key(u8 *sudoku, u8 *packed, SudokuTransform *transform)
+{
+    u8 canonical[CANON_CELLS];
+    sudoku_canonicalize(sudoku, canonical, transform);
+    corpus_pack_cells(canonical, packed);
+    return sudoku_canon_hash(packed);
+}
+
+// same set as run_tests. every random copy of a puzzle must reach the canonical grid of the
+// puzzle through the transform it get back, and transforms must invert to where they started.
+// solutions only get the invert check, full grids can hit CANON_MAX_TRIES
+void run_canon_tests(bool print_result, u32 copies = 64, u64 seed = 1)
+{
+    SudokuRng rng;
+    sudoku_rng_seed(&rng, seed);
+    
+    for (u32 k = 0; k < SUDOKU_TEST_FILES; ++k)
+    {
+        u8 sudoku[CANON_CELLS];
+        u8 solution[CANON_CELLS];
+        bool read = sudoku_load_test(k, sudoku, solution);
+        assert(read);
+        
+        u8 canonical[CANON_CELLS];
+        SudokuTransform transform;
+        sudoku_canonicalize(sudoku, canonical, &transform);
+        
+        u8 copy[CANON_CELLS];
+        u8 copy_solution[CANON_CELLS];
+        u8 back[CANON_CELLS];
+        for (u32 c = 0; c < copies; ++c)
+        {
+            SudokuTransform random;
+            sudoku_transform_random(&random, &rng);
+            sudoku_transform_apply(&random, sudoku, copy);
+            sudoku_transform_apply(&random, solution, copy_solution);
+            
+            sudoku_transform_invert(&random, copy, back);
+            assert(memcmp(back, sudoku, CANON_CELLS) == 0);
+            sudoku_transform_invert(&random, copy_solution, back);
+            assert(memcmp(back, solution, CANON_CELLS) == 0);
+            
+            u8 copy_canonical[CANON_CELLS];
+            SudokuTransform copy_transform;
+            sudoku_canonicalize(copy, copy_canonical, &copy_transform);
+            assert(memcmp(copy_canonical, canonical, CANON_CELLS) == 0);
+            
+            sudoku_transform_apply(&copy_transform, copy, back);
+            assert(memcmp(back, copy_canonical, CANON_CELLS) == 0);
+            sudoku_transform_invert(&copy_transform, copy_canonical, back);
+            assert(memcmp(back, copy, CANON_CELLS) == 0);
+        }
+        
+        if (print_result)
+        {
+            printf("canon %u: %d copies\n", k, copies);
+            sudoku_print(canonical, CANON_CELLS);
+        }
+    }
+}
@@ -0,0 +1,586 @@
+// logical grader, include after sudoku.cpp
+//
+// solve the way a person would: every step use the easiest technique that still make
+// progress (place a digit or remove candidates) and start over from the easiest one.
+// the grade is the hardest technique the puzzle needed plus a score that sum the
+// weight of every step. when no technique apply, the open cell with the fewest
+// candidates get its digit from the solution and the step count as a guess, so
+// puzzles past the technique list still get a grade
+
+// ordered from easy to hard, a puzzle grade is the highest one it used
+enum SudokuTechnique {
+    SUDOKU_TECH_NONE,
+    SUDOKU_TECH_HIDDEN_SINGLE,
+    SUDOKU_TECH_NAKED_SINGLE,
+    SUDOKU_TECH_POINTING,     // digit of a box on one line leave the rest of the line
+    SUDOKU_TECH_CLAIMING,     // digit of a line in one box leave the rest of the box
+    SUDOKU_TECH_NAKED_PAIR,
+    SUDOKU_TECH_X_WING,
+    SUDOKU_TECH_HIDDEN_PAIR,
+    SUDOKU_TECH_NAKED_TRIPLE,
+    SUDOKU_TECH_SWORDFISH,
+    SUDOKU_TECH_HIDDEN_TRIPLE,
+    SUDOKU_TECH_XY_WING,
+    SUDOKU_TECH_GUESS,
+    SUDOKU_TECH_COUNT,
+};
+
+static const char *sudoku_technique_names[] = {
+    "none",
+    "hidden_single",
+    "naked_single",
+    "pointing",
+    "claiming",
+    "naked_pair",
+    "x_wing",
+    "hidden_pair",
+    "naked_triple",
+    "swordfish",
+    "hidden_triple",
+    "xy_wing",
+    "guess",
+};
+
+// score of one step in tenths, roughly the usual human difficulty ratings
+static u32 sudoku_technique_weights[] = {
+    0, 15, 23, 26, 28, 30, 32, 34, 36, 38, 40, 42, 100,
+};
+
+struct SudokuElimination {
+    u16 index;
+    u16 bits;
+};
+
+// one step: a placement (index < max_size) or a list of eliminations, plus the
+// cells and digits of the pattern that prove it
+struct SudokuDeduction {
+    SudokuTechnique technique;
+    u32 index;
+    u8 val;
+    
+    u16 digits;
+    u32 cell_count;
+    u16 cells[SUDOKU_MAX_SIDE];
+    
+    u32 elimination_count;
+    SudokuElimination eliminations[SUDOKU_MAX_CELLS];
+};
+
+struct SudokuGrade {
+    SudokuTechnique hardest;
+    u32 score;
+    u32 steps;
+    u32 counts[SUDOKU_TECH_COUNT]; // steps per technique
+};
+
+inline bool sudoku_grade_sees(SudokuState *state, u32 a, u32 b)
+{
+    return a != b && (state->cell_row[a] == state->cell_row[b] || state->cell_col[a] == state->cell_col[b] ||
+                      state->cell_box[a] == state->cell_box[b]);
+}
+
+inline void sudoku_deduction_begin(SudokuDeduction *deduction, SudokuTechnique technique, u32 max_size)
+{
+    deduction->technique = technique;
+    deduction->index = max_size;
+    deduction->val = 0;
+    deduction->digits = 0;
+    deduction->cell_count = 0;
+    deduction->elimination_count = 0;
+}
+
+inline void sudoku_deduction_eliminate(SudokuDeduction *deduction, u32 index, u16 bits)
+{
+    SudokuElimination *elimination = deduction->eliminations + deduction->elimination_count++;
+    elimination->index = (u16)index;
+    elimination->bits = bits;
+}
+
+inline void sudoku_deduction_place(SudokuDeduction *deduction, SudokuTechnique technique, u32 max_size, u32 index, u8 val)
+{
+    sudoku_deduction_begin(deduction, technique, max_size);
+    deduction->index = index;
+    deduction->val = val;
+    deduction->digits = (u16)(1 << val);
+    deduction->cells[deduction->cell_count++] = (u16)index;
+}
+
+bool sudoku_find_hidden_single(SudokuState *state, u16 *possible, SudokuDeduction *deduction)
+{
+    for (u32 h = 0; h < state->num_houses; ++h)
+    {
+        u16 unique = 0;
+        sudoku_house_unique(state, possible, h, &unique);
+        if (!unique) continue;
+        
+        u8 *house = state->houses[h];
+        for (u32 k = 0; k < state->max_col; ++k)
+        {
+            u16 bits = possible[house[k]] & unique;
+            if (bits)
+            {
+                sudoku_deduction_place(deduction, SUDOKU_TECH_HIDDEN_SINGLE, state->max_size, house[k], (u8)lowest_bit_index(bits));
+                return true;
+            }
+        }
+    }
+    
+    return false;
+}
+
+bool sudoku_find_naked_single(SudokuState *state, u16 *possible, SudokuDeduction *deduction)
+{
+    for (u32 i = 0; i < state->max_size; ++i)
+    {
+        u16 m = possible[i];
+        if (m && !(m & (m - 1)))
+        {
+            sudoku_deduction_place(deduction, SUDOKU_TECH_NAKED_SINGLE, state->max_size, i, (u8)lowest_bit_index(m));
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+// pointing: digit of a box that sit on one line leave the rest of the line
+// claiming: digit of a line that sit in one box leave the rest of the box
+bool sudoku_find_intersection(SudokuState *state, u16 *possible, SudokuDeduction *deduction, bool pointing)
+{
+    u32 n = state->max_row;
+    u32 from_begin = pointing ? 2 * n : 0;
+    u32 from_end = pointing ? 3 * n : 2 * n;
+    for (u32 h = from_begin; h < from_end; ++h)
+    {
+        u8 *house = state->houses[h];
+        u16 digits = 0;
+        for (u32 k = 0; k < n; ++k)
+            digits |= possible[house[k]];
+        
+        for (u32 bits = digits; bits; bits &= bits - 1)
+        {
+            u16 bit = (u16)(1 << lowest_bit_index(bits));
+            
+            u16 cells[SUDOKU_MAX_SIDE];
+            u32 cell_count = 0;
+            bool same_row = true;
+            bool same_col = true;
+            bool same_box = true;
+            for (u32 k = 0; k < n; ++k)
+            {
+                u32 index = house[k];
+                if (!(possible[index] & bit)) continue;
+                
+                if (cell_count)
+                {
+                    same_row = same_row && state->cell_row[index] == state->cell_row[cells[0]];
+                    same_col = same_col && state->cell_col[index] == state->cell_col[cells[0]];
+                    same_box = same_box && state->cell_box[index] == state->cell_box[cells[0]];
+                }
+                cells[cell_count++] = (u16)index;
+            }
+            if (cell_count < 2) continue;
+            
+            u32 first = cells[0];
+            u32 to_house;
+            if (pointing && same_row)
+                to_house = state->cell_row[first];
+            else if (pointing && same_col)
+                to_house = n + state->cell_col[first];
+            else if (!pointing && same_box)
+                to_house = 2 * n + state->cell_box[first];
+            else
+                continue;
+            
+            // every cell of the digit in the first house is in cells, the others of the second house lose it
+            sudoku_deduction_begin(deduction, pointing ? SUDOKU_TECH_POINTING : SUDOKU_TECH_CLAIMING, state->max_size);
+            u8 *to_cells = state->houses[to_house];
+            for (u32 k = 0; k < n; ++k)
+            {
+                u32 index = to_cells[k];
+                if (!(possible[index] & bit)) continue;
+                
+                bool in_cells = false;
+                for (u32 c = 0; c < cell_count; ++c)
+                    in_cells = in_cells || cells[c] == index;
+                if (!in_cells)
+                    sudoku_deduction_eliminate(deduction, index, bit);
+            }
+            
+            if (deduction->elimination_count)
+            {
+                deduction->digits = bit;
+                deduction->cell_count = cell_count;
+                memcpy(deduction->cells, cells, cell_count * sizeof(u16));
+                return true;
+            }
+        }
+    }
+    
+    return false;
+}
+
+// naked (k cells holding k digits) or hidden (k digits in k cells) subsets of size k
+bool sudoku_find_subset(SudokuState *state, u16 *possible, SudokuDeduction *deduction, u32 size, bool hidden)
+{
+    u32 limit = 1 << state->max_col;
+    u16 *masks = sudoku_subset_table.masks;
+    SudokuTechnique technique = hidden ? (size == 2 ? SUDOKU_TECH_HIDDEN_PAIR : SUDOKU_TECH_HIDDEN_TRIPLE) :
+        (size == 2 ? SUDOKU_TECH_NAKED_PAIR : SUDOKU_TECH_NAKED_TRIPLE);
+    
+    u16 m[SUDOKU_MAX_SIDE];
+    u16 where[SUDOKU_MAX_SIDE + 1];
+    for (u32 h = 0; h < state->num_houses; ++h)
+    {
+        u8 *house = state->houses[h];
+        u32 open = sudoku_house_positions(state, possible, h, m, where);
+        
+        // digit d at bit d - 1 so digit sets index the same table as cell sets
+        u32 digits = 0;
+        for (u32 d = 1; d <= state->max_row; ++d)
+        {
+            if (where[d])
+                digits |= 1 << (d - 1);
+        }
+        
+        u32 pool = hidden ? digits : open;
+        if (count_set_bits((u16)pool) <= size) continue;
+        
+        for (u32 t = 0; t < sudoku_subset_table.count && masks[t] < limit; ++t)
+        {
+            u32 subset = masks[t];
+            if ((subset & pool) != subset || count_set_bits((u16)subset) != size) continue;
+            
+            u32 cells = subset;
+            u16 keep = 0;
+            if (hidden)
+            {
+                cells = 0;
+                for (u32 bits = subset; bits; bits &= bits - 1)
+                    cells |= where[lowest_bit_index(bits) + 1];
+                keep = (u16)(subset << 1);
+            }
+            else
+            {
+                for (u32 bits = subset; bits; bits &= bits - 1)
+                    keep |= m[lowest_bit_index(bits)];
+            }
+            if (count_set_bits((u16)cells) != size || count_set_bits(keep) != size) continue;
+            
+            sudoku_deduction_begin(deduction, technique, state->max_size);
+            for (u32 k = 0; k < state->max_col; ++k)
+            {
+                bool in_cells = (cells >> k) & 1;
+                u16 bits = hidden ? (in_cells ? m[k] & ~keep : 0) : (in_cells ? 0 : m[k] & keep);
+                if (bits)
+                    sudoku_deduction_eliminate(deduction, house[k], bits);
+            }
+            
+            if (deduction->elimination_count)
+            {
+                deduction->digits = keep;
+                for (u32 bits = cells; bits; bits &= bits - 1)
+                    deduction->cells[deduction->cell_count++] = house[lowest_bit_index(bits)];
+                return true;
+            }
+        }
+    }
+    
+    return false;
+}
+
+// x-wing (size 2) and swordfish (size 3): size base lines where a digit sit in the
+// same size cover lines, the digit leave the rest of the cover lines
+bool sudoku_find_fish(SudokuState *state, u16 *possible, SudokuDeduction *deduction, u32 size)
+{
+    u32 n = state->max_row;
+    u32 limit = 1 << n;
+    u16 *masks = sudoku_subset_table.masks;
+    SudokuTechnique technique = size == 2 ? SUDOKU_TECH_X_WING : SUDOKU_TECH_SWORDFISH;
+    
+    for (u32 d = 1; d <= n; ++d)
+    {
+        u16 bit = (u16)(1 << d);
+        for (u32 base_offset = 0; base_offset <= n; base_offset += n)
+        {
+            // positions of the digit on every base line, lines with 2..size places can be part of a fish
+            u16 where[SUDOKU_MAX_SIDE];
+            u32 lines = 0;
+            for (u32 line = 0; line < n; ++line)
+            {
+                u8 *house = state->houses[base_offset + line];
+                where[line] = 0;
+                for (u32 k = 0; k < n; ++k)
+                {
+                    if (possible[house[k]] & bit)
+                        where[line] |= 1 << k;
+                }
+                
+                u32 count = count_set_bits(where[line]);
+                if (count >= 2 && count <= size)
+                    lines |= 1 << line;
+            }
+            if (count_set_bits((u16)lines) < size) continue;
+            
+            u32 cover_offset = base_offset ? 0 : n;
+            for (u32 t = 0; t < sudoku_subset_table.count && masks[t] < limit; ++t)
+            {
+                u32 base = masks[t];
+                if ((base & lines) != base || count_set_bits((u16)base) != size) continue;
+                
+                u32 cover = 0;
+                for (u32 bits = base; bits; bits &= bits - 1)
+                    cover |= where[lowest_bit_index(bits)];
+                if (count_set_bits((u16)cover) != size) continue;
+                
+                // cell k of cover line c is on base line k
+                sudoku_deduction_begin(deduction, technique, state->max_size);
+                for (u32 bits = cover; bits; bits &= bits - 1)
+                {
+                    u8 *house = state->houses[cover_offset + lowest_bit_index(bits)];
+                    for (u32 k = 0; k < n; ++k)
+                    {
+                        if (!((base >> k) & 1) && (possible[house[k]] & bit))
+                            sudoku_deduction_eliminate(deduction, house[k], bit);
+                    }
+                }
+                
+                if (deduction->elimination_count)
+                {
+                    deduction->digits = bit;
+                    for (u32 bits = base; bits; bits &= bits - 1)
+                    {
+                        u32 line = lowest_bit_index(bits);
+                        for (u32 cells = where[line]; cells; cells &= cells - 1)
+                            deduction->cells[deduction->cell_count++] = state->houses[base_offset + line][lowest_bit_index(cells)];
+                    }
+                    return true;
+                }
+            }
+        }
+    }
+    
+    return false;
+}
+
+// pivot {a,b} that see a pincer {a,c} and a pincer {b,c}: one of the pincers is c,
+// so c leave every cell that see both pincers
+bool sudoku_find_xy_wing(SudokuState *state, u16 *possible, SudokuDeduction *deduction)
+{
+    u32 max_size = state->max_size;
+    
+    // bivalue cells, the only ones that can be part of the wing
+    u16 cells[SUDOKU_MAX_CELLS];
+    u32 cell_count = 0;
+    for (u32 i = 0; i < max_size; ++i)
+    {
+        if (count_set_bits(possible[i]) == 2)
+            cells[cell_count++] = (u16)i;
+    }
+    
+    for (u32 p = 0; p < cell_count; ++p)
+    {
+        u32 pivot = cells[p];
+        u16 pivot_bits = possible[pivot];
+        for (u32 q = 0; q < cell_count; ++q)
+        {
+            u32 first = cells[q];
+            u16 shared = possible[first] & pivot_bits;
+            if (!sudoku_grade_sees(state, pivot, first) || count_set_bits(shared) != 1) continue;
+            
+            u16 c = possible[first] & ~pivot_bits;
+            u16 second_bits = (pivot_bits & ~shared) | c;
+            for (u32 r = q + 1; r < cell_count; ++r)
+            {
+                u32 second = cells[r];
+                if (possible[second] != second_bits || !sudoku_grade_sees(state, pivot, second)) continue;
+                
+                sudoku_deduction_begin(deduction, SUDOKU_TECH_XY_WING, max_size);
+                for (u32 i = 0; i < max_size; ++i)
+                {
+                    if ((possible[i] & c) && sudoku_grade_sees(state, i, first) && sudoku_grade_sees(state, i, second))
+                        sudoku_deduction_eliminate(deduction, i, c);
+                }
+                
+                if (deduction->elimination_count)
+                {
+                    deduction->digits = pivot_bits | c;
+                    deduction->cells[0] = (u16)pivot;
+                    deduction->cells[1] = (u16)first;
+                    deduction->cells[2] = (u16)second;
+                    deduction->cell_count = 3;
+                    return true;
+                }
+            }
+        }
+    }
+    
+    return false;
+}
+
+// easiest deduction of the candidate table (0 for filled cells), up to max_technique.
+// sudoku_subset_table_init must have run
+bool sudoku_find_deduction(SudokuState *state, u16 *possible, SudokuDeduction *deduction, SudokuTechnique max_technique = SUDOKU_TECH_XY_WING)
+{
+    assert(sudoku_subset_table.ready);
+    
+    for (u32 t = SUDOKU_TECH_HIDDEN_SINGLE; t <= (u32)max_technique; ++t)
+    {
+        bool found = false;
+        switch (t)
+        {
+            case SUDOKU_TECH_HIDDEN_SINGLE: found = sudoku_find_hidden_single(state, possible, deduction); break;
+            case SUDOKU_TECH_NAKED_SINGLE: found = sudoku_find_naked_single(state, possible, deduction); break;
+            case SUDOKU_TECH_POINTING: found = sudoku_find_intersection(state, possible, deduction, true); break;
+            case SUDOKU_TECH_CLAIMING: found = sudoku_find_intersection(state, possible, deduction, false); break;
+            case SUDOKU_TECH_NAKED_PAIR: found = sudoku_find_subset(state, possible, deduction, 2, false); break;
+            case SUDOKU_TECH_X_WING: found = sudoku_find_fish(state, possible, deduction, 2); break;
+            case SUDOKU_TECH_HIDDEN_PAIR: found = sudoku_find_subset(state, possible, deduction, 2, true); break;
+            case SUDOKU_TECH_NAKED_TRIPLE: found = sudoku_find_subset(state, possible, deduction, 3, false); break;
+            case SUDOKU_TECH_SWORDFISH: found = sudoku_find_fish(state, possible, deduction, 3); break;
+            case SUDOKU_TECH_HIDDEN_TRIPLE: found = sudoku_find_subset(state, possible, deduction, 3, true); break;
+            case SUDOKU_TECH_XY_WING: found = sudoku_find_xy_wing(state, possible, deduction); break;
+        }
+        if (found)
+            return true;
+    }
+    
+    return false;
+}
+
+// place the digit or remove the candidates of a deduction
+void sudoku_apply_deduction(SudokuState *state, u16 *possible, SudokuDeduction *deduction)
+{
+    if (deduction->index < state->max_size)
+    {
+        u32 index = deduction->index;
+        u16 bit = (u16)(1 << deduction->val);
+        sudoku_state_place(state, index, deduction->val);
+        possible[index] = 0;
+        
+        u32 houses[3] = {
+            state->cell_row[index],
+            (u32)state->max_row + state->cell_col[index],
+            2u * state->max_row + state->cell_box[index],
+        };
+        for (u32 h = 0; h < 3; ++h)
+        {
+            u8 *house = state->houses[houses[h]];
+            for (u32 k = 0; k < state->max_col; ++k)
+                possible[house[k]] &= ~bit;
+        }
+    }
+    
+    for (u32 e = 0; e < deduction->elimination_count; ++e)
+        possible[deduction->eliminations[e].index] &= ~deduction->eliminations[e].bits;
+}
+
+// grade a puzzle and leave it solved, false when it has no solution.
+// caller own the trail, sudoku_subset_table_init must have run
+bool sudoku_grade(u8 *sudoku, u8 max_row, u8 max_col, u8 block_size, SudokuGrade *grade, SudokuTrail *trail)
+{
+    memset(grade, 0, sizeof(SudokuGrade));
+    u32 max_size = max_row * max_col;
+    
+    // the solution back the guesses
+    u8 solution[SUDOKU_MAX_CELLS];
+    memcpy(solution, sudoku, max_size);
+    u32 num_guess = 0;
+    if (!sudoku_solve_with_trail(solution, max_row, max_col, block_size, trail, &num_guess, SUDOKU_PROPAGATE_SINGLES))
+        return false;
+    
+    SudokuState state;
+    sudoku_state_init(&state, sudoku, max_row, max_col, block_size);
+    
+    u16 possible[SUDOKU_MAX_CELLS];
+    u32 open = 0;
+    for (u32 i = 0; i < max_size; ++i)
+    {
+        possible[i] = sudoku[i] ? 0 : sudoku_state_candidates(&state, i);
+        open += sudoku[i] == 0;
+    }
+    
+    SudokuDeduction deduction;
+    while (open)
+    {
+        if (!sudoku_find_deduction(&state, possible, &deduction))
+        {
+            u32 index = find_possible_min_from_table(sudoku, possible, max_size);
+            sudoku_deduction_place(&deduction, SUDOKU_TECH_GUESS, max_size, index, solution[index]);
+        }
+        
+        sudoku_apply_deduction(&state, possible, &deduction);
+        open -= deduction.index < max_size;
+        
+        ++grade->steps;
+        ++grade->counts[deduction.technique];
+        grade->score += sudoku_technique_weights[deduction.technique];
+        if (deduction.technique > grade->hardest)
+            grade->hardest = deduction.technique;
+    }
+    
+    return true;
+}
+
+// step through the run_tests puzzles the way sudoku_grade does, every placement has to be
+// the solution digit and no elimination may remove it, then sudoku_grade has to end on the solution
+void run_grade_tests(bool print_result)
+{
+    sudoku_subset_table_init();
+    SudokuTrail *trail = (SudokuTrail*)malloc(sizeof(SudokuTrail));
+    static SudokuDeduction deduction;
+    
+    u8 sudoku[96] = {};
+    u8 solution[96] = {};
+    for (u32 k = 0; k < SUDOKU_TEST_FILES; ++k)
+    {
+        bool read = sudoku_load_test(k, sudoku, solution);
+        assert(read);
+        
+        u8 board[96] = {};
+        memcpy(board, sudoku, 81);
+        SudokuState state;
+        sudoku_state_init(&state, board, 9, 9, 3);
+        u16 possible[81];
+        for (u32 i = 0; i < 81; ++i)
+            possible[i] = board[i] ? 0 : sudoku_state_candidates(&state, i);
+        
+        u32 steps = 0;
+        while (sudoku_find_deduction(&state, possible, &deduction))
+        {
+            if (deduction.index < 81)
+                assert(deduction.val == solution[deduction.index]);
+            for (u32 e = 0; e < deduction.elimination_count; ++e)
+            {
+                SudokuElimination *elimination = deduction.eliminations + e;
+                assert(elimination->bits && !(elimination->bits & (1 << solution[elimination->index])));
+            }
+            
+            sudoku_apply_deduction(&state, possible, &deduction);
+            ++steps;
+            for (u32 i = 0; i < 81; ++i)
+                assert(board[i] ? board[i] == solution[i] : (possible[i] >> solution[i]) & 1);
+        }
+        
+        SudokuGrade grade;
+        bool graded = sudoku_grade(sudoku, 9, 9, 3, &grade, trail);
+        assert(graded);
+        assert(memcmp(sudoku, solution, 81) == 0);
+        
+        u32 total = 0;
+        for (u32 t = 0; t < SUDOKU_TECH_COUNT; ++t)
+            total += grade.counts[t];
+        assert(total == grade.steps && grade.counts[grade.hardest] > 0);
+        assert(grade.hardest != SUDOKU_TECH_GUESS || grade.steps > steps);
+        
+        if (print_result) printf("grade %u: %s, score %u, %u steps\n", k, sudoku_technique_names[grade.hardest], grade.score, grade.steps);
+    }
+    
+    // two 1 in the first row
+    memset(sudoku, 0, sizeof(sudoku));
+    sudoku[0] = sudoku[1] = 1;
+    SudokuGrade grade;
+    assert(!sudoku_grade(sudoku, 9, 9, 3, &grade, trail));
+    
+    free(trail);
+}
@@ -0,0 +1,511 @@
+// player board for the gui, include after sudoku.cpp and sudoku_grade.cpp
+//
+// every house keep a count per digit so a move only touch the three houses of its
+// cell: used digits (count > 0) and repeated digits (count > 1) of those houses are
+// rebuilt from the counts, then the candidates and conflict flags of the cells in
+// them. nothing rescan the whole board. moves sit on a ring with an undo cursor,
+// undo and redo replay one move backward or forward
+
+#define SUDOKU_PLAYER_MAX_MOVES 1024 // oldest moves fall off the undo history
+
+struct SudokuMove {
+    u8 index;
+    u8 before;
+    u8 after;
+};
+
+struct SudokuPlayer {
+    SudokuState state; // board, houses and the used digits of every house
+    u16 *candidates;   // free digits of every open cell, 0 on filled cells
+    u8 *givens;        // cells the player can't change
+    
+    // candidates struck by applied hints, they follow from the entries so clearing one drop them all
+    u16 eliminated[SUDOKU_MAX_CELLS];
+    bool has_eliminations;
+    
+    u8 house_count[3 * SUDOKU_MAX_SIDE][SUDOKU_MAX_SIDE + 1];
+    u16 house_conflict[3 * SUDOKU_MAX_SIDE]; // digits more than once in the house
+    bool conflict[SUDOKU_MAX_CELLS];         // the cell digit repeat in one of its houses
+    u32 conflict_count;
+    
+    SudokuMove moves[SUDOKU_PLAYER_MAX_MOVES];
+    u32 move_first;  // ring index of the oldest move
+    u32 move_count;
+    u32 move_cursor; // moves applied, the ones after it can be redone
+};
+
+inline void sudoku_player_cell_houses(SudokuPlayer *player, u32 index, u32 *houses)
+{
+    SudokuState *state = &player->state;
+    houses[0] = state->cell_row[index];
+    houses[1] = state->max_row + state->cell_col[index];
+    houses[2] = 2 * state->max_row + state->cell_box[index];
+}
+
+// used and repeated digits of house h from its counts
+void sudoku_player_update_house(SudokuPlayer *player, u32 h)
+{
+    SudokuState *state = &player->state;
+    u16 used = 0;
+    u16 conflict = 0;
+    for (u32 d = 1; d <= state->max_row; ++d)
+    {
+        u8 count = player->house_count[h][d];
+        if (count)
+            used |= 1 << d;
+        if (count > 1)
+            conflict |= 1 << d;
+    }
+    player->house_conflict[h] = conflict;
+    
+    u32 n = state->max_row;
+    if (h < n) state->row_used[h] = used;
+    else if (h < 2 * n) state->col_used[h - n] = used;
+    else state->box_used[h - 2 * n] = used;
+}
+
+void sudoku_player_update_cell(SudokuPlayer *player, u32 index)
+{
+    SudokuState *state = &player->state;
+    u8 val = state->sudoku[index];
+    player->candidates[index] = val ? 0 : sudoku_state_candidates(state, index) & ~player->eliminated[index];
+    
+    u32 houses[3];
+    sudoku_player_cell_houses(player, index, houses);
+    u16 conflict = player->house_conflict[houses[0]] | player->house_conflict[houses[1]] | player->house_conflict[houses[2]];
+    bool is_conflict = val && (conflict & (1 << val));
+    player->conflict_count += (u32)is_conflict - (u32)player->conflict[index];
+    player->conflict[index] = is_conflict;
+}
+
+// board and candidates are caller memory (max_size items), the player keep them up to date
+void sudoku_player_init(SudokuPlayer *player, u8 *board, u16 *candidates, u8 *givens, u8 max_row, u8 max_col, u8 block_size)
+{
+    memset(player, 0, sizeof(SudokuPlayer));
+    sudoku_state_init(&player->state, board, max_row, max_col, block_size);
+    player->candidates = candidates;
+    player->givens = givens;
+    
+    u32 houses[3];
+    for (u32 i = 0; i < player->state.max_size; ++i)
+    {
+        if (!board[i]) continue;
+        
+        sudoku_player_cell_houses(player, i, houses);
+        for (u32 k = 0; k < 3; ++k)
+            ++player->house_count[houses[k]][board[i]];
+    }
+    
+    for (u32 h = 0; h < player->state.num_houses; ++h)
+        sudoku_player_update_house(player, h);
+    for (u32 i = 0; i < player->state.max_size; ++i)
+        sudoku_player_update_cell(player, i);
+}
+
+// write val (0 clear) without touching the history
+void sudoku_player_write(SudokuPlayer *player, u32 index, u8 val)
+{
+    SudokuState *state = &player->state;
+    u8 old = state->sudoku[index];
+    
+    u32 houses[3];
+    sudoku_player_cell_houses(player, index, houses);
+    for (u32 k = 0; k < 3; ++k)
+    {
+        if (old) --player->house_count[houses[k]][old];
+        if (val) ++player->house_count[houses[k]][val];
+    }
+    state->sudoku[index] = val;
+    
+    for (u32 k = 0; k < 3; ++k)
+        sudoku_player_update_house(player, houses[k]);
+    
+    if (old && player->has_eliminations)
+    {
+        memset(player->eliminated, 0, sizeof(player->eliminated));
+        player->has_eliminations = false;
+        for (u32 i = 0; i < state->max_size; ++i)
+            sudoku_player_update_cell(player, i);
+        return;
+    }
+    
+    // cells shared by two houses are updated twice, still a fixed 3 * n cells
+    for (u32 k = 0; k < 3; ++k)
+    {
+        u8 *house = state->houses[houses[k]];
+        for (u32 j = 0; j < state->max_col; ++j)
+            sudoku_player_update_cell(player, house[j]);
+    }
+}
+
+// a new move drop the redo history, false on givens or when nothing change
+bool sudoku_player_set(SudokuPlayer *player, u32 index, u8 val)
+{
+    u8 old = player->state.sudoku[index];
+    if (player->givens[index] || old == val)
+        return false;
+    
+    player->move_count = player->move_cursor;
+    if (player->move_count == SUDOKU_PLAYER_MAX_MOVES)
+    {
+        player->move_first = (player->move_first + 1) % SUDOKU_PLAYER_MAX_MOVES;
+        --player->move_count;
+    }
+    
+    SudokuMove *move = player->moves + (player->move_first + player->move_count) % SUDOKU_PLAYER_MAX_MOVES;
+    move->index = (u8)index;
+    move->before = old;
+    move->after = val;
+    player->move_cursor = ++player->move_count;
+    
+    sudoku_player_write(player, index, val);
+    return true;
+}
+
+// index of the changed cell, max_size when there is nothing to undo
+u32 sudoku_player_undo(SudokuPlayer *player)
+{
+    if (!player->move_cursor)
+        return player->state.max_size;
+    
+    SudokuMove *move = player->moves + (player->move_first + --player->move_cursor) % SUDOKU_PLAYER_MAX_MOVES;
+    sudoku_player_write(player, move->index, move->before);
+    return move->index;
+}
+
+u32 sudoku_player_redo(SudokuPlayer *player)
+{
+    if (player->move_cursor == player->move_count)
+        return player->state.max_size;
+    
+    SudokuMove *move = player->moves + (player->move_first + player->move_cursor++) % SUDOKU_PLAYER_MAX_MOVES;
+    sudoku_player_write(player, move->index, move->after);
+    return move->index;
+}
+
+// next logical step from the maintained candidates, the easiest technique first.
+// false when entries conflict or no technique apply
+bool sudoku_player_hint(SudokuPlayer *player, SudokuDeduction *hint)
+{
+    if (player->conflict_count)
+        return false;
+    return sudoku_find_deduction(&player->state, player->candidates, hint);
+}
+
+// a placement is an undoable move, eliminations strike candidates until an entry is cleared
+void sudoku_player_apply_hint(SudokuPlayer *player, SudokuDeduction *hint)
+{
+    if (hint->index < player->state.max_size)
+    {
+        sudoku_player_set(player, hint->index, hint->val);
+        return;
+    }
+    
+    for (u32 e = 0; e < hint->elimination_count; ++e)
+    {
+        SudokuElimination *elimination = hint->eliminations + e;
+        player->eliminated[elimination->index] |= elimination->bits;
+        player->candidates[elimination->index] &= ~elimination->bits;
+    }
+    player->has_eliminations = player->has_eliminations || hint->elimination_count;
+}
+
+// "still solvable?" check of a player board, run off the render thread.
+// the memo keep what earlier checks of the same puzzle learned: the last completion
+// found and, per cell, digits some solution of the givens has (seen) or that none
+// has (refuted). a board that agree with the last completion is solvable without a
+// search, clearing cells keep it solvable the same way
+enum SudokuCheckStatus {
+    SUDOKU_CHECK_PENDING,
+    SUDOKU_CHECK_SOLVABLE,
+    SUDOKU_CHECK_DEAD_END, // no completion, wrong marks the entries that can't be in any solution
+    SUDOKU_CHECK_GAVE_UP,  // budget ran out, nothing is known
+};
+
+struct SudokuCheckMemo {
+    u16 seen[SUDOKU_MAX_CELLS];
+    u16 refuted[SUDOKU_MAX_CELLS];
+    u8 completion[SUDOKU_MAX_CELLS];
+    bool has_completion;
+};
+
+struct SudokuCheck {
+    SudokuCheckStatus status;
+    bool wrong[SUDOKU_MAX_CELLS];
+    u32 wrong_count;
+    u64 nodes;
+};
+
+void sudoku_check_memo_add(SudokuCheckMemo *memo, u8 *solution, u32 max_size)
+{
+    for (u32 i = 0; i < max_size; ++i)
+        memo->seen[i] |= 1 << solution[i];
+    memcpy(memo->completion, solution, max_size);
+    memo->has_completion = true;
+}
+
+// solution can be 0 when the puzzle wasn't solved yet
+void sudoku_check_memo_init(SudokuCheckMemo *memo, u8 *solution, u32 max_size)
+{
+    memset(memo, 0, sizeof(SudokuCheckMemo));
+    if (solution)
+        sudoku_check_memo_add(memo, solution, max_size);
+}
+
+// every search of one check share the budget, past timeout (secs) the check give up
+// and entries not tested yet stay unmarked
+void sudoku_player_check(u8 *givens, u8 *board, u8 max_row, u8 max_col, u8 block_size, SudokuCheckMemo *memo, SudokuCheck *check,
+                         SudokuTrail *trail, double timeout)
+{
+    u32 max_size = max_row * max_col;
+    memset(check, 0, sizeof(SudokuCheck));
+    
+    if (memo->has_completion)
+    {
+        bool agree = true;
+        for (u32 i = 0; i < max_size && agree; ++i)
+            agree = !board[i] || board[i] == memo->completion[i];
+        if (agree)
+        {
+            check->status = SUDOKU_CHECK_SOLVABLE;
+            return;
+        }
+    }
+    
+    SudokuBudget budget;
+    sudoku_budget_init(&budget, 0, timeout);
+    
+    u8 work[SUDOKU_MAX_CELLS];
+    u32 num_guess = 0;
+    memcpy(work, board, max_size);
+    bool solved = sudoku_solve_with_trail(work, max_row, max_col, block_size, trail, &num_guess, SUDOKU_PROPAGATE_SINGLES, &budget);
+    if (solved)
+        sudoku_check_memo_add(memo, work, max_size);
+    
+    check->status = solved ? SUDOKU_CHECK_SOLVABLE : (budget.gave_up ? SUDOKU_CHECK_GAVE_UP : SUDOKU_CHECK_DEAD_END);
+    
+    // dead end: an entry is wrong when the givens plus that entry alone can't be completed
+    for (u32 i = 0; i < max_size && check->status == SUDOKU_CHECK_DEAD_END; ++i)
+    {
+        u16 bit = (u16)(1 << board[i]);
+        if (!board[i] || givens[i] || (memo->seen[i] & bit))
+            continue;
+        
+        if (!(memo->refuted[i] & bit))
+        {
+            memcpy(work, givens, max_size);
+            work[i] = board[i];
+            if (sudoku_solve_with_trail(work, max_row, max_col, block_size, trail, &num_guess, SUDOKU_PROPAGATE_SINGLES, &budget))
+            {
+                sudoku_check_memo_add(memo, work, max_size);
+                continue;
+            }
+            if (budget.gave_up)
+                break;
+            memo->refuted[i] |= bit;
+        }
+        
+        check->wrong[i] = true;
+        ++check->wrong_count;
+    }
+    check->nodes = budget.nodes;
+}
+
+// candidates and conflicts of a player against a full rescan of its board
+bool sudoku_player_test_consistent(SudokuPlayer *player)
+{
+    SudokuState *state = &player->state;
+    u8 *board = state->sudoku;
+    u32 conflict_count = 0;
+    for (u32 i = 0; i < state->max_size; ++i)
+    {
+        u16 used = 0;
+        bool conflict = false;
+        for (u32 j = 0; j < state->max_size; ++j)
+        {
+            if (j == i || !board[j] || !sudoku_grade_sees(state, i, j)) continue;
+            used |= 1 << board[j];
+            conflict = conflict || board[j] == board[i];
+        }
+        
+        u16 candidates = board[i] ? 0 : ~used & state->all_mask & ~player->eliminated[i];
+        if (player->candidates[i] != candidates || player->conflict[i] != (board[i] && conflict))
+            return false;
+        conflict_count += board[i] && conflict;
+    }
+    
+    return conflict_count == player->conflict_count;
+}
+
+// random set / undo / redo on a few run_tests puzzles, after every move the board has to
+// match the history and the incremental state the rescan
+void run_player_tests(bool print_result)
+{
+    static SudokuPlayer player;
+    static u8 history[1024][81];
+    u8 givens[96] = {};
+    u8 solution[96] = {};
+    u8 board[96] = {};
+    u16 candidates[81];
+    u32 seed = 1;
+    
+    for (u32 k = 0; k < SUDOKU_TEST_FILES; k += 5)
+    {
+        bool read = sudoku_load_test(k, givens, solution);
+        assert(read);
+        memcpy(board, givens, 81);
+        sudoku_player_init(&player, board, candidates, givens, 9, 9, 3);
+        assert(sudoku_player_test_consistent(&player));
+        
+        u32 h = 0;
+        memcpy(history[0], board, 81);
+        for (u32 step = 0; step < 1000; ++step)
+        {
+            seed = seed * 1103515245 + 12345;
+            u32 op = (seed >> 8) % 10;
+            u32 index = (seed >> 12) % 81;
+            u8 val = (u8)((seed >> 20) % 10);
+            if (op < 6)
+            {
+                // half the moves put the solution digit back so the board fill up as well
+                if (op < 3) val = solution[index];
+                bool moved = sudoku_player_set(&player, index, val);
+                assert(moved == (!givens[index] && history[h][index] != val));
+                if (moved) memcpy(history[++h], board, 81);
+            }
+            else if (op < 8)
+            {
+                u32 changed = sudoku_player_undo(&player);
+                assert((changed < 81) == (h > 0));
+                if (changed < 81) --h;
+            }
+            else
+            {
+                if (sudoku_player_redo(&player) < 81) ++h;
+            }
+            
+            assert(memcmp(board, history[h], 81) == 0);
+            assert(sudoku_player_test_consistent(&player));
+        }
+        
+        if (print_result) printf("player %u: %u moves kept, %u conflicts\n", k, h, player.conflict_count);
+    }
+}
+
+// run_tests puzzles with some solution entries then one wrong entry, with and without a
+// solved memo: right entries stay solvable, the wrong one is the only entry marked
+void run_check_tests(bool print_result)
+{
+    SudokuTrail *trail = (SudokuTrail*)malloc(sizeof(SudokuTrail));
+    static SudokuCheckMemo memo;
+    static SudokuCheck check;
+    u8 givens[96] = {};
+    u8 solution[96] = {};
+    u8 board[96] = {};
+    
+    for (u32 k = 0; k < SUDOKU_TEST_FILES; ++k)
+    {
+        bool read = sudoku_load_test(k, givens, solution);
+        assert(read);
+        
+        for (u32 solved = 0; solved < 2; ++solved)
+        {
+            sudoku_check_memo_init(&memo, solved ? solution : 0, 81);
+            memcpy(board, givens, 81);
+            sudoku_player_check(givens, board, 9, 9, 3, &memo, &check, trail, 0);
+            assert(check.status == SUDOKU_CHECK_SOLVABLE && check.wrong_count == 0);
+            
+            // every third open cell get its solution digit
+            u32 open = 0;
+            u32 wrong = 81;
+            for (u32 i = 0; i < 81; ++i)
+            {
+                if (givens[i]) continue;
+                if (open++ % 3 == 0) board[i] = solution[i];
+                else if (wrong == 81) wrong = i;
+            }
+            sudoku_player_check(givens, board, 9, 9, 3, &memo, &check, trail, 0);
+            assert(check.status == SUDOKU_CHECK_SOLVABLE && check.wrong_count == 0);
+            
+            // the puzzle is unique, any other digit is a dead end
+            board[wrong] = solution[wrong] % 9 + 1;
+            sudoku_player_check(givens, board, 9, 9, 3, &memo, &check, trail, 0);
+            assert(check.status == SUDOKU_CHECK_DEAD_END);
+            assert(check.wrong_count == 1 && check.wrong[wrong]);
+            
+            // the memo now know the digit is refuted, a second check give the same answer
+            sudoku_player_check(givens, board, 9, 9, 3, &memo, &check, trail, 0);
+            assert(check.status == SUDOKU_CHECK_DEAD_END);
+            assert(check.wrong_count == 1 && check.wrong[wrong]);
+            assert(memo.refuted[wrong] & (1 << board[wrong]));
+        }
+        
+        if (print_result) printf("check %u: %llu nodes\n", k, check.nodes);
+    }
+    
+    free(trail);
+}
+
+// take hints on the run_tests puzzles until none apply: every step has to agree with the
+// solution and keep the candidates right, a conflict stop the hints
+void run_hint_tests(bool print_result)
+{
+    sudoku_subset_table_init();
+    static SudokuPlayer player;
+    static SudokuDeduction hint;
+    u8 givens[96] = {};
+    u8 solution[96] = {};
+    u8 board[96] = {};
+    u16 candidates[81];
+    
+    for (u32 k = 0; k < SUDOKU_TEST_FILES; ++k)
+    {
+        bool read = sudoku_load_test(k, givens, solution);
+        assert(read);
+        memcpy(board, givens, 81);
+        sudoku_player_init(&player, board, candidates, givens, 9, 9, 3);
+        
+        u32 hints = 0;
+        while (sudoku_player_hint(&player, &hint))
+        {
+            if (hint.index < 81)
+                assert(hint.val == solution[hint.index]);
+            for (u32 e = 0; e < hint.elimination_count; ++e)
+                assert(!(hint.eliminations[e].bits & (1 << solution[hint.eliminations[e].index])));
+            
+            sudoku_player_apply_hint(&player, &hint);
+            assert(sudoku_player_test_consistent(&player));
+            ++hints;
+        }
+        
+        u32 open = 0;
+        for (u32 i = 0; i < 81; ++i)
+        {
+            assert(!board[i] || board[i] == solution[i]);
+            assert(board[i] || (candidates[i] & (1 << solution[i])));
+            open += !board[i];
+        }
+        
+        // clearing an entry drop the struck candidates, undo it and the hints are back in step
+        if (player.move_cursor)
+        {
+            sudoku_player_undo(&player);
+            assert(sudoku_player_test_consistent(&player) && !player.has_eliminations);
+            sudoku_player_redo(&player);
+        }
+        
+        // a wrong entry next to a given repeat it
+        u32 given = 0;
+        while (!givens[given]) ++given;
+        u32 row_start = given / 9 * 9;
+        for (u32 i = row_start; i < row_start + 9; ++i)
+        {
+            if (givens[i]) continue;
+            sudoku_player_set(&player, i, givens[given]);
+            assert(player.conflict_count && !sudoku_player_hint(&player, &hint));
+            break;
+        }
+        
+        if (print_result) printf("hint %u: %u hints, %u cells left\n", k, hints, open);
+    }
+}
@@ -0,0 +1,298 @@
+#include "immintrin.h"
+
+// inter puzzle simd engine, include after sudoku.cpp
+//
+// puzzles are laid out structure of arrays: candidates of cell i for every
+// puzzle in the batch sit next to each other in one vector, one u16 lane per
+// puzzle (same (1 << val) bit layout as sudoku_possible). naked and hidden
+// singles are run on all lanes at once until nothing change, lanes that
+// still have open cells fall back to the scalar heuristic search.
+//
+// 16 lanes with avx2, 8 lanes with sse2
+
+#ifdef __AVX2__
+#define SIMD_LANES 16
+typedef __m256i simd_vec;
+#define simd_load(p) _mm256_load_si256((simd_vec*)(p))
+#define simd_store(p, v) _mm256_store_si256((simd_vec*)(p), v)
+#define simd_set1(x) _mm256_set1_epi16((short)(x))
+#define simd_zero() _mm256_setzero_si256()
+#define simd_and(a, b) _mm256_and_si256(a, b)
+#define simd_or(a, b) _mm256_or_si256(a, b)
+#define simd_xor(a, b) _mm256_xor_si256(a, b)
+#define simd_andnot(a, b) _mm256_andnot_si256(a, b) // ~a & b
+#define simd_sub(a, b) _mm256_sub_epi16(a, b)
+#define simd_cmpeq(a, b) _mm256_cmpeq_epi16(a, b)
+#define simd_movemask(a) _mm256_movemask_epi8(a)
+#define SIMD_MOVEMASK_ALL 0xFFFFFFFF
+#else
+#define SIMD_LANES 8
+typedef __m128i simd_vec;
+#define simd_load(p) _mm_load_si128((simd_vec*)(p))
+#define simd_store(p, v) _mm_store_si128((simd_vec*)(p), v)
+#define simd_set1(x) _mm_set1_epi16((short)(x))
+#define simd_zero() _mm_setzero_si128()
+#define simd_and(a, b) _mm_and_si128(a, b)
+#define simd_or(a, b) _mm_or_si128(a, b)
+#define simd_xor(a, b) _mm_xor_si128(a, b)
+#define simd_andnot(a, b) _mm_andnot_si128(a, b) // ~a & b
+#define simd_sub(a, b) _mm_sub_epi16(a, b)
+#define simd_cmpeq(a, b) _mm_cmpeq_epi16(a, b)
+#define simd_movemask(a) _mm_movemask_epi8(a)
+#define SIMD_MOVEMASK_ALL 0xFFFF
+#endif
+
+#define SIMD_MAX_SIZE (9 * 9)
+#define SIMD_ALL_MASK 0x3FE
+
+struct SimdTables {
+    bool ready;
+    u8 peers[SIMD_MAX_SIZE][20];
+    u8 houses[27][9];
+};
+
+static SimdTables simd_tables;
+
+// call once before any thread use the engine
+void simd_init_tables()
+{
+    if (simd_tables.ready)
+        return;
+    
+    for (u32 i = 0; i < 9; ++i)
+    {
+        for (u32 j = 0; j < 9; ++j)
+        {
+            simd_tables.houses[i][j] = (u8)(i * 9 + j);      // row
+            simd_tables.houses[9 + i][j] = (u8)(j * 9 + i);  // col
+            u32 box_row = i / 3 * 3 + j / 3;
+            u32 box_col = i % 3 * 3 + j % 3;
+            simd_tables.houses[18 + i][j] = (u8)(box_row * 9 + box_col); // block
+        }
+    }
+    
+    for (u32 i = 0; i < SIMD_MAX_SIZE; ++i)
+    {
+        u32 row = i / 9;
+        u32 col = i % 9;
+        u32 count = 0;
+        for (u32 k = 0; k < SIMD_MAX_SIZE; ++k)
+        {
+            if (k == i) continue;
+            u32 k_row = k / 9;
+            u32 k_col = k % 9;
+            bool same_box = (k_row / 3 == row / 3) && (k_col / 3 == col / 3);
+            if (k_row == row || k_col == col || same_box)
+                simd_tables.peers[i][count++] = (u8)k;
+        }
+        assert(count == 20);
+    }
+    
+    simd_tables.ready = true;
+}
+
+// candidates of every cell for every lane, cell major
+struct SimdBatch {
+#ifdef _MSC_VER
+    __declspec(align(32)) u16 candidates[SIMD_MAX_SIZE][SIMD_LANES];
+#else
+    u16 candidates[SIMD_MAX_SIZE][SIMD_LANES] __attribute__((aligned(32)));
+#endif
+};
+
+// mask with only the lanes that have exactly one candidate left
+inline simd_vec simd_single(simd_vec m)
+{
+    simd_vec one = simd_set1(1);
+    simd_vec is_pow2 = simd_cmpeq(simd_and(m, simd_sub(m, one)), simd_zero());
+    return simd_and(m, is_pow2);
+}
+
+// naked + hidden singles on all lanes to fixpoint, return mask (bit per lane) of dead lanes
+u32 simd_propagate(SimdBatch *batch)
+{
+    simd_vec zero = simd_zero();
+    simd_vec all = simd_set1(SIMD_ALL_MASK);
+    simd_vec dead = zero;
+    
+    for (;;)
+    {
+        simd_vec changed = zero;
+        
+        // naked singles: drop digits already fixed in a peer
+        for (u32 i = 0; i < SIMD_MAX_SIZE; ++i)
+        {
+            simd_vec m = simd_load(batch->candidates[i]);
+            simd_vec used = zero;
+            u8 *peers = simd_tables.peers[i];
+            for (u32 k = 0; k < 20; ++k)
+                used = simd_or(used, simd_single(simd_load(batch->candidates[peers[k]])));
+            
+            simd_vec next = simd_andnot(used, m);
+            changed = simd_or(changed, simd_xor(next, m));
+            dead = simd_or(dead, simd_cmpeq(next, zero));
+            simd_store(batch->candidates[i], next);
+        }
+        
+        // hidden singles: digit possible in only one cell of a house
+        for (u32 h = 0; h < 27; ++h)
+        {
+            u8 *house = simd_tables.houses[h];
+            simd_vec once = zero;
+            simd_vec twice = zero;
+            for (u32 k = 0; k < 9; ++k)
+            {
+                simd_vec m = simd_load(batch->candidates[house[k]]);
+                twice = simd_or(twice, simd_and(once, m));
+                once = simd_or(once, m);
+            }
+            
+            // a digit with no place left in the house
+            dead = simd_or(dead, simd_xor(simd_cmpeq(once, all), simd_set1(0xFFFF)));
+            
+            simd_vec unique = simd_andnot(twice, once);
+            for (u32 k = 0; k < 9; ++k)
+            {
+                simd_vec m = simd_load(batch->candidates[house[k]]);
+                simd_vec hidden = simd_and(m, unique);
+                simd_vec has_hidden = simd_xor(simd_cmpeq(hidden, zero), simd_set1(0xFFFF));
+                
+                // two unique digits in one cell can't both be placed
+                simd_vec single = simd_single(hidden);
+                dead = simd_or(dead, simd_andnot(simd_cmpeq(hidden, single), has_hidden));
+                
+                simd_vec next = simd_or(simd_and(has_hidden, hidden), simd_andnot(has_hidden, m));
+                changed = simd_or(changed, simd_xor(next, m));
+                simd_store(batch->candidates[house[k]], next);
+            }
+        }
+        
+        // stop when no live lane changed
+        simd_vec live_changed = simd_andnot(dead, changed);
+        if ((u32)simd_movemask(simd_cmpeq(live_changed, zero)) == SIMD_MOVEMASK_ALL)
+            break;
+    }
+    
+    u32 dead_lanes = 0;
+#ifdef _MSC_VER
+    __declspec(align(32)) u16 dead_mask[SIMD_LANES];
+#else
+    u16 dead_mask[SIMD_LANES] __attribute__((aligned(32)));
+#endif
+    simd_store(dead_mask, dead);
+    for (u32 l = 0; l < SIMD_LANES; ++l)
+    {
+        if (dead_mask[l])
+            dead_lanes |= 1 << l;
+    }
+    
+    return dead_lanes;
+}
+
+// solve up to SIMD_LANES puzzles in place (9x9 only)
+// solved[l] and num_guess[l] get the result of every lane, lanes past count are ignored
+// budgets (optional, one per lane) only bound the scalar search, propagation always finish
+// lane_stats (optional, SUDOKU_STATS builds) get the counters of the scalar search of every lane
+void sudoku_solve_simd(u8 **sudokus, u32 count, bool *solved, u32 *num_guess, SudokuTrail *trail, SudokuBudget *budgets = 0, SudokuStats **lane_stats = 0)
+{
+    assert(simd_tables.ready);
+    assert(count <= SIMD_LANES);
+    
+    SimdBatch batch;
+    for (u32 i = 0; i < SIMD_MAX_SIZE; ++i)
+    {
+        for (u32 l = 0; l < SIMD_LANES; ++l)
+        {
+            u8 val = l < count ? sudokus[l][i] : 0;
+            batch.candidates[i][l] = val ? (u16)(1 << val) : SIMD_ALL_MASK;
+        }
+    }
+    
+    u32 dead_lanes = simd_propagate(&batch);
+    
+    for (u32 l = 0; l < count; ++l)
+    {
+        num_guess[l] = 0;
+        
+        // every lane start from cleared counters, a dead lane keep them at 0
+        if (lane_stats) sudoku_stats_begin(lane_stats[l]);
+        if (dead_lanes & (1 << l))
+        {
+            solved[l] = false;
+            if (lane_stats) sudoku_stats_end();
+            continue;
+        }
+        
+        u8 *sudoku = sudokus[l];
+        bool complete = true;
+        for (u32 i = 0; i < SIMD_MAX_SIZE; ++i)
+        {
+            u16 m = batch.candidates[i][l];
+            if (m & (m - 1)) {
+                sudoku[i] = 0;
+                complete = false;
+            }
+            else {
+                sudoku[i] = (u8)log2(m);
+            }
+        }
+        
+        // lane need branching, scalar search from the propagated board
+        solved[l] = complete || sudoku_solve_with_trail(sudoku, 9, 9, 3, trail, num_guess + l, SUDOKU_PROPAGATE_SINGLES, budgets ? budgets + l : 0);
+        if (lane_stats) sudoku_stats_end();
+    }
+}
+
+// the run_tests puzzles in full and partial lane batches plus a dead lane, against the solutions
+void run_simd_tests(bool print_result)
+{
+    simd_init_tables();
+    SudokuTrail *trail = (SudokuTrail*)malloc(sizeof(SudokuTrail));
+    
+    static u8 puzzles[SUDOKU_TEST_FILES][SIMD_MAX_SIZE];
+    static u8 solutions[SUDOKU_TEST_FILES][SIMD_MAX_SIZE];
+    for (u32 k = 0; k < SUDOKU_TEST_FILES; ++k)
+    {
+        bool read = sudoku_load_test(k, puzzles[k], solutions[k]);
+        assert(read);
+    }
+    
+    u8 sudokus[SIMD_LANES][SIMD_MAX_SIZE];
+    u8 *lanes[SIMD_LANES];
+    bool solved[SIMD_LANES];
+    u32 num_guess[SIMD_LANES];
+    for (u32 start = 0; start < SUDOKU_TEST_FILES; start += SIMD_LANES - 1)
+    {
+        u32 count = SUDOKU_TEST_FILES - start < SIMD_LANES ? SUDOKU_TEST_FILES - start : SIMD_LANES;
+        for (u32 l = 0; l < count; ++l)
+        {
+            memcpy(sudokus[l], puzzles[(start + l) % SUDOKU_TEST_FILES], SIMD_MAX_SIZE);
+            lanes[l] = sudokus[l];
+        }
+        
+        // the last lane of a full batch get two 1 in the first row, no solution
+        u32 dead = count == SIMD_LANES ? count - 1 : count;
+        if (dead < count)
+        {
+            memset(sudokus[dead], 0, SIMD_MAX_SIZE);
+            sudokus[dead][0] = sudokus[dead][1] = 1;
+        }
+        
+        sudoku_solve_simd(lanes, count, solved, num_guess, trail);
+        
+        for (u32 l = 0; l < count; ++l)
+        {
+            if (l == dead) {
+                assert(!solved[l]);
+                continue;
+            }
+            
+            assert(solved[l]);
+            assert(memcmp(sudokus[l], solutions[(start + l) % SUDOKU_TEST_FILES], SIMD_MAX_SIZE) == 0);
+        }
+        
+        if (print_result) printf("simd batch %u: %u lanes\n", start, count);
+    }
+    
+    free(trail);
+}
@@ -0,0 +1,215 @@
+// search trace for the debugger, include after sudoku.cpp
+//
+// every debug_callback call is one step. a step only keep what changed since the
+// previous one as xor deltas (board cell or candidate mask of one cell), so the
+// same delta move the state forward and back. all deltas live in one flat array,
+// the state is also saved in full every SUDOKU_TRACE_KEYFRAME_INTERVAL steps.
+// seeking to any step start from the view itself or the keyframe before the
+// step, whichever is closer, so it never apply more than one interval of steps
+
+#define SUDOKU_TRACE_KEYFRAME_INTERVAL 64
+
+// index < max_size: candidate mask of cell index, else board cell index - max_size
+struct SudokuTraceDelta {
+    u16 index;
+    u16 bits;
+};
+
+struct SudokuTraceStep {
+    u32 delta_begin; // deltas of the step end where the next step begin
+    u16 move_index;  // cell the search just placed
+    u8 val;
+};
+
+struct SudokuTrace {
+    u32 max_size;
+    
+    // state after the last recorded step, new steps are diffed against it
+    u8 sudoku[SUDOKU_MAX_CELLS];
+    u16 candidates[SUDOKU_MAX_CELLS];
+    
+    // step 0 is the start state, it has no deltas
+    SudokuTraceStep *steps;
+    u32 step_count;
+    u32 step_capacity;
+    
+    SudokuTraceDelta *deltas;
+    u32 delta_count;
+    u32 delta_capacity;
+    
+    // board then candidates of step k * SUDOKU_TRACE_KEYFRAME_INTERVAL
+    u8 *keyframes;
+    u32 keyframe_count;
+    u32 keyframe_capacity;
+};
+
+// one reconstructed step, keep it around so stepping by one only apply one step of deltas
+struct SudokuTraceView {
+    u32 step;
+    u32 move_index;
+    u8 sudoku[SUDOKU_MAX_CELLS];
+    u16 candidates[SUDOKU_MAX_CELLS];
+};
+
+inline u32 sudoku_trace_keyframe_size(SudokuTrace *trace)
+{
+    return trace->max_size * (sizeof(u8) + sizeof(u16));
+}
+
+// grow a flat array by doubling, count is the number of items the caller want to add
+inline void *sudoku_trace_reserve(void *items, u32 *capacity, u32 used, u32 count, u32 item_size)
+{
+    if (used + count <= *capacity)
+        return items;
+    
+    u32 new_capacity = *capacity ? *capacity * 2 : 256;
+    while (new_capacity < used + count)
+        new_capacity *= 2;
+    
+    *capacity = new_capacity;
+    return realloc(items, (u64)new_capacity * item_size);
+}
+
+void sudoku_trace_save_keyframe(SudokuTrace *trace)
+{
+    u32 size = sudoku_trace_keyframe_size(trace);
+    trace->keyframes = (u8*)sudoku_trace_reserve(trace->keyframes, &trace->keyframe_capacity, trace->keyframe_count, 1, size);
+    
+    u8 *keyframe = trace->keyframes + (u64)trace->keyframe_count++ * size;
+    memcpy(keyframe, trace->sudoku, trace->max_size);
+    memcpy(keyframe + trace->max_size, trace->candidates, trace->max_size * sizeof(u16));
+}
+
+// start state is step 0, only the first plane of candidates is traced
+void sudoku_trace_init(SudokuTrace *trace, u8 *sudoku, u16 *candidates, u32 max_size)
+{
+    memset(trace, 0, sizeof(SudokuTrace));
+    trace->max_size = max_size;
+    memcpy(trace->sudoku, sudoku, max_size);
+    memcpy(trace->candidates, candidates, max_size * sizeof(u16));
+    
+    trace->steps = (SudokuTraceStep*)sudoku_trace_reserve(trace->steps, &trace->step_capacity, 0, 1, sizeof(SudokuTraceStep));
+    trace->steps[0].delta_begin = 0;
+    trace->steps[0].move_index = (u16)max_size;
+    trace->steps[0].val = 0;
+    trace->step_count = 1;
+    
+    sudoku_trace_save_keyframe(trace);
+}
+
+void sudoku_trace_free(SudokuTrace *trace)
+{
+    free(trace->steps);
+    free(trace->deltas);
+    free(trace->keyframes);
+    trace->steps = 0;
+    trace->deltas = 0;
+    trace->keyframes = 0;
+    trace->step_count = trace->delta_count = trace->keyframe_count = 0;
+}
+
+// last step index, steps go from 0 to sudoku_trace_last
+inline u32 sudoku_trace_last(SudokuTrace *trace)
+{
+    return trace->step_count - 1;
+}
+
+void sudoku_trace_record(SudokuTrace *trace, u8 *sudoku, u16 *candidates, u32 index, u32 val)
+{
+    u32 max_size = trace->max_size;
+    trace->steps = (SudokuTraceStep*)sudoku_trace_reserve(trace->steps, &trace->step_capacity, trace->step_count, 1, sizeof(SudokuTraceStep));
+    trace->deltas = (SudokuTraceDelta*)sudoku_trace_reserve(trace->deltas, &trace->delta_capacity, trace->delta_count, max_size * 2, sizeof(SudokuTraceDelta));
+    
+    SudokuTraceStep *step = trace->steps + trace->step_count++;
+    step->delta_begin = trace->delta_count;
+    step->move_index = (u16)index;
+    step->val = (u8)val;
+    
+    for (u32 i = 0; i < max_size; ++i)
+    {
+        u16 bits = trace->candidates[i] ^ candidates[i];
+        if (bits) {
+            SudokuTraceDelta *delta = trace->deltas + trace->delta_count++;
+            delta->index = (u16)i;
+            delta->bits = bits;
+            trace->candidates[i] = candidates[i];
+        }
+        
+        bits = trace->sudoku[i] ^ sudoku[i];
+        if (bits) {
+            SudokuTraceDelta *delta = trace->deltas + trace->delta_count++;
+            delta->index = (u16)(max_size + i);
+            delta->bits = bits;
+            trace->sudoku[i] = sudoku[i];
+        }
+    }
+    
+    if (sudoku_trace_last(trace) % SUDOKU_TRACE_KEYFRAME_INTERVAL == 0)
+        sudoku_trace_save_keyframe(trace);
+}
+
+// debug_callback for the engines, context is the SudokuTrace
+void sudoku_trace_callback(void *context, u8 *sudoku, u16 *sudoku_possible, u32 index, u32 val)
+{
+    SudokuTrace *trace = (SudokuTrace*)context;
+    sudoku_trace_record(trace, sudoku, sudoku_possible, index, val);
+}
+
+// xor the deltas of step k into the view, going into step k or back out of it
+void sudoku_trace_apply(SudokuTrace *trace, SudokuTraceView *view, u32 k)
+{
+    u32 max_size = trace->max_size;
+    u32 end = k + 1 < trace->step_count ? trace->steps[k + 1].delta_begin : trace->delta_count;
+    for (u32 d = trace->steps[k].delta_begin; d < end; ++d)
+    {
+        SudokuTraceDelta *delta = trace->deltas + d;
+        if (delta->index < max_size)
+            view->candidates[delta->index] ^= delta->bits;
+        else
+            view->sudoku[delta->index - max_size] ^= (u8)delta->bits;
+    }
+}
+
+void sudoku_trace_view_init(SudokuTrace *trace, SudokuTraceView *view)
+{
+    view->step = 0;
+    view->move_index = trace->steps[0].move_index;
+    memcpy(view->sudoku, trace->keyframes, trace->max_size);
+    memcpy(view->candidates, trace->keyframes + trace->max_size, trace->max_size * sizeof(u16));
+}
+
+// move the view to step (clamped to the last step)
+void sudoku_trace_seek(SudokuTrace *trace, SudokuTraceView *view, u32 step)
+{
+    u32 last = sudoku_trace_last(trace);
+    if (step > last)
+        step = last;
+    
+    u32 key = step / SUDOKU_TRACE_KEYFRAME_INTERVAL;
+    u32 key_step = key * SUDOKU_TRACE_KEYFRAME_INTERVAL;
+    u32 distance = view->step > step ? view->step - step : step - view->step;
+    
+    if (distance > step - key_step)
+    {
+        u32 size = sudoku_trace_keyframe_size(trace);
+        u8 *keyframe = trace->keyframes + (u64)key * size;
+        memcpy(view->sudoku, keyframe, trace->max_size);
+        memcpy(view->candidates, keyframe + trace->max_size, trace->max_size * sizeof(u16));
+        view->step = key_step;
+    }
+    
+    for (; view->step < step; ++view->step)
+        sudoku_trace_apply(trace, view, view->step + 1);
+    for (; view->step > step; --view->step)
+        sudoku_trace_apply(trace, view, view->step);
+    
+    view->move_index = trace->steps[step].move_index;
+}
+
+// bytes held by the trace, for the hud
+inline u64 sudoku_trace_memory(SudokuTrace *trace)
+{
+    return (u64)trace->step_capacity * sizeof(SudokuTraceStep) +
+        (u64)trace->delta_capacity * sizeof(SudokuTraceDelta) +
+        (u64)trace->keyframe_capacity * sudoku_trace_keyframe_size(trace);
+}